@@ -6,7 +6,7 @@
 /** BSD random var. */
 static bsd_u_long bsd_rand_next = 2;
 
-int bsd_rand(void)
+int bsd_rand_r(bsd_u_long *next)
 {
   /*
    * Compute x = (7^5 * x) mod (2^31 - 1)
@@ -19,16 +19,21 @@ int bsd_rand(void)
   long hi, lo, x;
 
   /* Must be in [1, 0x7ffffffe] range at this point. */
-  hi = (long)(bsd_rand_next / 127773);
-  lo = (long)(bsd_rand_next % 127773);
+  hi = (long)(*next / 127773);
+  lo = (long)(*next % 127773);
   x = 16807 * lo - 2836 * hi;
   if (x < 0)
     x += 0x7fffffff;
-  bsd_rand_next = (bsd_u_long)x;
+  *next = (bsd_u_long)x;
   /* Transform to [0, 0x7ffffffd] range. */
   return (int)(x - 1);
 }
 
+int bsd_rand(void)
+{
+  return bsd_rand_r(&bsd_rand_next);
+}
+
 void bsd_srand(bsd_u_int seed)
 {
   /* Transform to [1, 0x7ffffffe] range. */
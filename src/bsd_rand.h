@@ -14,6 +14,14 @@ extern "C" {
  */
 int bsd_rand(void);
 
+/** \brief Reentrant BSD rand() implementation.
+ *
+ * Same sequence as bsd_rand(), but state is kept by the caller.
+ *
+ * \param next Random state, must be in [1, 0x7ffffffe] range.
+ */
+int bsd_rand_r(bsd_u_long *next);
+
 /** \brief FreeBSD srand() implementation.
  *
  * Compiled in whenever not using FreeBSD() in which case it can be dynamically loaded.
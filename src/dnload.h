@@ -209,6 +209,7 @@ static void asm_exit(void)
 #define dnload_SDL_Delay SDL_Delay
 #define dnload_SDL_DestroyCond SDL_DestroyCond
 #define dnload_SDL_DestroyMutex SDL_DestroyMutex
+#define dnload_SDL_GetCPUCount SDL_GetCPUCount
 #define dnload_SDL_GetTicks SDL_GetTicks
 #define dnload_SDL_Init SDL_Init
 #define dnload_SDL_OpenAudio SDL_OpenAudio
@@ -302,6 +303,7 @@ static void asm_exit(void)
 #define dnload_SDL_Delay g_symbol_table.SDL_Delay
 #define dnload_SDL_DestroyCond g_symbol_table.SDL_DestroyCond
 #define dnload_SDL_DestroyMutex g_symbol_table.SDL_DestroyMutex
+#define dnload_SDL_GetCPUCount g_symbol_table.SDL_GetCPUCount
 #define dnload_SDL_GetTicks g_symbol_table.SDL_GetTicks
 #define dnload_SDL_Init g_symbol_table.SDL_Init
 #define dnload_SDL_OpenAudio g_symbol_table.SDL_OpenAudio
@@ -399,6 +401,7 @@ static struct SymbolTableStruct
   void (*SDL_Delay)(Uint32);
   void (*SDL_DestroyCond)(SDL_cond*);
   void (*SDL_DestroyMutex)(SDL_mutex*);
+  int (*SDL_GetCPUCount)(void);
   uint32_t (*SDL_GetTicks)(void);
   int (*SDL_Init)(Uint32);
   int (*SDL_OpenAudio)(SDL_AudioSpec*, SDL_AudioSpec*);
@@ -500,6 +503,7 @@ static const char g_dynstr[] = ""
 "SDL_Delay\0"
 "SDL_DestroyCond\0"
 "SDL_DestroyMutex\0"
+"SDL_GetCPUCount\0"
 "SDL_GetTicks\0"
 "SDL_Init\0"
 "SDL_OpenAudio\0"
@@ -92,6 +92,21 @@ typedef uint8_t sample_t;
 /// Intro length (in frames).
 #define INTRO_LENGTH_FRAMES (INTRO_LENGTH_SECONDS * 1000 / FRAME_MILLISECONDS)
 
+/// Number of threads generating states for consecutive frames at the same time (1 for serial).
+#define STATE_WORKERS 3
+
+/// Number of states that can be generated ahead of rendering.
+#define STATE_QUEUE_DEPTH (STATE_WORKERS * 2)
+
+/// Number of threads building visual assets during precalculation (1 for serial).
+#define PRECALC_WORKERS 4
+
+/// Start playback while audio is still being generated.
+#define AUDIO_STREAMING
+
+/// Seconds of audio generated before playback starts when streaming.
+#define AUDIO_STREAMING_PRELOAD 4
+
 /// Clear all buffers when clearing - advantageous on some architectures.
 #define RENDER_CLEAR_ALL_BUFFERS
 
@@ -226,6 +241,24 @@ static void set_verbose(bool op)
   g_verbose = op;
 }
 
+/// Geometry cache file, empty if not used.
+static std::string g_geometry_cache;
+
+/// Accessor.
+///
+/// \return Geometry cache file, empty if not used.
+static const std::string& get_geometry_cache()
+{
+  return g_geometry_cache;
+}
+/// Set geometry cache file.
+///
+/// \param op Geometry cache file, empty to not use.
+static void set_geometry_cache(const std::string &op)
+{
+  g_geometry_cache = op;
+}
+
 #else
 
 /// Globally disable developer mode.
@@ -248,51 +281,7 @@ static bool is_developer()
 #include "bsd_rand.c"
 #endif
 
-/// Boolean random value.
-///
-/// \returns True or false.
-bool brand()
-{
-  return static_cast<bool>(bsd_rand() & 0x1);
-}
-
-/// Boolean random value that returns either of two floating point values.
-///
-/// \param aa First floating point value.
-/// \param bb Second floating point value.
-/// \return Either aa or bb.
-float brand(float aa, float bb)
-{
-  return brand() ? aa : bb;
-}
-
-/// Random float value.
-///
-/// \param op Given maximum value.
-/// \return Random value between 0 and given value.
-static float frand(float op)
-{
-  return static_cast<float>(bsd_rand() & 0xFFFF) * ((1.0f / 65535.0f) * op);
-}
-
-/// Random float value.
-///
-/// \param minimum Given minimum value.
-/// \param maximum Given maximum value.
-/// \return Random value between minimum and maximum value.
-static float frand(float minimum, float maximum)
-{
-  return frand(maximum - minimum) + minimum;
-}
-
-/// Random unsigned value.
-///
-/// \param op Random cap.
-/// \return Random value from range [0, op[
-static unsigned urand(unsigned op)
-{
-  return static_cast<unsigned>(bsd_rand() % static_cast<int>(op));
-}
+#include "verbatim_random.hpp"
 
 #if 0 // Stateless random disabled for now, not needed.
 #if defined(USE_MT_RAND)
@@ -351,6 +340,10 @@ static float frandom(float minimum, float maximum)
 #include "verbatim_logical_mesh.hpp"
 #include "verbatim_spline.hpp"
 #include "verbatim_state_queue.hpp"
+#include "verbatim_task_graph.hpp"
+#if defined(USE_LD)
+#include "verbatim_geometry_cache.hpp"
+#endif
 
 // Additional program logic.
 #include "intro_aqueduct.hpp"
@@ -578,6 +571,13 @@ static sample_t g_audio_buffer[AUDIO_BUFFER_SIZE / sizeof(sample_t)];
 /// Current audio position.
 static uint8_t *g_audio_position = reinterpret_cast<uint8_t*>(g_audio_buffer);
 
+#if defined(AUDIO_STREAMING)
+#include "synth/song_writer.hpp"
+
+/// Audio generation progress.
+static AudioStream g_audio_stream;
+#endif
+
 /// \brief Update audio stream.
 ///
 /// \param userdata Not used.
@@ -587,11 +587,17 @@ static void audio_callback(void *userdata, Uint8 *stream, int len)
 {
   const uint8_t *audio_stream_in = g_audio_position;
 
-#if defined(USE_LD)
-  const uint8_t *audio_stream_end = reinterpret_cast<const uint8_t*>(g_audio_buffer) + AUDIO_BUFFER_SIZE;
-  if(audio_stream_in + len > audio_stream_end)
+#if defined(USE_LD) || defined(AUDIO_STREAMING)
+  const int audio_size = static_cast<int>(AUDIO_BUFFER_SIZE);
+  const int audio_offset = static_cast<int>(audio_stream_in - reinterpret_cast<const uint8_t*>(g_audio_buffer));
+#if defined(AUDIO_STREAMING)
+  const int audio_ready = static_cast<int>(g_audio_stream.ready.load(std::memory_order_acquire));
+#else
+  const int audio_ready = audio_size;
+#endif
+  if(audio_offset + len > audio_ready)
   {
-    const int len_audio = static_cast<int>(audio_stream_end - audio_stream_in);
+    const int len_audio = (audio_ready > audio_offset) ? (audio_ready - audio_offset) : 0;
 
     for(int ii = 0; (ii < len_audio); ++ii)
     {
@@ -602,7 +608,8 @@ static void audio_callback(void *userdata, Uint8 *stream, int len)
       stream[ii] = 0;
     }
 
-    g_audio_position += len_audio;
+    // Play silence if generation has not caught up, but keep advancing to stay in sync.
+    g_audio_position += (audio_offset + len > audio_size) ? (audio_size - audio_offset) : len;
   }
   else
 #endif
@@ -737,6 +744,7 @@ static const char *g_shader_vertex_geometry_plain = ""
 "uniform highp mat4 W;"
 "uniform highp mat3 B;"
 "uniform mediump float V;"
+"uniform highp float Z;"
 "varying lowp vec3 f;"
 "varying lowp vec3 n;"
 "varying mediump vec3 r;"
@@ -744,7 +752,7 @@ static const char *g_shader_vertex_geometry_plain = ""
 "precision mediump float;"
 "void main()"
 "{"
-"vec4 p=vec4(P,1.);"
+"vec4 p=vec4(P*Z,1.);"
 "f=C;"
 "n=B*N;"
 "r=(W*p).xyz;"
@@ -829,6 +837,7 @@ static const char *g_shader_vertex_geometry_shadow = ""
 "uniform highp mat3 B;"
 "uniform mediump vec3 L;"
 "uniform mediump float V;"
+"uniform highp float Z;"
 "varying mediump float d;"
 "varying lowp vec4 f;"
 "varying mediump vec2 s;"
@@ -836,7 +845,7 @@ static const char *g_shader_vertex_geometry_shadow = ""
 "precision mediump float;"
 "void main()"
 "{"
-"vec4 p=vec4(P,1.);"
+"vec4 p=vec4(P*Z,1.);"
 "vec4 v=S*p;"
 "vec3 u=v.xyz/v.w*.5+.5;"
 "s=u.xy;"
@@ -885,13 +894,14 @@ static const char *g_shader_fragment_geometry_shadow = ""
 static const char *g_shader_vertex_shadow_map = ""
 "attribute vec3 P;"
 "uniform highp mat4 S;"
+"uniform highp float Z;"
 #if !defined(RENDERER_ENABLE_DEPTH_TEXTURE)
 "varying mediump float d;"
 #endif
 "precision mediump float;"
 "void main()"
 "{"
-"vec4 p=S*vec4(P,1.);"
+"vec4 p=S*vec4(P*Z,1.);"
 #if !defined(RENDERER_ENABLE_DEPTH_TEXTURE)
 "d=(p.z/p.w*.5+.5)*255.;"
 #endif
@@ -1048,19 +1058,20 @@ static const char *g_shader_fragment_blit = ""
 /// \param width Width Screen width.
 /// \param height Height Screen height.
 /// \param ambient Ambient level.
+/// \param rnd Random number generator.
 /// \param seed Random seed.
-static ImageGrayUptr generate_image_screenspace(unsigned width, unsigned height, float ambient,
+static ImageGrayUptr generate_image_screenspace(unsigned width, unsigned height, float ambient, Random &rnd,
     unsigned seed)
 {
   uptr<ImageGray> ret(new ImageGray(width, height));
   ImageGrayUptr noise[9];
 
-  bsd_srand(seed);
+  rnd.srand(seed);
 
   for(unsigned ii = 0; (ii < 9); ++ii)
   {
     noise[ii] = new ImageGray((ii + 1) * 143 / 5, (ii + 1) * 17 / 5);
-    noise[ii]->noise();
+    noise[ii]->noise(rnd);
   }
 
   for(unsigned jj = 0; (height > jj); ++jj)
@@ -1154,6 +1165,46 @@ struct GlobalContainer
     static const unsigned ISLAND_FILLER_LAST = 8;
     /// \endcond
 
+    /// Designer maze size in cells.
+    /// \cond
+    static const unsigned MAZE_FULL_WIDTH = 2;
+    static const unsigned MAZE_FULL_HEIGHT = 8;
+    static const unsigned MAZE_FAKE_HEIGHT = 3;
+    /// \endcond
+
+    /// Hellraiser maze size in cells.
+    /// \cond
+    static const unsigned MAZE_HELLRAISER_WIDTH = 5;
+    static const unsigned MAZE_HELLRAISER_HEIGHT = 2;
+    /// \endcond
+
+    /// Random seed of the designer maze.
+    static const unsigned MAZE_FULL_SEED = 1904783453;
+
+    /// Number of visual precalculation tasks.
+    ///
+    /// Tasks are listed in the order of original serial generation, staging areas are merged in this order.
+    static const unsigned PRECALC_COUNT = 15 + AQUEDUCT_VARIATION_COUNT + 5;
+    /// \cond
+    static const unsigned PRECALC_SKYBOX_HORRORI = 0;
+    static const unsigned PRECALC_SKYBOX_NORMAL = 1;
+    static const unsigned PRECALC_SKYBOX_OVERCAST = 2;
+    static const unsigned PRECALC_HAAMU_MOELLI = 3;
+    static const unsigned PRECALC_MAZE_RESOURCES = 4;
+    static const unsigned PRECALC_ISLAND_MAZE = 5;
+    static const unsigned PRECALC_ISLAND_FILLER = 6;
+    static const unsigned PRECALC_MAZE_FULL = 9;
+    static const unsigned PRECALC_MAZE_FAKE = 10;
+    static const unsigned PRECALC_COLISEUM = 11;
+    static const unsigned PRECALC_ISLAND_COLISEUM = 12;
+    static const unsigned PRECALC_ISLAND_HELLRAISER = 13;
+    static const unsigned PRECALC_MAZE_HELLRAISER = 14;
+    static const unsigned PRECALC_AQUEDUCT = 15;
+    static const unsigned PRECALC_ISLAND_TRIP = PRECALC_AQUEDUCT + AQUEDUCT_VARIATION_COUNT;
+    static const unsigned PRECALC_IMAGE_CREEPY = PRECALC_ISLAND_TRIP + 3;
+    static const unsigned PRECALC_IMAGE_MILD = PRECALC_IMAGE_CREEPY + 1;
+    /// \endcond
+
   public:
     /// \cond
     Program program_haamu_shape;
@@ -1173,6 +1224,8 @@ struct GlobalContainer
     Direction direction;
     HaamuUptr haamu;
     MoelliUptr moelli;
+    MazePortalsUptr maze_portals_full;
+    MazePortalsUptr maze_portals_hellraiser;
     Skybox skybox_horrori;
     Skybox skybox_normal;
     Skybox skybox_overcast;
@@ -1205,6 +1258,20 @@ struct GlobalContainer
     /// Object database.
     ObjectDatabase m_object_database[ARRANGEMENT_COUNT];
 
+    /// Staging geometry of precalculation tasks.
+    GeometryBuffer m_precalc_geometry[PRECALC_COUNT];
+
+    /// Staging objects of precalculation tasks.
+    ObjectDatabase m_precalc_database[PRECALC_COUNT];
+
+    /// Random number generators of precalculation tasks, left in their final state.
+    Random m_precalc_random[PRECALC_COUNT];
+
+#if defined(USE_LD)
+    /// Geometry cache, owns world meshes if they were read from the cache.
+    uptr<GeometryCache> m_geometry_cache;
+#endif
+
   public:
     GlobalContainer(unsigned screen_w, unsigned screen_h, unsigned shadow_w, unsigned shadow_h) :
       program_haamu_shape(g_shader_vertex_geometry_haamu_shape, g_shader_fragment_geometry_haamu_shape),
@@ -1229,7 +1296,9 @@ struct GlobalContainer
       fnt(36, g_font_options),
       projection(mat4::projection(CAMERA_FOV_RADIANS, screen_w, screen_h, CAMERA_NEAR, CAMERA_FAR)),
       screen_width(screen_w),
-      screen_height(screen_h)
+      screen_height(screen_h),
+      geometry_aqueduct(true),
+      geometry_maze(true)
     {
       for(unsigned ii = static_cast<unsigned>('+'); (static_cast<unsigned>('z') >= ii); ++ii)
       {
@@ -1259,63 +1328,78 @@ struct GlobalContainer
       return m_object_database[idx];
     }
 
-    /// Precalculation of visuals.
-    void precalculateVisuals()
+  private:
+    /// Get geometry buffer a precalculation task is merged into.
+    ///
+    /// \param idx Task index.
+    /// \return Geometry buffer.
+    GeometryBuffer& getPrecalcTarget(unsigned idx)
     {
-#if defined(USE_LD)
-      uint32_t precalc_start = dnload_SDL_GetTicks();
-#endif
-
-      // Read spline data for ghost.
-      spline_ghost.readData(g_ghost_light_path);
-
-      // Skyboxes.
-      skybox_horrori.construct(geometry_generic, 1741.0f, Skybox::coloring_func_horrori);
-      skybox_horrori.setColorForward1(vec3(0.9f, 0.6f, 0.01f));
-      skybox_horrori.setColorForward2(vec3(0.2f, 0.0f, 0.0f));
-      skybox_horrori.setColorBackward(vec3(-1.0f, -1.0f, -1.0f));
-      skybox_normal.construct(geometry_generic, 1741.0f, Skybox::coloring_func_normal);
-      skybox_normal.setColorForward1(vec3(0.5f, 0.5f, 0.45f));
-      skybox_normal.setColorForward2(vec3(0.0f, 0.0f, 0.0f));
-      skybox_normal.setColorBackward(vec3(0.4f, 0.4f, 0.7f));
-      skybox_overcast.construct(geometry_generic, 1741.0f, Skybox::coloring_func_overcast);
-      skybox_overcast.setColorForward1(vec3(0.5f, 0.5f, 0.45f));
-      skybox_overcast.setColorForward2(vec3(0.6f, 0.6f, 0.7f));
-      skybox_overcast.setColorBackward(vec3(-0.4f, -0.4f, -0.4f));
+      if((PRECALC_MAZE_RESOURCES == idx) || (PRECALC_MAZE_FULL == idx) || (PRECALC_MAZE_FAKE == idx) ||
+          (PRECALC_MAZE_HELLRAISER == idx))
+      {
+        return geometry_maze;
+      }
+      if((PRECALC_AQUEDUCT <= idx) && (PRECALC_ISLAND_TRIP > idx))
+      {
+        return geometry_aqueduct;
+      }
+      return geometry_generic;
+    }
 
-      haamu = new Haamu(geometry_generic);
-      moelli = new Moelli(1.0f, 5.0f, geometry_generic);
-      maze_resources = new MazeResources(geometry_maze);
+    /// Run one precalculation task.
+    ///
+    /// Tasks only write into their own staging areas and the assets they construct. Generators that continue
+    /// the random sequence of another generator start from the state that generator was left in.
+    ///
+    /// \param idx Task index.
+    void runPrecalcTask(unsigned idx)
+    {
+      GeometryBuffer &buf = m_precalc_geometry[idx];
+      Random &rnd = m_precalc_random[idx];
 
-      // Main island.
-      island[ISLAND_MAZE] = new FloatingIsland(130.0f, 50.0f, 19, geometry_generic, 1,
-          (2*MAZE_CELL_WIDTH+MAZE_CELL_WALL_THICKNESS)/100.0f, (MAZE_CELL_HEIGHT*8)/130.0f);
+#if defined(USE_LD)
+      if(m_geometry_cache && m_geometry_cache->isLoaded() && is_precalc_world_task(idx))
+      {
+        return;
+      }
+#endif
 
-      // Filler islands.
-      for(unsigned ii = ISLAND_FILLER; (ISLAND_FILLER_LAST >= ii); ++ii)
+      if(PRECALC_SKYBOX_HORRORI == idx)
       {
-        island[ii] = new FloatingIsland(130.0f, 30.0f, 17, geometry_generic, ii);
+        skybox_horrori.construct(buf, rnd, 1741.0f, Skybox::coloring_func_horrori);
       }
+      else if(PRECALC_SKYBOX_NORMAL == idx)
       {
-        mat4 tr = mat4::translation(-449.0f, 48.0f, -501.0f);
-        addObject(island[ISLAND_FILLER + 0]->getMeshLower(), tr, ARRANGEMENT_OPENING);
-        addObject(island[ISLAND_FILLER + 0]->getMeshUpper(), tr, ARRANGEMENT_OPENING);
+        skybox_normal.construct(buf, rnd, 1741.0f, Skybox::coloring_func_normal);
       }
+      else if(PRECALC_SKYBOX_OVERCAST == idx)
       {
-        mat4 tr = mat4::translation(32.0f, 98.0f, -130.0f);
-        addObject(island[ISLAND_FILLER + 1]->getMeshLower(), tr, ARRANGEMENT_OPENING);
-        addObject(island[ISLAND_FILLER + 1]->getMeshUpper(), tr, ARRANGEMENT_OPENING);
+        skybox_overcast.construct(buf, rnd, 1741.0f, Skybox::coloring_func_overcast);
       }
+      else if(PRECALC_HAAMU_MOELLI == idx)
       {
-        mat4 tr = mat4::translation(291.0f, 8.0f, -670.0f);
-        addObject(island[ISLAND_FILLER + 2]->getMeshLower(), tr, ARRANGEMENT_OPENING);
-        addObject(island[ISLAND_FILLER + 2]->getMeshUpper(), tr, ARRANGEMENT_OPENING);
+        haamu = new Haamu(buf, rnd);
+        moelli = new Moelli(1.0f, 5.0f, buf, rnd);
+      }
+      else if(PRECALC_MAZE_RESOURCES == idx)
+      {
+        maze_resources = new MazeResources(buf, rnd);
+      }
+      // Main island.
+      else if(PRECALC_ISLAND_MAZE == idx)
+      {
+        island[ISLAND_MAZE] = new FloatingIsland(130.0f, 50.0f, 19, buf, rnd, 1,
+            (2*MAZE_CELL_WIDTH+MAZE_CELL_WALL_THICKNESS)/100.0f, (MAZE_CELL_HEIGHT*8)/130.0f);
+      }
+      // Filler islands.
+      else if((PRECALC_ISLAND_FILLER <= idx) && (PRECALC_MAZE_FULL > idx))
+      {
+        unsigned island_idx = ISLAND_FILLER + (idx - PRECALC_ISLAND_FILLER);
+        island[island_idx] = new FloatingIsland(130.0f, 30.0f, 17, buf, rnd, island_idx);
       }
-
-      addObject(island[ISLAND_MAZE]->getMeshLower(), mat4::identity(), ARRANGEMENT_MAZE_CULLED);
-      addObject(island[ISLAND_MAZE]->getMeshUpper(), mat4::identity(), ARRANGEMENT_MAZE_SUPPORT);
-
       // Designer maze.
+      else if((PRECALC_MAZE_FULL == idx) || (PRECALC_MAZE_FAKE == idx))
       {
         static const uint8_t ledzideita[2 * 8 * 2] =
         {
@@ -1341,52 +1425,286 @@ struct GlobalContainer
           0x00, 0x00, 0x00, 0x00,
           0x08, 0x00, 0x22, 0x00
         };
-        const vec3 maze_position(-MAZE_CELL_WIDTH - MAZE_CELL_WALL_THICKNESS,
-            -MAZE_CELL_HEIGHT * 8 + 13.0f,
-            MAZE_CELL_WIDTH + MAZE_CELL_WALL_THICKNESS);
+        const vec3 maze_position = get_maze_position_full();
 
-        bsd_srand(1904783453); // FFS
+        if(PRECALC_MAZE_FULL == idx)
+        {
+          rnd.srand(MAZE_FULL_SEED); // FFS
 
-        maze_full = new Maze(2, 8, *maze_resources, m_object_database[ARRANGEMENT_MAZE], geometry_maze,
-            NULL, maze_position, ledzideita, pakkorampit);
+          maze_full = new Maze(MAZE_FULL_WIDTH, MAZE_FULL_HEIGHT, *maze_resources, m_precalc_database[idx], buf,
+              rnd, NULL, maze_position, ledzideita, pakkorampit);
+        }
+        else
+        {
+          rnd = m_precalc_random[PRECALC_MAZE_FULL];
 
-        // Small fake maze since we're not going to look down.
-        maze_fake = new Maze(2, 3, *maze_resources, m_object_database[ARRANGEMENT_MAZE_CULLED], geometry_maze,
-            NULL, maze_position + vec3(0.0f, 26.0f, 0.0f), ledzideita + (5 * 4), pakkorampit + (5 * 4));
+          // Small fake maze since we're not going to look down.
+          maze_fake = new Maze(MAZE_FULL_WIDTH, MAZE_FAKE_HEIGHT, *maze_resources, m_precalc_database[idx], buf,
+              rnd, NULL, maze_position + vec3(0.0f, 26.0f, 0.0f), ledzideita + (5 * 4), pakkorampit + (5 * 4));
+        }
       }
-
       // Coliseum island and coliseum.
+      else if(PRECALC_COLISEUM == idx)
       {
         LogicalMesh msh(COLOR_COLISEUM);
-        mesh_generate_end_scene(msh);
-        mesh_coliseum = msh.insert(geometry_generic, 1);
+        mesh_generate_end_scene(msh, rnd);
+        mesh_coliseum = msh.insert(buf, rnd, 1);
+      }
+      else if(PRECALC_ISLAND_COLISEUM == idx)
+      {
+        island[ISLAND_COLISEUM] = new FloatingIsland(440.0f, 160.0f, 21, buf, rnd, 2, 0.33f, 0.003f);
       }
-      island[ISLAND_COLISEUM] = new FloatingIsland(440.0f, 160.0f, 21, geometry_generic, 2, 0.33f, 0.003f);
-
-      addObject(*mesh_coliseum, mat4::translation(0.0f, 38.0f, 0.0f), ARRANGEMENT_COLISEUM);
-      addObject(island[ISLAND_COLISEUM]->getMeshLower(), mat4::identity(), ARRANGEMENT_COLISEUM_CULLED);
-      addObject(island[ISLAND_COLISEUM]->getMeshUpper(), mat4::identity(), ARRANGEMENT_COLISEUM);
-
       // Hellraiser scene.
+      else if(PRECALC_ISLAND_HELLRAISER == idx)
       {
-        island[ISLAND_HELLRAISER] = new FloatingIsland(105.0f, 105.0f, 8, geometry_generic, 1, 0.4f, 0.1f);
-        addObject(island[ISLAND_HELLRAISER]->getMeshUpper(), mat4::identity(), ARRANGEMENT_HELLRAISER);
+        island[ISLAND_HELLRAISER] = new FloatingIsland(105.0f, 105.0f, 8, buf, rnd, 1, 0.4f, 0.1f);
+      }
+      else if(PRECALC_MAZE_HELLRAISER == idx)
+      {
+        rnd = m_precalc_random[PRECALC_ISLAND_HELLRAISER];
 
-        maze_hellraiser = new Maze(5, 2, *maze_resources, m_object_database[ARRANGEMENT_HELLRAISER],
-            geometry_maze, NULL, vec3(-MAZE_CELL_WIDTH * 2.5f - 2.5f, 14.4f, MAZE_CELL_WIDTH * 2.5f + 2.5f));
+        maze_hellraiser = new Maze(MAZE_HELLRAISER_WIDTH, MAZE_HELLRAISER_HEIGHT, *maze_resources,
+            m_precalc_database[idx], buf, rnd, NULL, get_maze_position_hellraiser());
+      }
+      // Aqueducts.
+      else if((PRECALC_AQUEDUCT <= idx) && (PRECALC_ISLAND_TRIP > idx))
+      {
+        unsigned aqueduct_idx = idx - PRECALC_AQUEDUCT;
+        aqueduct[aqueduct_idx] = new Aqueduct(aqueduct_idx / Aqueduct::AQUEDUCT_COUNT,
+            aqueduct_idx % Aqueduct::AQUEDUCT_COUNT, buf, rnd, aqueduct_idx + 1);
+      }
+      // Aqueduct scene islands on the way.
+      else if((PRECALC_ISLAND_TRIP <= idx) && (PRECALC_IMAGE_CREEPY > idx))
+      {
+        unsigned island_idx = ISLAND_TRIP + (idx - PRECALC_ISLAND_TRIP);
+        island[island_idx] = new FloatingIsland(80.0f, 15.0f, 13, buf, rnd, island_idx);
       }
+      // Images.
+      else if(PRECALC_IMAGE_CREEPY == idx)
+      {
+        image_screenspace_creepy = generate_image_screenspace(256, 256, 0.18f, rnd, 1);
+      }
+      else
+      {
+        image_screenspace_mild = generate_image_screenspace(256, 256, 0.84f, rnd, 2);
+      }
+    }
 
-      // Aqueduct(s) with trip islands.
-      for(unsigned ii = 0; (ii < Aqueduct::AQUEDUCT_COUNT); ++ii)
+    /// Precalculation task function.
+    ///
+    /// \param data Global container.
+    /// \param idx Task index.
+    static void precalc_task(void *data, unsigned idx)
+    {
+      static_cast<GlobalContainer*>(data)->runPrecalcTask(idx);
+    }
+
+    /// Get origin of the designer maze.
+    ///
+    /// \return Maze origin.
+    static vec3 get_maze_position_full()
+    {
+      return vec3(-MAZE_CELL_WIDTH - MAZE_CELL_WALL_THICKNESS,
+          -MAZE_CELL_HEIGHT * 8 + 13.0f,
+          MAZE_CELL_WIDTH + MAZE_CELL_WALL_THICKNESS);
+    }
+
+    /// Get origin of the hellraiser maze.
+    ///
+    /// \return Maze origin.
+    static vec3 get_maze_position_hellraiser()
+    {
+      return vec3(-MAZE_CELL_WIDTH * 2.5f - 2.5f, 14.4f, MAZE_CELL_WIDTH * 2.5f + 2.5f);
+    }
+
+#if defined(USE_LD)
+    /// Tell if a precalculation task only builds world geometry.
+    ///
+    /// World geometry is only referred to by the object databases and can be cached.
+    ///
+    /// \param idx Task index.
+    /// \return True if yes, false if no.
+    static bool is_precalc_world_task(unsigned idx)
+    {
+      return ((PRECALC_MAZE_RESOURCES <= idx) && (PRECALC_IMAGE_CREEPY > idx));
+    }
+
+    /// Version of world geometry generators.
+    ///
+    /// Increment when changing mesh, CSG, maze, island or aqueduct generation so existing caches are rejected.
+    static const unsigned GEOMETRY_CACHE_GENERATOR_VERSION = 3;
+
+    /// Get geometry cache key.
+    ///
+    /// Combines generator version with generator inputs. Edits outside the generators keep the cache valid.
+    ///
+    /// \return Key computed from generator inputs.
+    static uint32_t get_geometry_cache_key()
+    {
+      const vec3 positions[] =
+      {
+        get_maze_position_full(),
+        get_maze_position_hellraiser()
+      };
+      const unsigned inputs[] =
+      {
+        GEOMETRY_CACHE_GENERATOR_VERSION,
+        PRECALC_COUNT,
+        AQUEDUCT_VARIATION_COUNT,
+        ISLAND_COUNT,
+        ARRANGEMENT_COUNT,
+        MAZE_FULL_SEED,
+        MAZE_FULL_WIDTH,
+        MAZE_FULL_HEIGHT,
+        MAZE_FAKE_HEIGHT,
+        MAZE_HELLRAISER_WIDTH,
+        MAZE_HELLRAISER_HEIGHT,
+        sizeof(Vertex),
+        sizeof(EdgeVertex),
+        sizeof(Object),
+        sizeof(IndexRun),
+        static_cast<unsigned>(MAZE_CELL_WIDTH * 1024.0f),
+        static_cast<unsigned>(MAZE_CELL_HEIGHT * 1024.0f),
+        static_cast<unsigned>(MAZE_CELL_WALL_THICKNESS * 1024.0f)
+      };
+      unsigned ret = 0;
+
+      for(unsigned vv : inputs)
+      {
+        ret = HashChain::combine(ret, vv);
+      }
+      for(const vec3 &vv : positions)
       {
-        for(unsigned jj = 0; (jj < Aqueduct::AQUEDUCT_COUNT); ++jj)
+        for(unsigned ii = 0; (3 > ii); ++ii)
         {
-          unsigned idx = (ii * Aqueduct::AQUEDUCT_COUNT) + jj;
-          aqueduct[idx] = new Aqueduct(ii, jj, geometry_aqueduct, idx + 1);
+          ret = HashChain::combine(ret, static_cast<unsigned>(static_cast<int>(vv[ii] * 1024.0f)));
         }
       }
-      bsd_srand(8);
+      return ret;
+    }
+
+    /// Get name of a precalculation task.
+    ///
+    /// \param idx Task index.
+    /// \return Name for printing.
+    static std::string get_precalc_task_name(unsigned idx)
+    {
+      std::ostringstream sstr;
+
+      if(PRECALC_SKYBOX_HORRORI == idx)
+      {
+        sstr << "skybox_horrori";
+      }
+      else if(PRECALC_SKYBOX_NORMAL == idx)
+      {
+        sstr << "skybox_normal";
+      }
+      else if(PRECALC_SKYBOX_OVERCAST == idx)
+      {
+        sstr << "skybox_overcast";
+      }
+      else if(PRECALC_HAAMU_MOELLI == idx)
+      {
+        sstr << "haamu_moelli";
+      }
+      else if(PRECALC_MAZE_RESOURCES == idx)
+      {
+        sstr << "maze_resources";
+      }
+      else if(PRECALC_ISLAND_MAZE == idx)
+      {
+        sstr << "island_maze";
+      }
+      else if((PRECALC_ISLAND_FILLER <= idx) && (PRECALC_MAZE_FULL > idx))
+      {
+        sstr << "island_filler_" << (idx - PRECALC_ISLAND_FILLER);
+      }
+      else if(PRECALC_MAZE_FULL == idx)
+      {
+        sstr << "maze_full";
+      }
+      else if(PRECALC_MAZE_FAKE == idx)
+      {
+        sstr << "maze_fake";
+      }
+      else if(PRECALC_COLISEUM == idx)
+      {
+        sstr << "coliseum";
+      }
+      else if(PRECALC_ISLAND_COLISEUM == idx)
+      {
+        sstr << "island_coliseum";
+      }
+      else if(PRECALC_ISLAND_HELLRAISER == idx)
+      {
+        sstr << "island_hellraiser";
+      }
+      else if(PRECALC_MAZE_HELLRAISER == idx)
+      {
+        sstr << "maze_hellraiser";
+      }
+      else if((PRECALC_AQUEDUCT <= idx) && (PRECALC_ISLAND_TRIP > idx))
+      {
+        sstr << "aqueduct_" << (idx - PRECALC_AQUEDUCT);
+      }
+      else if((PRECALC_ISLAND_TRIP <= idx) && (PRECALC_IMAGE_CREEPY > idx))
+      {
+        sstr << "island_trip_" << (idx - PRECALC_ISLAND_TRIP);
+      }
+      else if(PRECALC_IMAGE_CREEPY == idx)
+      {
+        sstr << "image_screenspace_creepy";
+      }
+      else
+      {
+        sstr << "image_screenspace_mild";
+      }
+      return sstr.str();
+    }
+#endif
+
+  private:
+    /// Add world objects into the object databases.
+    ///
+    /// Must be called after world geometry has been generated.
+    void addWorldObjects()
+    {
+      // Filler islands.
+      {
+        mat4 tr = mat4::translation(-449.0f, 48.0f, -501.0f);
+        addObject(island[ISLAND_FILLER + 0]->getMeshLower(), tr, ARRANGEMENT_OPENING);
+        addObject(island[ISLAND_FILLER + 0]->getMeshUpper(), tr, ARRANGEMENT_OPENING);
+      }
+      {
+        mat4 tr = mat4::translation(32.0f, 98.0f, -130.0f);
+        addObject(island[ISLAND_FILLER + 1]->getMeshLower(), tr, ARRANGEMENT_OPENING);
+        addObject(island[ISLAND_FILLER + 1]->getMeshUpper(), tr, ARRANGEMENT_OPENING);
+      }
+      {
+        mat4 tr = mat4::translation(291.0f, 8.0f, -670.0f);
+        addObject(island[ISLAND_FILLER + 2]->getMeshLower(), tr, ARRANGEMENT_OPENING);
+        addObject(island[ISLAND_FILLER + 2]->getMeshUpper(), tr, ARRANGEMENT_OPENING);
+      }
+
+      addObject(island[ISLAND_MAZE]->getMeshLower(), mat4::identity(), ARRANGEMENT_MAZE_CULLED);
+      addObject(island[ISLAND_MAZE]->getMeshUpper(), mat4::identity(), ARRANGEMENT_MAZE_SUPPORT);
+
+      // Designer maze.
+      m_object_database[ARRANGEMENT_MAZE].merge(m_precalc_database[PRECALC_MAZE_FULL]);
+      m_object_database[ARRANGEMENT_MAZE_CULLED].merge(m_precalc_database[PRECALC_MAZE_FAKE]);
+
+      // Coliseum island and coliseum.
+      addObject(*mesh_coliseum, mat4::translation(0.0f, 38.0f, 0.0f), ARRANGEMENT_COLISEUM);
+      addObject(island[ISLAND_COLISEUM]->getMeshLower(), mat4::identity(), ARRANGEMENT_COLISEUM_CULLED);
+      addObject(island[ISLAND_COLISEUM]->getMeshUpper(), mat4::identity(), ARRANGEMENT_COLISEUM);
+
+      // Hellraiser scene.
+      addObject(island[ISLAND_HELLRAISER]->getMeshUpper(), mat4::identity(), ARRANGEMENT_HELLRAISER);
+      m_object_database[ARRANGEMENT_HELLRAISER].merge(m_precalc_database[PRECALC_MAZE_HELLRAISER]);
+
+      // Aqueduct(s) with trip islands.
       {
+        Random rnd(8);
         const Aqueduct *curr = aqueduct[0].get();
         for(float pos = 52.5f; (pos < 1000.0f); pos += 19.0f)
         {
@@ -1407,7 +1725,7 @@ struct GlobalContainer
 
           for(;;)
           {
-            Aqueduct *next = aqueduct[urand(AQUEDUCT_VARIATION_COUNT)].get();
+            Aqueduct *next = aqueduct[rnd.urand(AQUEDUCT_VARIATION_COUNT)].get();
 
             if((curr->hasLeftExtentForward() != next->hasLeftExtentBackward()) ||
                 (curr->hasRightExtentForward() != next->hasRightExtentBackward()))
@@ -1421,13 +1739,7 @@ struct GlobalContainer
         }
       }
 
-      bsd_srand(8);
-
       // Aqueduct scene islands on the way.
-      for(unsigned ii = ISLAND_TRIP; (ii <= ISLAND_TRIP_LAST); ++ii)
-      {
-        island[ii] = new FloatingIsland(80.0f, 15.0f, 13, geometry_generic, ii);
-      }
       {
         const mat4 trn = mat4::translation(50.0f, 40.0f, 850.0f);
         addObject(island[ISLAND_TRIP + 0]->getMeshLower(), trn, ARRANGEMENT_TRIP_ISLANDS);
@@ -1443,16 +1755,151 @@ struct GlobalContainer
         addObject(island[ISLAND_TRIP + 2]->getMeshLower(), trn, ARRANGEMENT_TRIP_ISLANDS);
         addObject(island[ISLAND_TRIP + 2]->getMeshUpper(), trn, ARRANGEMENT_TRIP_ISLANDS);
       }
+    }
+
+    /// Create portal structures of mazes.
+    ///
+    /// \param maze_walls_full Wall data of the designer maze.
+    /// \param maze_walls_hellraiser Wall data of the hellraiser maze.
+    void createMazePortals(const seq<uint8_t> &maze_walls_full, const seq<uint8_t> &maze_walls_hellraiser)
+    {
+      maze_portals_full = new MazePortals(m_object_database[ARRANGEMENT_MAZE], get_maze_position_full(),
+          MAZE_FULL_WIDTH, MAZE_FULL_HEIGHT, maze_walls_full);
+      maze_portals_hellraiser = new MazePortals(m_object_database[ARRANGEMENT_HELLRAISER],
+          get_maze_position_hellraiser(), MAZE_HELLRAISER_WIDTH, MAZE_HELLRAISER_HEIGHT, maze_walls_hellraiser);
+    }
+
+  public:
+    /// Precalculation of visuals.
+    void precalculateVisuals()
+    {
+#if defined(USE_LD)
+      uint32_t precalc_start = dnload_SDL_GetTicks();
+
+      // World geometry is read from the geometry cache instead of generating it if the cache is valid.
+      if(!get_geometry_cache().empty())
+      {
+        m_geometry_cache = new GeometryCache();
+        m_geometry_cache->load(get_geometry_cache(), get_geometry_cache_key());
+      }
+#endif
+
+      // Read spline data for ghost.
+      spline_ghost.readData(g_ghost_light_path);
+
+      // Build assets on several threads. Generators continuing the random sequence of another generator
+      // depend on it, as do mazes on their resources.
+      {
+        TaskGraph graph(PRECALC_COUNT, precalc_task, this);
+
+        graph.addDependency(PRECALC_MAZE_FULL, PRECALC_MAZE_RESOURCES);
+        graph.addDependency(PRECALC_MAZE_FAKE, PRECALC_MAZE_RESOURCES);
+        graph.addDependency(PRECALC_MAZE_FAKE, PRECALC_MAZE_FULL);
+        graph.addDependency(PRECALC_MAZE_HELLRAISER, PRECALC_MAZE_RESOURCES);
+        graph.addDependency(PRECALC_MAZE_HELLRAISER, PRECALC_ISLAND_HELLRAISER);
+
+        graph.run(PRECALC_WORKERS);
+
+#if defined(USE_LD)
+        for(unsigned ii = 0; (PRECALC_COUNT > ii); ++ii)
+        {
+          std::cout << "|precalc(" << get_precalc_task_name(ii) << "): " <<
+            (static_cast<float>(graph.getDuration(ii)) * .001f) << " at " <<
+            (static_cast<float>(graph.getStart(ii)) * .001f) << std::endl;
+        }
+        std::cout << "|precalc(critical path): " << (static_cast<float>(graph.getCriticalPath()) * .001f) <<
+          std::endl;
+#endif
+      }
+
+#if defined(USE_LD)
+      if(m_geometry_cache)
+      {
+        for(unsigned ii = 0; (PRECALC_COUNT > ii); ++ii)
+        {
+          if(!is_precalc_world_task(ii))
+          {
+            continue;
+          }
+          if(m_geometry_cache->isLoaded())
+          {
+            m_geometry_cache->readGeometry(m_precalc_geometry[ii]);
+          }
+          else
+          {
+            m_geometry_cache->writeGeometry(m_precalc_geometry[ii]);
+          }
+        }
+      }
+#endif
+
+      // Merge staging areas in task order so the result does not depend on scheduling.
+      for(unsigned ii = 0; (PRECALC_COUNT > ii); ++ii)
+      {
+        getPrecalcTarget(ii).merge(m_precalc_geometry[ii]);
+      }
+
+      // Skyboxes.
+      skybox_horrori.setColorForward1(vec3(0.9f, 0.6f, 0.01f));
+      skybox_horrori.setColorForward2(vec3(0.2f, 0.0f, 0.0f));
+      skybox_horrori.setColorBackward(vec3(-1.0f, -1.0f, -1.0f));
+      skybox_normal.setColorForward1(vec3(0.5f, 0.5f, 0.45f));
+      skybox_normal.setColorForward2(vec3(0.0f, 0.0f, 0.0f));
+      skybox_normal.setColorBackward(vec3(0.4f, 0.4f, 0.7f));
+      skybox_overcast.setColorForward1(vec3(0.5f, 0.5f, 0.45f));
+      skybox_overcast.setColorForward2(vec3(0.6f, 0.6f, 0.7f));
+      skybox_overcast.setColorBackward(vec3(-0.4f, -0.4f, -0.4f));
+
+#if defined(USE_LD)
+      if(m_geometry_cache && m_geometry_cache->isLoaded())
+      {
+        for(ObjectDatabase &vv : m_object_database)
+        {
+          m_geometry_cache->readDatabase(vv);
+        }
+      }
+      else
+#endif
+      {
+        addWorldObjects();
+      }
 
-      // Done adding objects, sort the databases.
+      // Done adding objects, sort the databases and build hierarchies for culling.
       for(ObjectDatabase &vv : m_object_database)
       {
         vv.sort();
+        vv.buildHierarchy();
       }
 
-      // Generate images.
-      image_screenspace_creepy = generate_image_screenspace(256, 256, 0.18f, 1);
-      image_screenspace_mild = generate_image_screenspace(256, 256, 0.84f, 2);
+      // Mazes the camera enters are culled through the openings in their walls.
+#if defined(USE_LD)
+      if(m_geometry_cache && m_geometry_cache->isLoaded())
+      {
+        seq<uint8_t> maze_walls_full;
+        seq<uint8_t> maze_walls_hellraiser;
+
+        m_geometry_cache->readData(maze_walls_full);
+        m_geometry_cache->readData(maze_walls_hellraiser);
+        createMazePortals(maze_walls_full, maze_walls_hellraiser);
+      }
+      else
+#endif
+      {
+        createMazePortals(maze_full->getWalls(), maze_hellraiser->getWalls());
+      }
+
+#if defined(USE_LD)
+      if(m_geometry_cache && !m_geometry_cache->isLoaded())
+      {
+        for(const ObjectDatabase &vv : m_object_database)
+        {
+          m_geometry_cache->writeDatabase(vv);
+        }
+        m_geometry_cache->writeData(maze_full->getWalls());
+        m_geometry_cache->writeData(maze_hellraiser->getWalls());
+        m_geometry_cache->save(get_geometry_cache(), get_geometry_cache_key());
+      }
+#endif
 
       //gfx::image_png_save(std::string("lol.png"), image_senspace->getWidth(),
       //    image_screenspace->getHeight(), 24, image_screenspace->getExportData());
@@ -1493,6 +1940,8 @@ struct GlobalContainer
         LogicalMesh::get_discarded_edge_count() << " non-visible edges discarded\n" <<
         LogicalMesh::get_discarded_face_count() << " non-visible faces discarded, " <<
         LogicalFace::get_degenerate_count() << " degenerate faces removed\n" <<
+        CompiledMesh::get_acmr_before() << " vertex cache ACMR before ordering faces, " <<
+        CompiledMesh::get_acmr_after() << " after\n" <<
         vgl::get_data_size_edge() << " bytes used for edge data\n" <<
         vgl::get_data_size_index() << " bytes used for index data\n" <<
         vgl::get_data_size_texture() << " bytes used for texture data\n" <<
@@ -1508,7 +1957,7 @@ struct GlobalContainer
 /// Global state.
 ///
 /// Holds global state and global data.
-class GlobalState : public StateQueue
+class GlobalState : public StateQueue<STATE_QUEUE_DEPTH>
 {
   public:
     /// Pass index.
@@ -1536,6 +1985,19 @@ class GlobalState : public StateQueue
     /// Done flag.
     bool m_done;
 
+#if defined(AUDIO_STREAMING)
+    /// Audio generation thread, keeps running after precalc is done.
+    uptr<Thread> m_audio_thread;
+#endif
+
+#if defined(USE_LD)
+    /// Guards mapping of tickets to frames.
+    Mutex m_ticket_mutex;
+
+    /// Offset from ticket to frame, changed by frame jumps.
+    int m_ticket_offset;
+#endif
+
   public:
     /// Constructor.
     ///
@@ -1543,7 +2005,22 @@ class GlobalState : public StateQueue
     /// \param screen_h Screen height.
     GlobalState(unsigned screen_w, unsigned screen_h) :
       m_globals(screen_w, screen_h, 1024, 1024),
-      m_done(false) { }
+      m_done(false)
+    {
+#if defined(USE_LD)
+      m_ticket_offset = 0;
+#endif
+    }
+
+#if defined(AUDIO_STREAMING)
+    /// Destructor.
+    ///
+    /// Stops audio generation if it's still running.
+    ~GlobalState()
+    {
+      g_audio_stream.quit.store(true);
+    }
+#endif
 
   private:
     /// Add a string.
@@ -1564,7 +2041,7 @@ class GlobalState : public StateQueue
       unsigned previous_char = 0;
 #endif
 
-      bsd_srand(static_cast<unsigned>(*content));
+      Random rnd(static_cast<unsigned>(*content));
 
       for(;; ++content)
       {
@@ -1598,7 +2075,7 @@ class GlobalState : public StateQueue
 
         // Check for phasing and rendering at all.
         {
-          float char_phase = frand(PHASE_AREA);
+          float char_phase = rnd.frand(PHASE_AREA);
           float instep = linear_step(char_phase, char_phase + PHASE_IN, phase);
           float outstep = linear_step_down(PHASE_OUT + char_phase, PHASE_OUT + PHASE_IN + char_phase, phase);
           float squish = instep * outstep;
@@ -1767,6 +2244,26 @@ class GlobalState : public StateQueue
       op.addObject(vv.getObject(), mtr * mat4::translation(vv.getDirection() * dist));
     }
 
+    /// Fill maze visible from the camera.
+    ///
+    /// If camera is not within the maze, all objects are added.
+    ///
+    /// \param op State to fill.
+    /// \param arrangement Arrangement containing the maze.
+    /// \param portals Portal structure of the maze.
+    void fillMaze(State &op, unsigned arrangement, const MazePortals &portals) const
+    {
+      const ObjectDatabase &db = m_globals.getObjectDatabase(arrangement);
+      seq<unsigned> visible;
+
+      if(portals.collect(op.getScreenTransform(), op.getCameraPosition(), visible))
+      {
+        op.addObjectDatabase(db, visible);
+        return;
+      }
+      op.addObjectDatabase(db);
+    }
+
     /// Fill text.
     ///
     /// \param data Text location data.
@@ -1871,6 +2368,11 @@ class GlobalState : public StateQueue
       /// Initialize state.
       op.initialize(m_globals.projection, camera);
 
+      // Scenes rendered with stencil shadows may not cull objects, scenes rendered with shadow maps must keep
+      // objects visible to light.
+      op.setViewCulling(COLISEUM != scene);
+      op.setLightCulling((OPENING == scene) || (AQUEDUCT == scene) || (CREDITS == scene));
+
       // Act differently depending on scene.
       if(OPENING == scene)
       {
@@ -1921,7 +2423,7 @@ class GlobalState : public StateQueue
         static const int SPRITE_DETAIL = 18;
 
         op.addObjectDatabase(m_globals.getObjectDatabase(GlobalContainer::ARRANGEMENT_MAZE_SUPPORT));
-        op.addObjectDatabase(m_globals.getObjectDatabase(GlobalContainer::ARRANGEMENT_MAZE));
+        fillMaze(op, GlobalContainer::ARRANGEMENT_MAZE, *(m_globals.maze_portals_full));
 
         {
           // Undo Blender space.
@@ -1942,12 +2444,12 @@ class GlobalState : public StateQueue
 
           if(istamp)
           {
-            bsd_srand(istamp);
+            Random rnd(static_cast<unsigned>(istamp));
 
             float jitter = HAAMU_JITTER * fi;
-            float jitter_x = frand(-jitter, jitter);
-            float jitter_y = frand(-jitter, jitter);
-            float jitter_z = frand(-jitter, jitter);
+            float jitter_x = rnd.frand(-jitter, jitter);
+            float jitter_y = rnd.frand(-jitter, jitter);
+            float jitter_z = rnd.frand(-jitter, jitter);
             vec3 ghost_real_pos = vec3(jitter_x, jitter_y, jitter_z) + ghost_pos;
             mat4 ghost_transform = mat4::lookat(ghost_real_pos, cpos);
 
@@ -2079,8 +2581,8 @@ class GlobalState : public StateQueue
         // Flicker fadeout.
         if(fscene < FLICKER_END)
         {
-          bsd_srand(uframe);
-          op.storeFloat('K', 1.0f - linear_step_down(0.0f, FLICKER_END, fscene) * frand(FLICKER_AMPLITUDE));
+          Random rnd(uframe);
+          op.storeFloat('K', 1.0f - linear_step_down(0.0f, FLICKER_END, fscene) * rnd.frand(FLICKER_AMPLITUDE));
         }
 
         fillHaamu(op, HAAMU_POSITION, uscene);
@@ -2106,7 +2608,10 @@ class GlobalState : public StateQueue
 
         if(fscene > FLICKER_START)
         {
-          op.storeFloat('K', 1.0f - linear_step(FLICKER_START, FLICKER_END, fscene) * frand(FLICKER_AMPLITUDE));
+          // Seeded by frame so the result does not depend on which states were generated before.
+          Random rnd(uframe);
+          op.storeFloat('K', 1.0f - linear_step(FLICKER_START, FLICKER_END, fscene) *
+              rnd.frand(FLICKER_AMPLITUDE));
         }
 
         fillHaamu(op, HAAMU_POSITION, uscene);
@@ -2215,11 +2720,11 @@ class GlobalState : public StateQueue
   
           for(unsigned ii = 0; (EYE_COMPLEXITY > ii); ++ii)
           {
-            bsd_srand(uframe + ii);
+            Random rnd(uframe + ii);
 
-            vec3 eye_jitter(frand(-EYE_JITTER, EYE_JITTER),
-                frand(-EYE_JITTER, EYE_JITTER),
-                frand(-EYE_JITTER, EYE_JITTER));
+            vec3 eye_jitter(rnd.frand(-EYE_JITTER, EYE_JITTER),
+                rnd.frand(-EYE_JITTER, EYE_JITTER),
+                rnd.frand(-EYE_JITTER, EYE_JITTER));
             mat4 eye_transform = mat4::lookat(vec3(0.0f, 60.0f, 0.0f) + eye_jitter, cpos);    
             
             op.addObject(m_globals.moelli->getSprite(uframe + ii), eye_transform, PASS_HAAMU_SPRITE);
@@ -2259,7 +2764,7 @@ class GlobalState : public StateQueue
       }
       else // Default is hellraiser/greets scene.
       {
-        op.addObjectDatabase(m_globals.getObjectDatabase(GlobalContainer::ARRANGEMENT_HELLRAISER));
+        fillMaze(op, GlobalContainer::ARRANGEMENT_HELLRAISER, *(m_globals.maze_portals_hellraiser));
 
         if(GREETS == scene)
         {
@@ -2288,8 +2793,8 @@ class GlobalState : public StateQueue
           fillText(op, TEXT_LOCATIONS, fscene);
 
           // Very faint background flicker.
-          bsd_srand(uframe);
-          float amplitude = frand(FLICKER_AMPLITUDE_MIN, FLICKER_AMPLITUDE_MAX);
+          Random rnd(uframe);
+          float amplitude = rnd.frand(FLICKER_AMPLITUDE_MIN, FLICKER_AMPLITUDE_MAX);
 
           op.storeFloat('K', FLICKER_AMBIENT - amplitude * dnload_cosf(FLICKER_PHASE * fscene));
           op.storeFloat('Z', 1.0f);
@@ -2310,8 +2815,8 @@ class GlobalState : public StateQueue
           // Not so faint background flicker.
           if(fscene > FLICKER_START)
           {
-            bsd_srand(uframe);
-            op.storeFloat('K', 1.0f - ((fscene - FLICKER_START) * FLICKER_GROW * frand(1.0f)));
+            Random rnd(uframe);
+            op.storeFloat('K', 1.0f - ((fscene - FLICKER_START) * FLICKER_GROW * rnd.frand(1.0f)));
           }
         }
 
@@ -2353,6 +2858,12 @@ class GlobalState : public StateQueue
           op.addObject(vv, sb_transform, PASS_SKY);
         }
       }
+
+      // Screen and light space transformations are calculated for all objects at once.
+      op.transformObjects();
+
+      // Default pass is drawn without blending, draw repeated objects in batches.
+      op.buildInstanceBatches(PASS_DEFAULT);
     }
 
     /// Generate initial state.
@@ -2372,6 +2883,56 @@ class GlobalState : public StateQueue
       return state;
     }
 
+#if defined(USE_LD)
+    /// Move audio playback to given frame.
+    ///
+    /// \param frame Frame to move to.
+    static void jump_audio(int frame)
+    {
+      float fpos = static_cast<float>(frame * FRAME_MILLISECONDS) / 1000.0f;
+
+      g_audio_position = reinterpret_cast<uint8_t*>(g_audio_buffer) +
+        static_cast<size_t>(static_cast<float>(AUDIO_BYTERATE) * fpos);
+    }
+#endif
+
+#if (1 < STATE_WORKERS)
+    /// Acquire an empty state for the next frame in ticket order.
+    ///
+    /// Without frame jumps, the frame of a state is its ticket.
+    ///
+    /// \param ticket Ticket output.
+    /// \param frame Frame output.
+    /// \return State or NULL if queue is terminated.
+    State* acquireEmptyFrame(unsigned &ticket, int &frame)
+    {
+#if defined(USE_LD)
+      // Frame jumps move all later tickets, so they must be resolved in ticket order.
+      ScopedLock lock(&m_ticket_mutex);
+#endif
+      State *ret = acquireEmptyOrdered(ticket);
+      if(!ret)
+      {
+        return NULL;
+      }
+
+      frame = static_cast<int>(ticket);
+#if defined(USE_LD)
+      if(g_frame_jump != 1)
+      {
+        int prev_frame = std::min(std::max(frame - 1 + m_ticket_offset, 0), INTRO_LENGTH_FRAMES);
+        int next_frame = std::min(std::max(prev_frame + g_frame_jump, 0), INTRO_LENGTH_FRAMES);
+
+        m_ticket_offset = next_frame - frame;
+        jump_audio(next_frame);
+        g_frame_jump = 1;
+      }
+      frame = std::min(std::max(frame + m_ticket_offset, 0), INTRO_LENGTH_FRAMES);
+#endif
+      return ret;
+    }
+#endif
+
     /// Generates next state.
     ///
     /// \return True if state was generated, false if should exit.
@@ -2412,10 +2973,7 @@ class GlobalState : public StateQueue
       // Only jump once.
       if(g_frame_jump != 1)
       {
-        float fpos = static_cast<float>(next_frame * FRAME_MILLISECONDS) / 1000.0f;
-
-        g_audio_position = reinterpret_cast<uint8_t*>(g_audio_buffer) +
-          static_cast<size_t>(static_cast<float>(AUDIO_BYTERATE) * fpos);
+        jump_audio(next_frame);
         g_frame_jump = 1;
       }
 #endif
@@ -2496,10 +3054,21 @@ class GlobalState : public StateQueue
 #endif
 
       dnload_memset(g_audio_buffer, 0, AUDIO_BUFFER_SIZE);
+#if defined(AUDIO_STREAMING)
+      if(!is_developer())
+      {
+        generate_audio(g_audio_buffer, AUDIO_BUFFER_SIZE, &g_audio_stream);
+      }
+      else
+      {
+        g_audio_stream.ready.store(AUDIO_BUFFER_SIZE);
+      }
+#else
       if(!is_developer())
       {
         generate_audio(g_audio_buffer, AUDIO_BUFFER_SIZE);
       }
+#endif
 
 #if defined(USE_LD)
       uint32_t precalc_end = dnload_SDL_GetTicks();
@@ -2533,10 +3102,23 @@ class GlobalState : public StateQueue
     {
       GlobalState *globals = static_cast<GlobalState*>(user_data);
 
+#if defined(AUDIO_STREAMING)
+      globals->m_audio_thread.reset(new Thread(precalc_function_audio, globals));
+      {
+        Thread thread_visuals(precalc_function_visuals, globals);
+      }
+
+      // Visuals are done, wait until enough audio has been generated to start playback.
+      while(g_audio_stream.ready.load(std::memory_order_acquire) < AUDIO_STREAMING_PRELOAD * AUDIO_BYTERATE)
+      {
+        dnload_SDL_Delay(1);
+      }
+#else
       {
         Thread thread_audio(precalc_function_audio, globals);
         Thread thread_visuals(precalc_function_visuals, globals);
       }
+#endif
 
       globals->setDone();
 
@@ -2572,6 +3154,44 @@ class GlobalState : public StateQueue
 
       return 0;
     }
+
+#if (1 < STATE_WORKERS)
+    /// \brief State worker thread function.
+    ///
+    /// Several workers generate consecutive frames at the same time. A frame only depends on its index, so
+    /// the state for frame N is the Nth state in the queue, unless frames have been jumped over.
+    ///
+    /// \param data Data (actually state queue).
+    /// \return Return value (always 0).
+    static int state_worker_function(void *data)
+    {
+      GlobalState *gstate = static_cast<GlobalState*>(data);
+
+      for(;;)
+      {
+        unsigned ticket;
+        int frame;
+        State *state = gstate->acquireEmptyFrame(ticket, frame);
+        if(!state)
+        {
+          break;
+        }
+
+        // Initial state was the first state in the queue.
+        state->setFrame(frame, ticket);
+
+        gstate->fillState(*state);
+
+        // Initial state is not counted as generated.
+        if(INTRO_LENGTH_FRAMES + 1 < gstate->finishEmptyOrdered(ticket))
+        {
+          gstate->terminate();
+        }
+      }
+
+      return 0;
+    }
+#endif
 };
 
 //######################################
@@ -2674,7 +3294,7 @@ static void draw(const GlobalContainer &globals, State &state)
       //prg.uniform('I', 0);
       //prg.uniform('K', vec2(0.4f, 0.6f));
       //prg.uniform('L', light);
-      state.drawGeometry(prg);
+      state.drawShadowMap(prg);
     }
 
     // Screen space pass.
@@ -3003,6 +3623,12 @@ static void perform_record(GlobalState &gstate)
   const GlobalContainer &globals = gstate.getGlobals();
 
   // audio
+#if defined(AUDIO_STREAMING)
+  while(g_audio_stream.ready.load(std::memory_order_acquire) < AUDIO_BUFFER_SIZE)
+  {
+    dnload_SDL_Delay(1);
+  }
+#endif
   write_audio(g_audio_buffer, AUDIO_BUFFER_SIZE);
 
   // video
@@ -3209,7 +3835,25 @@ void intro(unsigned screen_w, unsigned screen_h, bool flag_fullscreen, bool flag
 
   // Scope will ensure destruction of threading.
   {
+#if (1 < STATE_WORKERS)
+    uptr<Thread> state_threads[STATE_WORKERS];
+#if defined(USE_LD)
+    // Developer mode jumps around freely, frames depend on previous frames.
+    if(is_developer())
+    {
+      state_threads[0].reset(new Thread(GlobalState::state_function, &gstate));
+    }
+    else
+#endif
+    {
+      for(uptr<Thread> &vv : state_threads)
+      {
+        vv.reset(new Thread(GlobalState::state_worker_function, &gstate));
+      }
+    }
+#else
     Thread state_thread(GlobalState::state_function, &gstate);
+#endif
     uint32_t prev_ticks = dnload_SDL_GetTicks();
 #if defined(USE_LD)
     unsigned successful_frames = 0;
@@ -3533,6 +4177,11 @@ void intro(unsigned screen_w, unsigned screen_h, bool flag_fullscreen, bool flag
     gstate.terminate();
   }
 
+#if defined(USE_LD)
+  std::cout << "|state queue stalls: " << gstate.getStallsFull() << " full, " << gstate.getStallsEmpty() <<
+    " empty" << std::endl;
+#endif
+
   teardown();
 }
 
@@ -3560,9 +4209,13 @@ int DNLOAD_MAIN(int argc, char **argv)
       po::options_description desc("Options");
       desc.add_options()
         ("developer,d", "Developer mode.")
+        ("geometry-cache,g", po::value<std::string>(), "Read world geometry from given file if valid, otherwise "
+         "generate it and write the file.")
         ("help,h", "Print help text.")
         ("record,R", "Do not play intro normally, instead save audio as .wav and frames as .png -files.")
         ("resolution,r", po::value<std::string>(), "Resolution to use, specify as 'WIDTHxHEIGHT' or 'HEIGHTp'.")
+        ("song-checkpoints,s", po::value<std::string>(), "Render audio in time slices from checkpoints in given "
+         "file if valid, otherwise render serially and write the file.")
         ("verbose,v", "Display extra debug info.")
         ("window,w", "Start in window instead of full-screen.");
 
@@ -3574,6 +4227,14 @@ int DNLOAD_MAIN(int argc, char **argv)
       {
         set_developer(true);
       }
+      if(vmap.count("geometry-cache"))
+      {
+        set_geometry_cache(vmap["geometry-cache"].as<std::string>());
+      }
+      if(vmap.count("song-checkpoints"))
+      {
+        set_song_checkpoints(vmap["song-checkpoints"].as<std::string>());
+      }
       if(vmap.count("help"))
       {
         std::cout << g_usage << desc << std::endl;
@@ -39,20 +39,23 @@ class Aqueduct
     ///
     /// \param left Left type.
     /// \param right Right type.
+    /// \param buf Geometry buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Texturing random seed.
-    Aqueduct(unsigned left, unsigned right, GeometryBuffer &buf, unsigned seed) :
+    Aqueduct(unsigned left, unsigned right, GeometryBuffer &buf, Random &rnd, unsigned seed) :
       m_left(left),
       m_right(right)
     {
-      construct(buf, seed);
+      construct(buf, rnd, seed);
     }
 
   private:
     /// Construct the mesh.
     ///
     /// \param buf Geometry buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Texturing random seed.
-    void construct(GeometryBuffer &buf, unsigned seed)
+    void construct(GeometryBuffer &buf, Random &rnd, unsigned seed)
     {
       //static const float AQUEDUCT_WIDTH = 10.0f;
       static const float PILLAR_WIDTH = 5.0f;
@@ -139,11 +142,11 @@ class Aqueduct
 
         msh.setPaintColor(LIGHT_COLOR);
 
-        bsd_srand(seed);
+        rnd.srand(seed);
 
         for(float ii = bk; (fw > ii); ii += len)
         {
-          float x_offset = frand(-FLOOR_HEIGHT, FLOOR_HEIGHT);
+          float x_offset = rnd.frand(-FLOOR_HEIGHT, FLOOR_HEIGHT);
           mesh_generate_box(msh, vec3(0.0f + x_offset, FLOOR_HEIGHT * 0.5f, ii + len * 0.5f),
               PILLAR_WIDTH - 3.0f * FLOOR_HEIGHT, FLOOR_HEIGHT, len, CSG_NO_BOTTOM);
           msh.advanceBlockId();
@@ -245,7 +248,7 @@ class Aqueduct
       }
 
       // Generate the actual mesh.
-      m_mesh = msh.insert(buf, seed);
+      m_mesh = msh.insert(buf, rnd, seed);
     }
 
     /// Tell if left pillar exists.
@@ -890,6 +890,7 @@ static void mesh_generate_arced_wall(LogicalMesh &input, const vec3 &p1, const v
 /// This is highly specific, but used both for haamus and floating islands.
 ///
 /// \param msh Target mesh.
+/// \param rnd Random number generator.
 /// \param h1 First height.
 /// \param r1 First radius.
 /// \param d1 First detail.
@@ -899,8 +900,8 @@ static void mesh_generate_arced_wall(LogicalMesh &input, const vec3 &p1, const v
 /// \param d2 Second detail.
 /// \param s2 Second seed.
 /// \param invert True to invert faces.
-void mesh_generate_polygon_ring(LogicalMesh &msh, float h1, float r1, unsigned d1, unsigned s1, float h2,
-    float r2, unsigned d2, unsigned s2, bool invert)
+void mesh_generate_polygon_ring(LogicalMesh &msh, Random &rnd, float h1, float r1, unsigned d1, unsigned s1,
+    float h2, float r2, unsigned d2, unsigned s2, bool invert)
 {
   static const float RANDOM_FACTOR = 0.1f;
   static const float RANDOM_FACTOR_HT = 0.05f;
@@ -917,38 +918,38 @@ void mesh_generate_polygon_ring(LogicalMesh &msh, float h1, float r1, unsigned d
   unsigned first_base = msh.getLogicalVertexCount();
 
   // First circle.
-  bsd_srand(s1);
+  rnd.srand(s1);
 
   float a1 = static_cast<float>(M_PI * 2.0) / static_cast<float>(d1);
-  float a1_add = frand(0.0f, a1);
+  float a1_add = rnd.frand(0.0f, a1);
 
   for(unsigned ii = 0; (ii < d1); ++ii)
   {
     float angle = static_cast<float>(ii) * a1 + a1_add;
     float ca = dnload_cosf(angle);
     float sa = dnload_sinf(angle);
-    vec3 point(ca * r1 + frand(-RANDOM_FACTOR * r1, RANDOM_FACTOR * r1),
-        h1 + frand(-RANDOM_FACTOR_HT * r1, RANDOM_FACTOR_HT * r1),
-        sa * r1 + frand(-RANDOM_FACTOR * r1, RANDOM_FACTOR * r1));
+    vec3 point(ca * r1 + rnd.frand(-RANDOM_FACTOR * r1, RANDOM_FACTOR * r1),
+        h1 + rnd.frand(-RANDOM_FACTOR_HT * r1, RANDOM_FACTOR_HT * r1),
+        sa * r1 + rnd.frand(-RANDOM_FACTOR * r1, RANDOM_FACTOR * r1));
 
     msh.addVertex(point);
   }
 
   // Second circle.
   unsigned second_base = msh.getLogicalVertexCount();
-  bsd_srand(s2);
+  rnd.srand(s2);
 
   float a2 = static_cast<float>(M_PI * 2.0) / static_cast<float>(d2);
-  float a2_add = frand(0.0f, a2);
+  float a2_add = rnd.frand(0.0f, a2);
 
   for(unsigned ii = 0; (ii < d2); ++ii)
   {
     float angle = static_cast<float>(ii) * a2 + a2_add;
     float ca = dnload_cosf(angle);
     float sa = dnload_sinf(angle);
-    vec3 point(ca * r2 + frand(-RANDOM_FACTOR * r2, RANDOM_FACTOR * r2),
-        h2 + frand(-RANDOM_FACTOR_HT * r2, RANDOM_FACTOR_HT * r2),
-        sa * r2 + frand(-RANDOM_FACTOR * r2, RANDOM_FACTOR * r2));
+    vec3 point(ca * r2 + rnd.frand(-RANDOM_FACTOR * r2, RANDOM_FACTOR * r2),
+        h2 + rnd.frand(-RANDOM_FACTOR_HT * r2, RANDOM_FACTOR_HT * r2),
+        sa * r2 + rnd.frand(-RANDOM_FACTOR * r2, RANDOM_FACTOR * r2));
 
     msh.addVertex(point);
 
@@ -39,8 +39,9 @@ class FloatingIsland
     /// \param width Width.
     /// \param vdetail Vertical detail.
     /// \param buf Geometry buffer.
+    /// \param rnd Random number generator.
     /// \param unsigned seed Random seed.
-    FloatingIsland(float height, float radius, unsigned vdetail, GeometryBuffer &buf,
+    FloatingIsland(float height, float radius, unsigned vdetail, GeometryBuffer &buf, Random &rnd,
         unsigned seed, float hole_coefficient = 0.3f, float pit_coefficient = 0.2f) :
       m_height(height),
       m_radius(radius),
@@ -48,15 +49,16 @@ class FloatingIsland
       m_hole_coefficient(hole_coefficient),
       m_pit_coefficient(pit_coefficient)
     {
-      construct(buf, seed);
+      construct(buf, rnd, seed);
     }
 
   private:
     /// Construct content.
     ///
     /// \param buf Geometry buffer.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    void construct(GeometryBuffer &buf, unsigned seed)
+    void construct(GeometryBuffer &buf, Random &rnd, unsigned seed)
     {
       static const float SHAPE_FAR = 0.67f;
       static const float SHAPE_DEPTH = 0.1366f; // May seem silly but is obligatory.
@@ -90,7 +92,7 @@ class FloatingIsland
           }
           else
           {
-            mesh_generate_polygon_ring(msh,
+            mesh_generate_polygon_ring(msh, rnd,
                 h1, r1, m_vdetail - ii + 3, seed + ii,
                 h2, r2, m_vdetail - ii - 1 + 3, seed + ii + 1,
                 false);
@@ -98,7 +100,7 @@ class FloatingIsland
         }
 
         // Main mesh done.
-        m_mesh_lower = msh.insert(buf, seed + m_vdetail + 3);
+        m_mesh_lower = msh.insert(buf, rnd, seed + m_vdetail + 3);
       }
 
       // Bottom mesh.
@@ -112,7 +114,7 @@ class FloatingIsland
         msh.setPaintColor(0.89f, 0.85f, 0.83f);
 
         // First cycle (upwards).
-        mesh_generate_polygon_ring(msh,
+        mesh_generate_polygon_ring(msh, rnd,
             0.0f, m_radius, m_vdetail + 3, seed,
             ystep, (1.0f - fdetail_mul) * m_radius, m_vdetail - 1 + 3, seed + m_vdetail + 1,
             true);
@@ -231,7 +233,7 @@ class FloatingIsland
               s_near * 2.0f, m_pit_coefficient * m_height, s_near * 2.0f, CSG_NO_TOP & CSG_INVERSE);
         }
 
-        m_mesh_upper = msh.insert(buf, seed + m_vdetail + 2);
+        m_mesh_upper = msh.insert(buf, rnd, seed + m_vdetail + 2);
       }
     }
 
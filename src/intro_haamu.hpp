@@ -17,11 +17,12 @@ class HaamuSprite : public Sprite<ImageLA>
     /// Constructor.
     ///
     /// \param buf Geometry buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    HaamuSprite(GeometryBuffer &buf, unsigned seed) :
+    HaamuSprite(GeometryBuffer &buf, Random &rnd, unsigned seed) :
       Sprite(buf, 0.8f, 1.4f)
     {
-      m_image = generate_image(48, 64, seed);
+      m_image = generate_image(48, 64, rnd, seed);
     }
 
   private:
@@ -29,8 +30,9 @@ class HaamuSprite : public Sprite<ImageLA>
     ///
     /// \param width Width.
     /// \param height Height.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    static ImageLAUptr generate_image(unsigned width, unsigned height, unsigned seed)
+    static ImageLAUptr generate_image(unsigned width, unsigned height, Random &rnd, unsigned seed)
     {
       static const float ELONGATION_X = 0.5f;
       static const float ELONGATION_Y = 0.33f;
@@ -41,12 +43,12 @@ class HaamuSprite : public Sprite<ImageLA>
       for(unsigned ii = 0; (ii < 6); ++ii)
       {
         noise[ii] = new ImageGray((ii + 1) * 64 / 5, (ii + 1) * 31 / 5);
-        noise[ii]->noise();
+        noise[ii]->noise(rnd);
       }
 
       vec2 center(static_cast<float>(width) * ELONGATION_X, static_cast<float>(height) * ELONGATION_Y);
 
-      bsd_srand(seed);
+      rnd.srand(seed);
 
       for(unsigned ii = 0; (width > ii); ++ii)
       {
@@ -104,10 +106,11 @@ class HaamuShape
     /// Constructor.
     ///
     /// \param buf Geometry buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    HaamuShape(GeometryBuffer &buf, unsigned seed)
+    HaamuShape(GeometryBuffer &buf, Random &rnd, unsigned seed)
     {
-      construct(buf, seed);
+      construct(buf, rnd, seed);
       m_object = new Object(m_mesh->getBlock(0), mat4::identity());
     }
 
@@ -115,8 +118,9 @@ class HaamuShape
     /// Construction.
     ///
     /// \param buf Geometry buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    void construct(GeometryBuffer &buf, unsigned seed)
+    void construct(GeometryBuffer &buf, Random &rnd, unsigned seed)
     {
       LogicalMesh msh;
 
@@ -155,7 +159,7 @@ class HaamuShape
         }
         else
         {
-          mesh_generate_polygon_ring(msh,
+          mesh_generate_polygon_ring(msh, rnd,
               h1, r1, HAAMU_DETAIL - ii + 3, seed + ii,
               h2, r2, HAAMU_DETAIL - ii - 1 + 3, seed + ii + 1,
               false);
@@ -193,7 +197,7 @@ class HaamuShape
         }
         else
         {
-          mesh_generate_polygon_ring(msh,
+          mesh_generate_polygon_ring(msh, rnd,
               h1, r1, HAAMU_DETAIL - ii + 3, seed + ii,
               h2, r2, HAAMU_DETAIL - ii - 1 + 3, seed + ii + 1,
               true);
@@ -220,7 +224,7 @@ class HaamuShape
           face.setTexcoord(1, vec2(0.0f, 0.0f));
           face.setTexcoord(2, vec2(0.0f, 0.0f));
 
-          unsigned sidx = urand(8);
+          unsigned sidx = rnd.urand(8);
           if(3 > sidx)
           {
             face.setTexcoord(sidx, vec2(1.0f, 1.0f));
@@ -231,7 +235,7 @@ class HaamuShape
       }
       else
       {
-        m_mesh = msh.insert(buf, 1);
+        m_mesh = msh.insert(buf, rnd, 1);
       }
     }
 
@@ -293,12 +297,13 @@ class Haamu
     /// Constructor.
     ///
     /// \param buf Geometry buffer to insert to.
-    Haamu(GeometryBuffer &buf)
+    /// \param rnd Random number generator.
+    Haamu(GeometryBuffer &buf, Random &rnd)
     {
       for(unsigned ii = 0; (SHAPE_COUNT > ii); ++ii)
       {
-        m_shapes[ii] = new HaamuShape(buf, ii); // First shape has no mangled texcoords.
-        m_sprites[ii] = new HaamuSprite(buf, ii + 1);
+        m_shapes[ii] = new HaamuShape(buf, rnd, ii); // First shape has no mangled texcoords.
+        m_sprites[ii] = new HaamuSprite(buf, rnd, ii + 1);
       }
 
       // Armature.
@@ -334,9 +339,9 @@ class Haamu
     {
       if(seed)
       {
-        bsd_srand(seed);
+        Random rnd(seed);
   
-        return m_shapes[urand(SHAPE_COUNT - 1) + 1]->getObject();
+        return m_shapes[rnd.urand(SHAPE_COUNT - 1) + 1]->getObject();
       }
       return m_shapes[0]->getObject();
     }
@@ -346,9 +351,9 @@ class Haamu
     /// \param seed Random seed for acquiring the object.
     const Object& getSprite(unsigned seed) const
     {
-      bsd_srand(seed);
+      Random rnd(seed);
 
-      return m_sprites[urand(SHAPE_COUNT)]->getObject();
+      return m_sprites[rnd.urand(SHAPE_COUNT)]->getObject();
     }
 
     /// Insert into state.
@@ -55,6 +55,7 @@
 
 #include "intro_mazeprimitives.hpp"
 #include "intro_mazeresources.hpp"
+#include "intro_mazeportals.hpp"
 
 //######################################
 // Primitives ##########################
@@ -113,7 +114,7 @@ static void mesh_generate_aqueduct_circle(LogicalMesh &input, float radius, floa
   }
 }
 
-static void mesh_generate_end_scene(LogicalMesh &input)
+static void mesh_generate_end_scene(LogicalMesh &input, Random &rnd)
 {
   mesh_generate_aqueduct_circle(input, AQUEDUCT_RADIUS_INNER, AQUEDUCT_WIDTH_INNER, AQUEDUCT_HEIGHT_INNER, 12, 0);
   mesh_generate_aqueduct_circle(input, AQUEDUCT_RADIUS_OUTER, AQUEDUCT_WIDTH_OUTER, AQUEDUCT_HEIGHT_OUTER, 12, 1);
@@ -129,13 +130,13 @@ static void mesh_generate_end_scene(LogicalMesh &input)
   }
 
   // Magically get good placement for pillars
-  bsd_srand(19); // or 10?
+  rnd.srand(19); // or 10?
 	
   for (int ii = 0; ii < AQUEDUCT_OUTER_PILLAR_AMOUNT; ii++)
   {
-    pillarpos = vec3(AQUEDUCT_RADIUS_OUTER + AQUEDUCT_WIDTH_OUTER + 3.0f + frand(2.0f * AQUEDUCT_RADIUS_OUTER), -2.0f, 0.0f);
-    pillarpos = pillarpos.rotateY(frand(2.0f*static_cast<float>(M_PI))-0.15f);
-    mesh_generate_pillar(input, pillarpos, pillarpos + (15.0f + frand(20.0f))*CSG_DIR_UP, 2, 8, 2);
+    pillarpos = vec3(AQUEDUCT_RADIUS_OUTER + AQUEDUCT_WIDTH_OUTER + 3.0f + rnd.frand(2.0f * AQUEDUCT_RADIUS_OUTER), -2.0f, 0.0f);
+    pillarpos = pillarpos.rotateY(rnd.frand(2.0f*static_cast<float>(M_PI))-0.15f);
+    mesh_generate_pillar(input, pillarpos, pillarpos + (15.0f + rnd.frand(20.0f))*CSG_DIR_UP, 2, 8, 2);
   }
 }
 
@@ -0,0 +1,555 @@
+#ifndef INTRO_MAZEPORTALS_HPP
+#define INTRO_MAZEPORTALS_HPP
+
+/// Tolerance for bounding volumes touching cell boundaries and points at the camera plane.
+#define MAZE_PORTAL_EPSILON 0.01f
+
+/// Maze portal structure.
+///
+/// Divides a maze into its cells. Cells on the same floor see each other only through the opening in the wall
+/// between them, cells on top of each other through the open cell shaft. Openings are taken from the wall types
+/// recorded by the maze. Objects of a maze object database are bucketed into every cell their bounding volume
+/// touches.
+class MazePortals
+{
+  private:
+    /// Number of directions out of a cell.
+    static const unsigned DIRECTION_COUNT = 6;
+
+  private:
+    /// Maze origin (west, bottom, south corner of first cell).
+    vec3 m_origin;
+
+    /// Width (and depth) in cells.
+    unsigned m_width;
+
+    /// Height in cells.
+    unsigned m_height;
+
+    /// First object index of every cell, one extra at the end.
+    seq<unsigned> m_cell_first;
+
+    /// Object indices of all cells.
+    seq<unsigned> m_cell_objects;
+
+    /// Indices of objects not within the maze, always visible.
+    seq<unsigned> m_outside;
+
+    /// Openings of eastern and northern wall of every cell, minimum and maximum along the wall in world space.
+    ///
+    /// Minimum is greater than maximum for walls without an opening.
+    seq<float> m_openings;
+
+    /// Number of objects in the database.
+    unsigned m_object_count;
+
+  public:
+    /// Constructor.
+    ///
+    /// \param db Sorted object database of the maze, must not change afterwards.
+    /// \param origin Maze origin as given to maze construction.
+    /// \param width Width (and depth) in cells.
+    /// \param height Height in cells.
+    /// \param walls Wall data of the maze.
+    MazePortals(const ObjectDatabase &db, const vec3 &origin, unsigned width, unsigned height,
+        const seq<uint8_t> &walls) :
+      m_origin(origin),
+      m_width(width),
+      m_height(height),
+      m_object_count(db.getObjectCount())
+    {
+      unsigned cell_count = getCellCount();
+
+#if defined(USE_LD)
+      if(walls.size() != cell_count * 2)
+      {
+        std::ostringstream sstr;
+        sstr << "wall data size " << walls.size() << " does not match " << cell_count << " cells";
+        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+      }
+#endif
+
+      // Walls are rotated into place as the maze inserts them.
+      m_openings.resize(cell_count * 4);
+      for(unsigned ii = 0; (cell_count * 2 > ii); ++ii)
+      {
+        unsigned cell = ii / 2;
+        bool north = (ii & 1);
+        float lo;
+        float hi;
+
+        if(!get_wall_opening(walls[ii] & ~MAZE_WALL_INVERTED, lo, hi))
+        {
+          m_openings[ii * 2 + 0] = FLT_MAX;
+          m_openings[ii * 2 + 1] = -FLT_MAX;
+          continue;
+        }
+
+        float yaw = (north ? 0.0f : 3.0f * static_cast<float>(M_PI) / 2.0f) +
+          ((walls[ii] & MAZE_WALL_INVERTED) ? static_cast<float>(M_PI) : 0.0f);
+        vec3 axis = mat3::rotation_euler(yaw, 0.0f, 0.0f) * vec3(1.0f, 0.0f, 0.0f);
+        float center;
+        float dir;
+
+        if(north)
+        {
+          center = m_origin[0] + (static_cast<float>(cell % m_width) + 0.5f) * MAZE_CELL_WIDTH_TOTAL;
+          dir = axis[0];
+        }
+        else
+        {
+          center = m_origin[2] - (static_cast<float>((cell / m_width) % m_width) + 0.5f) * MAZE_CELL_WIDTH_TOTAL;
+          dir = axis[2];
+        }
+        m_openings[ii * 2 + 0] = center + std::min(dir * lo, dir * hi);
+        m_openings[ii * 2 + 1] = center + std::max(dir * lo, dir * hi);
+      }
+
+      m_cell_first.resize(cell_count + 1);
+      for(unsigned &vv : m_cell_first)
+      {
+        vv = 0;
+      }
+
+      // First pass counts objects of every cell, second pass fills them in.
+      for(unsigned pass = 0; (2 > pass); ++pass)
+      {
+        if(1 == pass)
+        {
+          for(unsigned ii = 0; (cell_count > ii); ++ii)
+          {
+            m_cell_first[ii + 1] += m_cell_first[ii];
+          }
+          m_cell_objects.resize(m_cell_first[cell_count]);
+        }
+
+        seq<unsigned> cell_fill;
+        cell_fill.resize(cell_count);
+        for(unsigned ii = 0; (cell_count > ii); ++ii)
+        {
+          cell_fill[ii] = m_cell_first[ii];
+        }
+
+        for(unsigned ii = 0; (m_object_count > ii); ++ii)
+        {
+          const BoundingVolume &volume = db.getObject(ii).getBoundingVolume();
+          int x1 = getCellX(volume.getMinX() + MAZE_PORTAL_EPSILON);
+          int x2 = getCellX(volume.getMaxX() - MAZE_PORTAL_EPSILON);
+          int y1 = getCellY(volume.getMinY() + MAZE_PORTAL_EPSILON);
+          int y2 = getCellY(volume.getMaxY() - MAZE_PORTAL_EPSILON);
+          int z1 = getCellZ(volume.getMaxZ() - MAZE_PORTAL_EPSILON);
+          int z2 = getCellZ(volume.getMinZ() + MAZE_PORTAL_EPSILON);
+
+          if(!isCell(x1, y1, z1) || !isCell(x2, y2, z2))
+          {
+            if(0 == pass)
+            {
+              m_outside.push_back(ii);
+            }
+            continue;
+          }
+
+          for(int jj = y1; (y2 >= jj); ++jj)
+          {
+            for(int kk = z1; (z2 >= kk); ++kk)
+            {
+              for(int ll = x1; (x2 >= ll); ++ll)
+              {
+                unsigned cell = getCellIndex(ll, jj, kk);
+
+                if(0 == pass)
+                {
+                  ++m_cell_first[cell + 1];
+                }
+                else
+                {
+                  m_cell_objects[cell_fill[cell]++] = ii;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    /// Get opening of a wall between cells.
+    ///
+    /// Opening is given along the wall in wall object space, from the wall start at +MAZE_CELL_WIDTH / 2 towards
+    /// -MAZE_CELL_WIDTH / 2. Vertically all openings span the doorway band. Walls with several openings return
+    /// the span containing all of them.
+    ///
+    /// \param type Wall type.
+    /// \param lo Opening minimum output.
+    /// \param hi Opening maximum output.
+    /// \return True if wall has an opening, false if not.
+    static bool get_wall_opening(unsigned type, float &lo, float &hi)
+    {
+      float extent;
+
+      switch(type)
+      {
+        case MAZE_WALL_TYPE_LARGE_ARC_1:
+          extent = MAZE_LARGE_ARC_WIDTH_1 * 0.5f;
+          break;
+
+        case MAZE_WALL_TYPE_LARGE_ARC_2:
+          extent = MAZE_LARGE_ARC_WIDTH_2 * 0.5f;
+          break;
+
+        case MAZE_WALL_TYPE_LARGE_ARC_3:
+          extent = MAZE_LARGE_ARC_WIDTH_3 * 0.5f;
+          break;
+
+        // Small arcs are two ledge widths apart and reach 0.6666 ledge widths to either side.
+        case MAZE_WALL_TYPE_SMALL_ARC_1:
+          extent = MAZE_LEDGE_WIDTH * 0.6666f;
+          break;
+
+        case MAZE_WALL_TYPE_SMALL_ARC_2:
+          extent = MAZE_LEDGE_WIDTH * 1.6666f;
+          break;
+
+        case MAZE_WALL_TYPE_SMALL_ARC_3:
+          extent = MAZE_LEDGE_WIDTH * 2.6666f;
+          break;
+
+        // Single opening at the wall start.
+        case MAZE_WALL_TYPE_HALF_ARC:
+          lo = MAZE_CELL_WIDTH * 0.5f - MAZE_LEDGE_WIDTH;
+          hi = MAZE_CELL_WIDTH * 0.5f;
+          return true;
+
+        // Openings at both ends or between pillars along the whole wall.
+        case MAZE_WALL_TYPE_DOUBLE_HALF_ARC:
+        case MAZE_WALL_TYPE_PILLARS:
+          extent = MAZE_CELL_WIDTH * 0.5f;
+          break;
+
+        default:
+          return false;
+      }
+
+      lo = -extent;
+      hi = extent;
+      return true;
+    }
+
+    /// Get cell count.
+    ///
+    /// \return Number of cells.
+    unsigned getCellCount() const
+    {
+      return m_width * m_height * m_width;
+    }
+
+    /// Get cell index.
+    ///
+    /// \param x X coordinate (west to east).
+    /// \param y Y coordinate (bottom to top).
+    /// \param z Z coordinate (south to north).
+    /// \return Cell index.
+    unsigned getCellIndex(int x, int y, int z) const
+    {
+      return static_cast<unsigned>(y) * m_width * m_width + static_cast<unsigned>(z) * m_width +
+        static_cast<unsigned>(x);
+    }
+
+    /// Get cell X coordinate for a world position.
+    ///
+    /// \param op World X.
+    /// \return Cell X, may be outside the maze.
+    int getCellX(float op) const
+    {
+      return floor_cell((op - m_origin[0]) / MAZE_CELL_WIDTH_TOTAL);
+    }
+
+    /// Get cell Y coordinate for a world position.
+    ///
+    /// \param op World Y.
+    /// \return Cell Y, may be outside the maze.
+    int getCellY(float op) const
+    {
+      return floor_cell((op - m_origin[1]) / MAZE_CELL_HEIGHT);
+    }
+
+    /// Get cell Z coordinate for a world position.
+    ///
+    /// Cells advance towards negative Z.
+    ///
+    /// \param op World Z.
+    /// \return Cell Z, may be outside the maze.
+    int getCellZ(float op) const
+    {
+      return floor_cell((m_origin[2] - op) / MAZE_CELL_WIDTH_TOTAL);
+    }
+
+    /// Round a cell coordinate down.
+    ///
+    /// \param op Coordinate in cell units.
+    /// \return Largest integer not greater than input.
+    static int floor_cell(float op)
+    {
+      int ret = static_cast<int>(op);
+
+      return (op < static_cast<float>(ret)) ? (ret - 1) : ret;
+    }
+
+    /// Tell if cell coordinates are within the maze.
+    ///
+    /// \param x X coordinate.
+    /// \param y Y coordinate.
+    /// \param z Z coordinate.
+    /// \return True if yes, false if no.
+    bool isCell(int x, int y, int z) const
+    {
+      return (0 <= x) && (static_cast<int>(m_width) > x) && (0 <= y) && (static_cast<int>(m_height) > y) &&
+        (0 <= z) && (static_cast<int>(m_width) > z);
+    }
+
+    /// Project a portal rectangle into screen space.
+    ///
+    /// Rectangle is given as a corner and two edge vectors. If any corner is behind the camera, the whole screen
+    /// is returned.
+    ///
+    /// \param screen Screen space transformation.
+    /// \param corner Portal corner.
+    /// \param edge1 First edge.
+    /// \param edge2 Second edge.
+    /// \param rect Screen space bounds output (min x, min y, max x, max y).
+    static void project_portal(const mat4 &screen, const vec3 &corner, const vec3 &edge1, const vec3 &edge2,
+        float *rect)
+    {
+      rect[0] = FLT_MAX;
+      rect[1] = FLT_MAX;
+      rect[2] = -FLT_MAX;
+      rect[3] = -FLT_MAX;
+
+      for(unsigned ii = 0; (4 > ii); ++ii)
+      {
+        vec3 pos = corner + ((ii & 1) ? edge1 : vec3(0.0f)) + ((ii & 2) ? edge2 : vec3(0.0f));
+        float ww = screen[3] * pos[0] + screen[7] * pos[1] + screen[11] * pos[2] + screen[15];
+
+        if(ww <= MAZE_PORTAL_EPSILON)
+        {
+          rect[0] = -1.0f;
+          rect[1] = -1.0f;
+          rect[2] = 1.0f;
+          rect[3] = 1.0f;
+          return;
+        }
+
+        float px = (screen[0] * pos[0] + screen[4] * pos[1] + screen[8] * pos[2] + screen[12]) / ww;
+        float py = (screen[1] * pos[0] + screen[5] * pos[1] + screen[9] * pos[2] + screen[13]) / ww;
+
+        rect[0] = std::min(rect[0], px);
+        rect[1] = std::min(rect[1], py);
+        rect[2] = std::max(rect[2], px);
+        rect[3] = std::max(rect[3], py);
+      }
+    }
+
+  public:
+    /// Collect objects visible from a camera position.
+    ///
+    /// Walks from the camera cell through portals, narrowing the visible screen area on the way. Cells are
+    /// revisited only if the screen area they are seen through grows, so the walk is conservative.
+    ///
+    /// \param screen Screen space transformation.
+    /// \param pos Camera position.
+    /// \param dst Indices of visible objects output.
+    /// \return True if camera is within the maze, false if all objects must be considered visible.
+    bool collect(const mat4 &screen, const vec3 &pos, seq<unsigned> &dst) const
+    {
+      int cx = getCellX(pos[0]);
+      int cy = getCellY(pos[1]);
+      int cz = getCellZ(pos[2]);
+
+      if(!isCell(cx, cy, cz))
+      {
+        return false;
+      }
+
+      unsigned cell_count = getCellCount();
+      seq<float> rects;
+      seq<unsigned> stack;
+
+      rects.resize(cell_count * 4);
+      for(unsigned ii = 0; (cell_count > ii); ++ii)
+      {
+        rects[ii * 4 + 0] = FLT_MAX;
+        rects[ii * 4 + 1] = FLT_MAX;
+        rects[ii * 4 + 2] = -FLT_MAX;
+        rects[ii * 4 + 3] = -FLT_MAX;
+      }
+
+      {
+        unsigned cell = getCellIndex(cx, cy, cz);
+
+        rects[cell * 4 + 0] = -1.0f;
+        rects[cell * 4 + 1] = -1.0f;
+        rects[cell * 4 + 2] = 1.0f;
+        rects[cell * 4 + 3] = 1.0f;
+        stack.push_back(cell);
+      }
+
+      while(!stack.empty())
+      {
+        unsigned cell = stack.back();
+        stack.pop_back();
+
+        int xx = static_cast<int>(cell % m_width);
+        int zz = static_cast<int>((cell / m_width) % m_width);
+        int yy = static_cast<int>(cell / (m_width * m_width));
+        vec3 cell_min(m_origin[0] + static_cast<float>(xx) * MAZE_CELL_WIDTH_TOTAL,
+            m_origin[1] + static_cast<float>(yy) * MAZE_CELL_HEIGHT,
+            m_origin[2] - static_cast<float>(zz + 1) * MAZE_CELL_WIDTH_TOTAL);
+        float door_y = cell_min[1] + MAZE_LEDGE_HEIGHT;
+        vec3 edge_x(MAZE_CELL_WIDTH_TOTAL, 0.0f, 0.0f);
+        vec3 edge_y(0.0f, MAZE_CELL_HEIGHT, 0.0f);
+        vec3 edge_z(0.0f, 0.0f, MAZE_CELL_WIDTH_TOTAL);
+        vec3 edge_door(0.0f, MAZE_OPENING_HEIGHT, 0.0f);
+        float rect[4] =
+        {
+          rects[cell * 4 + 0],
+          rects[cell * 4 + 1],
+          rects[cell * 4 + 2],
+          rects[cell * 4 + 3]
+        };
+
+        for(unsigned ii = 0; (DIRECTION_COUNT > ii); ++ii)
+        {
+          float portal[4];
+          int nx = xx;
+          int ny = yy;
+          int nz = zz;
+
+          // East, west, north and south through wall openings, up and down through the cell shaft.
+          switch(ii)
+          {
+            case 0:
+              ++nx;
+              break;
+
+            case 1:
+              --nx;
+              break;
+
+            case 2:
+              ++nz;
+              break;
+
+            case 3:
+              --nz;
+              break;
+
+            case 4:
+              ++ny;
+              break;
+
+            default:
+              --ny;
+              break;
+          }
+
+          if(!isCell(nx, ny, nz))
+          {
+            continue;
+          }
+
+          if(4 > ii)
+          {
+            // Wall belongs to the cell on its west or south side.
+            bool north = (2 <= ii);
+            const float *opening = m_openings.getData() +
+              getCellIndex(std::min(xx, nx), yy, std::min(zz, nz)) * 4 + (north ? 2 : 0);
+
+            if(opening[0] > opening[1])
+            {
+              continue;
+            }
+
+            if(north)
+            {
+              float door_z = cell_min[2] + ((nz > zz) ? 0.0f : MAZE_CELL_WIDTH_TOTAL);
+
+              project_portal(screen, vec3(opening[0], door_y, door_z), vec3(opening[1] - opening[0], 0.0f, 0.0f),
+                  edge_door, portal);
+            }
+            else
+            {
+              float door_x = cell_min[0] + ((nx > xx) ? MAZE_CELL_WIDTH_TOTAL : 0.0f);
+
+              project_portal(screen, vec3(door_x, door_y, opening[0]), vec3(0.0f, 0.0f, opening[1] - opening[0]),
+                  edge_door, portal);
+            }
+          }
+          else
+          {
+            project_portal(screen, cell_min + ((ny > yy) ? edge_y : vec3(0.0f)), edge_x, edge_z, portal);
+          }
+
+          // Narrow to area seen so far.
+          portal[0] = std::max(portal[0], rect[0]);
+          portal[1] = std::max(portal[1], rect[1]);
+          portal[2] = std::min(portal[2], rect[2]);
+          portal[3] = std::min(portal[3], rect[3]);
+          if((portal[0] > portal[2]) || (portal[1] > portal[3]))
+          {
+            continue;
+          }
+
+          unsigned next = getCellIndex(nx, ny, nz);
+          float *next_rect = rects.getData() + next * 4;
+          if((next_rect[0] <= portal[0]) && (next_rect[1] <= portal[1]) && (next_rect[2] >= portal[2]) &&
+              (next_rect[3] >= portal[3]))
+          {
+            continue;
+          }
+
+          next_rect[0] = std::min(next_rect[0], portal[0]);
+          next_rect[1] = std::min(next_rect[1], portal[1]);
+          next_rect[2] = std::max(next_rect[2], portal[2]);
+          next_rect[3] = std::max(next_rect[3], portal[3]);
+          stack.push_back(next);
+        }
+      }
+
+      // Objects may be in several cells, only add once.
+      seq<uint8_t> added;
+      added.resize(m_object_count);
+      for(uint8_t &vv : added)
+      {
+        vv = 0;
+      }
+
+      for(unsigned vv : m_outside)
+      {
+        dst.push_back(vv);
+      }
+      for(unsigned ii = 0; (cell_count > ii); ++ii)
+      {
+        if(rects[ii * 4 + 0] > rects[ii * 4 + 2])
+        {
+          continue;
+        }
+
+        for(unsigned jj = m_cell_first[ii], ee = m_cell_first[ii + 1]; (ee > jj); ++jj)
+        {
+          unsigned idx = m_cell_objects[jj];
+
+          if(!added[idx])
+          {
+            added[idx] = 1;
+            dst.push_back(idx);
+          }
+        }
+      }
+      return true;
+    }
+};
+
+/// Convenience typedef.
+typedef uptr<MazePortals> MazePortalsUptr;
+
+#endif
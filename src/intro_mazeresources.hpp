@@ -53,19 +53,19 @@ class MazeCell
     uint8_t ledge[4];
     uint8_t wall[4];
 
-    static uint8_t randomizeWall(int condition) {
+    static uint8_t randomizeWall(Random &rnd, int condition) {
       switch (condition) {
         case CONDITION_DIAGONAL:
-          return walls_diagonal[urand(WALL_RANDOMIZER_SIZE)];
+          return walls_diagonal[rnd.urand(WALL_RANDOMIZER_SIZE)];
           break;
         case CONDITION_DIRECT_1:
-          return walls_direct_1[urand(WALL_RANDOMIZER_SIZE)];
+          return walls_direct_1[rnd.urand(WALL_RANDOMIZER_SIZE)];
           break;
         case CONDITION_DIRECT_2:
-          return walls_direct_2[urand(WALL_RANDOMIZER_SIZE)];
+          return walls_direct_2[rnd.urand(WALL_RANDOMIZER_SIZE)];
           break;
         case CONDITION_FULL:
-          return walls_full[urand(WALL_RANDOMIZER_SIZE)];
+          return walls_full[rnd.urand(WALL_RANDOMIZER_SIZE)];
           break;
         default:
 #if defined(USE_LD)
@@ -80,13 +80,13 @@ class MazeCell
       }
     }
 
-    static void setWallsBasedOnLedgeInformation(MazeCell &cell_current, MazeCell &cell_next, int right,
-        int top, int left, int bottom)
+    static void setWallsBasedOnLedgeInformation(Random &rnd, MazeCell &cell_current, MazeCell &cell_next,
+        int right, int top, int left, int bottom)
     {
       // Both sides have full ledge
       if (cell_current.hasLedgeNormal(right) && cell_next.hasLedgeNormal(left)) {
         //std::cout << "Full ledge both sides FIRED!" << std::endl;
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_FULL));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_FULL));
         // This mode sacrifices the edges of the walls of the connection
         cell_current.setLedgeNoUse(right, LEDGE_END_FAR, true);
         cell_current.setLedgeNoUse(right, LEDGE_END_NEAR, true);
@@ -96,7 +96,7 @@ class MazeCell
       }
       // Both sides have both north and south ledges
       else if ((cell_current.hasLedgeNormal(bottom) && cell_next.hasLedgeNormal(bottom)) && (cell_current.hasLedge(top) && cell_next.hasLedge(top))) {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_2));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_2));
         // This mode sacrifices the edges of the walls of the connection
         cell_current.setLedgeNoUse(right, LEDGE_END_FAR, true);
         cell_current.setLedgeNoUse(right, LEDGE_END_NEAR, true);
@@ -110,7 +110,7 @@ class MazeCell
       }
       // South & North ledges present on opposite sides of the wall
       else if (cell_current.hasLedgeNormal(bottom) && cell_next.hasLedgeNormal(top)) {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIAGONAL));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIAGONAL));
         cell_current.setLedge(right, LEDGE_DIAGONAL);
         cell_next.setLedge(left, LEDGE_DIAGONAL);
         cell_next.setLedgeDirection(left, DIRECTION_INVERSE);
@@ -134,7 +134,7 @@ class MazeCell
       }
       // North & south ledges present on opposite sides of the wall
       else if (cell_current.hasLedgeNormal(top) && cell_next.hasLedgeNormal(bottom)) {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIAGONAL));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIAGONAL));
         cell_current.setLedge(right, LEDGE_DIAGONAL);
         cell_next.setLedge(left, LEDGE_DIAGONAL);
         cell_current.setLedgeDirection(right, DIRECTION_INVERSE);
@@ -194,7 +194,7 @@ class MazeCell
       }
       // Both south walls have a ledge
       else if (cell_current.hasLedgeNormal(bottom) && cell_next.hasLedgeNormal(bottom))  {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_1));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_1));
         //cell_current.setWallDirection(right, DIRECTION_INVERSE);
         // This mode sacrifices the edges of the walls of the connection
         cell_current.setLedgeNoUse(right, LEDGE_END_NEAR, true);
@@ -205,7 +205,7 @@ class MazeCell
       }
       // Both north walls have a ledge
       else if (cell_current.hasLedgeNormal(top) && cell_next.hasLedgeNormal(top))  {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_1));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_1));
         cell_current.setWallDirection(right, DIRECTION_INVERSE);
         // This mode sacrifices the edges of the walls of the connection
         cell_current.setLedgeNoUse(right, LEDGE_END_FAR, true);
@@ -216,7 +216,7 @@ class MazeCell
       }
       // This side has right edge and the other side has south edge
       else if (cell_current.hasLedgeNormal(right) && cell_next.hasLedgeNormal(bottom))  {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_1));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_1));
         cell_current.setLedgeEnd(right, LEDGE_END_FAR, MAZE_LEDGE_END_ROUNDED);
         // This mode sacrifices no edges
         cell_current.setLedgeNoUse(right, LEDGE_END_FAR, true);
@@ -227,7 +227,7 @@ class MazeCell
       }
       // This side has right edge and the other side has north edge
       else if (cell_current.hasLedgeNormal(right) && cell_next.hasLedgeNormal(top))  {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_1));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_1));
         //cell_current.setWallDirection(right, DIRECTION_INVERSE);
         cell_current.setLedgeEnd(right, LEDGE_END_NEAR, MAZE_LEDGE_END_ROUNDED);
         // This mode sacrifices the edges it uses
@@ -239,7 +239,7 @@ class MazeCell
       }
       // This side has south edge the other side has left edge 
       else if (cell_current.hasLedgeNormal(bottom) && cell_next.hasLedgeNormal(left))  {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_1));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_1));
         //cell_current.setWallDirection(right, DIRECTION_INVERSE);
         cell_next.setLedgeEnd(left, LEDGE_END_NEAR, MAZE_LEDGE_END_ROUNDED);
         // This mode sacrifices the edges it uses
@@ -252,7 +252,7 @@ class MazeCell
       }
       // This side has north edge the other side has left edge 
       else if (cell_current.hasLedgeNormal(top) && cell_next.hasLedgeNormal(left))  {
-        cell_current.setWall(right, cell_current.randomizeWall(CONDITION_DIRECT_1));
+        cell_current.setWall(right, cell_current.randomizeWall(rnd, CONDITION_DIRECT_1));
         cell_current.setWallDirection(right, DIRECTION_INVERSE);
         cell_next.setLedgeEnd(left, LEDGE_END_FAR, MAZE_LEDGE_END_ROUNDED);
         // This mode sacrifices the edges it uses
@@ -687,13 +687,14 @@ class MazeLedge
     /// Constructor.
     ///
     /// \param buf Geometry buffer to use.
+    /// \param rnd Random number generator.
     /// \param type Type of wall to create.
-    MazeLedge(GeometryBuffer &buf, int type)
+    MazeLedge(GeometryBuffer &buf, Random &rnd, int type)
     {
-      construct(buf, type);
+      construct(buf, rnd, type);
     }
 
-    void construct(GeometryBuffer &buf, int type)
+    void construct(GeometryBuffer &buf, Random &rnd, int type)
     {
       LogicalMesh mesh(COLOR_MAZELEDGE);
       vec3 p1(0, 0, 0);
@@ -747,7 +748,7 @@ class MazeLedge
           break;
       }
 
-      m_mesh = mesh.insert(buf, 1);
+      m_mesh = mesh.insert(buf, rnd, 1);
     }
 
     const Mesh& getMesh() const
@@ -765,17 +766,18 @@ class MazeWall
     /// Constructor.
     ///
     /// \param buf Geometry buffer to use.
+    /// \param rnd Random number generator.
     /// \param type Type of wall to create.
-    MazeWall(GeometryBuffer &buf, int type)
+    MazeWall(GeometryBuffer &buf, Random &rnd, int type)
     {
-      construct(buf, type);
+      construct(buf, rnd, type);
     }
 
-    void construct(GeometryBuffer &buf, int type)
+    void construct(GeometryBuffer &buf, Random &rnd, int type)
     {
       LogicalMesh mesh(COLOR_MAZEWALL);
       mesh_generate_maze_wall_segment(mesh, vec3(0, 0, 0), type);
-      m_mesh = mesh.insert(buf, 1);
+      m_mesh = mesh.insert(buf, rnd, 1);
     }
 
     const Mesh& getMesh() const
@@ -803,15 +805,16 @@ class MazeResources
     /// Constructor.
     ///
     /// \param buf Geometry buffer to use.
-    MazeResources(GeometryBuffer &buf)
+    /// \param rnd Random number generator.
+    MazeResources(GeometryBuffer &buf, Random &rnd)
     {
       for (int ii = 0; ii < MAZE_WALL_TYPES; ii++)
       {
-        walls[ii] = new MazeWall(buf, ii);
+        walls[ii] = new MazeWall(buf, rnd, ii);
       }
       for (int ii = 0; ii < MAZE_LEDGE_TYPES; ii++)
       {
-        ledges[ii] = new MazeLedge(buf, ii);
+        ledges[ii] = new MazeLedge(buf, rnd, ii);
       }
     }
 
@@ -1002,6 +1005,9 @@ class MazeResources
 /// Convenience typedef.
 typedef uptr<MazeResources> MazeResourcesUptr;
 
+/// Flag set in maze wall data for walls inserted in inverse direction.
+#define MAZE_WALL_INVERTED 0x80
+
 /// Maze class.
 class Maze
 {
@@ -1009,6 +1015,12 @@ class Maze
     /// Cell array.
     seq<MazeCell> m_cells;
 
+    /// Wall data, types of eastern and northern wall of every cell in cell order.
+    ///
+    /// Walls inserted in inverse direction have MAZE_WALL_INVERTED set. Cells on the maze edge have no wall
+    /// in that direction, these are marked plain.
+    seq<uint8_t> m_walls;
+
     /// Width (and depth).
     unsigned m_w;
 
@@ -1023,9 +1035,10 @@ class Maze
     ///
     /// \param width How wide and how deep the maze is.
     /// \param height How high the maze is.
+    /// \param rnd Random number generator.
     Maze(unsigned width, unsigned height, const MazeResources &mazeresources, ObjectDatabase &db,
-        GeometryBuffer &buf, const Texture *tex, const vec3 &maze_start, const uint8_t *ledge_data = NULL,
-        const uint8_t *ramp_data = NULL) :
+        GeometryBuffer &buf, Random &rnd, const Texture *tex, const vec3 &maze_start,
+        const uint8_t *ledge_data = NULL, const uint8_t *ramp_data = NULL) :
       m_w(width),
       m_h(height)
     {
@@ -1034,7 +1047,7 @@ class Maze
         m_cells.emplace_back();
       }
 
-      construct(mazeresources, db, buf, tex, maze_start, ledge_data, ramp_data);
+      construct(mazeresources, db, buf, rnd, tex, maze_start, ledge_data, ramp_data);
     }
 
   public:
@@ -1060,8 +1073,16 @@ class Maze
       return m_h;
     }
 
+    /// Accessor.
+    ///
+    /// \return Wall data.
+    const seq<uint8_t>& getWalls() const
+    {
+      return m_walls;
+    }
+
     /// GEnerate maze.
-    void construct(const MazeResources &mazeresources, ObjectDatabase &db, GeometryBuffer &buf,
+    void construct(const MazeResources &mazeresources, ObjectDatabase &db, GeometryBuffer &buf, Random &rnd,
         const Texture *tex, const vec3 &maze_start, const uint8_t *ledge_data = NULL,
         const uint8_t *ramp_data = NULL)
     {
@@ -1081,10 +1102,10 @@ class Maze
             // If it is not, randomize it.
             if (ledge_data == NULL)
             {
-              getCell(ii, jj, kk).setLedge(EAST, static_cast<uint8_t>(urand(2))); // No ramps yet
-              getCell(ii, jj, kk).setLedge(WEST, static_cast<uint8_t>(urand(2)));
-              getCell(ii, jj, kk).setLedge(NORTH, static_cast<uint8_t>(urand(2)));
-              getCell(ii, jj, kk).setLedge(SOUTH, static_cast<uint8_t>(urand(2)));
+              getCell(ii, jj, kk).setLedge(EAST, static_cast<uint8_t>(rnd.urand(2))); // No ramps yet
+              getCell(ii, jj, kk).setLedge(WEST, static_cast<uint8_t>(rnd.urand(2)));
+              getCell(ii, jj, kk).setLedge(NORTH, static_cast<uint8_t>(rnd.urand(2)));
+              getCell(ii, jj, kk).setLedge(SOUTH, static_cast<uint8_t>(rnd.urand(2)));
             }
             // Unpack data from table 
             else
@@ -1121,12 +1142,12 @@ class Maze
             // Eastern walls
             if (ii < maze_width - 1)
             {
-              getCell(ii, jj, kk).setWallsBasedOnLedgeInformation(getCell(ii, jj, kk), getCell(ii + 1, jj, kk), EAST, NORTH, WEST, SOUTH);
+              getCell(ii, jj, kk).setWallsBasedOnLedgeInformation(rnd, getCell(ii, jj, kk), getCell(ii + 1, jj, kk), EAST, NORTH, WEST, SOUTH);
             }
             // Northern walls
             if (kk < maze_width - 1)
             {
-              getCell(ii, jj, kk).setWallsBasedOnLedgeInformation(getCell(ii, jj, kk), getCell(ii, jj, kk + 1), NORTH, WEST, SOUTH, EAST);
+              getCell(ii, jj, kk).setWallsBasedOnLedgeInformation(rnd, getCell(ii, jj, kk), getCell(ii, jj, kk + 1), NORTH, WEST, SOUTH, EAST);
             }
 #if defined(USE_LD) && defined(DEBUG) && 0
             std::cout << "After setting walls, ledges are [" << getCell(ii, jj, kk).getLedge(EAST) << ", " << getCell(ii, jj, kk).getLedge(NORTH) << ", " << getCell(ii, jj, kk).getLedge(WEST) << ", " << getCell(ii, jj, kk).getLedge(SOUTH) << "]" << std::endl;
@@ -1158,6 +1179,25 @@ class Maze
       }
       //getCell(1, 6, 0).attemptRamp(getCell(1, 6, 0), getCell(1, 7, 0));
 
+      // Record walls between cells for portal culling.
+      m_walls.resize(maze_width * maze_height * maze_width * 2);
+      for(unsigned ii = 0; (maze_width > ii); ++ii)
+      {
+        for(unsigned jj = 0; (maze_height > jj); ++jj)
+        {
+          for(unsigned kk = 0; (maze_width > kk); ++kk)
+          {
+            MazeCell &cell = getCell(ii, jj, kk);
+            unsigned idx = (jj * maze_width * maze_width + kk * maze_width + ii) * 2;
+
+            m_walls[idx + 0] = (ii < maze_width - 1) ? static_cast<uint8_t>(cell.getWall(EAST) |
+                  (cell.getWallDirection(EAST) ? MAZE_WALL_INVERTED : 0)) : MAZE_WALL_TYPE_PLAIN;
+            m_walls[idx + 1] = (kk < maze_width - 1) ? static_cast<uint8_t>(cell.getWall(NORTH) |
+                  (cell.getWallDirection(NORTH) ? MAZE_WALL_INVERTED : 0)) : MAZE_WALL_TYPE_PLAIN;
+          }
+        }
+      }
+
       // Fourth round, draw the ledges based on wall information
       // Also draw the walls themselves
       for(unsigned ii = 0; ii < maze_width; ii++)
@@ -1220,7 +1260,7 @@ class Maze
         }
       }
 
-      m_mesh = msh.insert(buf, 23);
+      m_mesh = msh.insert(buf, rnd, 23);
 
       // Still need to add generated mesh.
       db.addObject(*m_mesh, mat4::identity());
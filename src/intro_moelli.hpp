@@ -10,11 +10,12 @@ class MoelliSprite : public Sprite<ImageRGBA>
     /// Constructor.
     ///
     /// \param buf Geometry buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    MoelliSprite(GeometryBuffer &buf, unsigned seed) :
+    MoelliSprite(GeometryBuffer &buf, Random &rnd, unsigned seed) :
       Sprite(buf, 2.5f)
     {
-      m_image = generate_image(64, 64, seed);
+      m_image = generate_image(64, 64, rnd, seed);
     }
 
   private:
@@ -22,8 +23,9 @@ class MoelliSprite : public Sprite<ImageRGBA>
     ///
     /// \param width Width.
     /// \param height Height.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    static ImageRGBAUptr generate_image(unsigned width, unsigned height, unsigned seed)
+    static ImageRGBAUptr generate_image(unsigned width, unsigned height, Random &rnd, unsigned seed)
     {
       uptr<ImageRGBA> ret(new ImageRGBA(width, height));
       ImageGrayUptr noise[6];
@@ -31,12 +33,12 @@ class MoelliSprite : public Sprite<ImageRGBA>
       for(unsigned ii = 0; (ii < 6); ++ii)
       {
         noise[ii] = new ImageGray((ii + 1) * 64 / 5, (ii + 1) * 31 / 5);
-        noise[ii]->noise();
+        noise[ii]->noise(rnd);
       }
 
       vec2 center = vec2(static_cast<float>(width), static_cast<float>(height)) * 0.5f;
 
-      bsd_srand(seed);
+      rnd.srand(seed);
 
       for(unsigned ii = 0; (width > ii); ++ii)
       {
@@ -98,12 +100,14 @@ class MoelliPart
     /// \param outer Outer distance.
     /// \param upper Upper distance.
     /// \param buf Buffer to insert to.
+    /// \param rnd Random number generator.
+    /// \param seed Random seed.
     /// \param tex Texture to use.
     MoelliPart(float sx, float sy, float sz, float inner, float outer, float upper, GeometryBuffer &buf,
-        unsigned seed, Texture* tex = NULL) :
+        Random &rnd, unsigned seed, Texture* tex = NULL) :
       m_direction(sx, sy, sz)
     {
-      m_mesh = construct(inner, outer, upper, buf, seed);
+      m_mesh = construct(inner, outer, upper, buf, rnd, seed);
 
       m_object = new Object(m_mesh->getBlock(0), mat4::identity(), tex);
     }
@@ -115,8 +119,9 @@ class MoelliPart
     /// \param outer Outer distance.
     /// \param upper Upper distance.
     /// \param buf Buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param seed Random seed.
-    MeshUptr construct(float inner, float outer, float upper, GeometryBuffer &buf, unsigned seed)
+    MeshUptr construct(float inner, float outer, float upper, GeometryBuffer &buf, Random &rnd, unsigned seed)
     {
       static const float ELONGATION_HORIZONTAL = 0.8f;
 
@@ -152,7 +157,7 @@ class MoelliPart
         msh.flipLastFaces(5);
       }
 
-      return msh.insert(buf, seed);
+      return msh.insert(buf, rnd, seed);
     }
 
   public:
@@ -213,35 +218,38 @@ class Moelli
     /// \param inner Inner scale.
     /// \param outer Outer scale.
     /// \param buf Buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param tex Texture to use.
-    Moelli(float inner, float outer, GeometryBuffer &buf, Texture* tex = NULL) :
+    Moelli(float inner, float outer, GeometryBuffer &buf, Random &rnd, Texture* tex = NULL) :
       m_inner(inner),
       m_outer(outer)
     {
       for(unsigned ii = 0; (NUM_SPRITES > ii); ++ii)
       {
-        m_sprites[ii] = new MoelliSprite(buf, ii + 1);
+        m_sprites[ii] = new MoelliSprite(buf, rnd, ii + 1);
       }
-      construct(buf, tex);
+      construct(buf, rnd, tex);
     }
 
   private:
     /// Construct.
     ///
     /// \param buf Buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param tex Texture to use.
-    void construct(GeometryBuffer &buf, Texture* tex)
+    void construct(GeometryBuffer &buf, Random &rnd, Texture* tex)
     {
       static const float ELONGATION_DOWN = 1.3f;
-
-      m_parts[0] = new MoelliPart(1.0f, 1.0f, 1.0f, m_inner, m_outer, m_outer, buf, 1, tex);
-      m_parts[1] = new MoelliPart(-1.0f, 1.0f, 1.0f, m_inner, m_outer, m_outer, buf, 2, tex);
-      m_parts[2] = new MoelliPart(-1.0f, 1.0f, -1.0f, m_inner, m_outer, m_outer, buf, 3, tex);
-      m_parts[3] = new MoelliPart(1.0f, 1.0f, -1.0f, m_inner, m_outer, m_outer, buf, 4, tex);
-      m_parts[4] = new MoelliPart(1.0f, -1.0f, 1.0f, m_inner, m_outer, m_outer * ELONGATION_DOWN, buf, 5, tex);
-      m_parts[5] = new MoelliPart(-1.0f, -1.0f, 1.0f, m_inner, m_outer, m_outer * ELONGATION_DOWN, buf, 6, tex);
-      m_parts[6] = new MoelliPart(-1.0f, -1.0f, -1.0f, m_inner, m_outer, m_outer * ELONGATION_DOWN, buf, 7, tex);
-      m_parts[7] = new MoelliPart(1.0f, -1.0f, -1.0f, m_inner, m_outer, m_outer * ELONGATION_DOWN, buf, 8, tex);
+      float outer_down = m_outer * ELONGATION_DOWN;
+
+      m_parts[0] = new MoelliPart(1.0f, 1.0f, 1.0f, m_inner, m_outer, m_outer, buf, rnd, 1, tex);
+      m_parts[1] = new MoelliPart(-1.0f, 1.0f, 1.0f, m_inner, m_outer, m_outer, buf, rnd, 2, tex);
+      m_parts[2] = new MoelliPart(-1.0f, 1.0f, -1.0f, m_inner, m_outer, m_outer, buf, rnd, 3, tex);
+      m_parts[3] = new MoelliPart(1.0f, 1.0f, -1.0f, m_inner, m_outer, m_outer, buf, rnd, 4, tex);
+      m_parts[4] = new MoelliPart(1.0f, -1.0f, 1.0f, m_inner, m_outer, outer_down, buf, rnd, 5, tex);
+      m_parts[5] = new MoelliPart(-1.0f, -1.0f, 1.0f, m_inner, m_outer, outer_down, buf, rnd, 6, tex);
+      m_parts[6] = new MoelliPart(-1.0f, -1.0f, -1.0f, m_inner, m_outer, outer_down, buf, rnd, 7, tex);
+      m_parts[7] = new MoelliPart(1.0f, -1.0f, -1.0f, m_inner, m_outer, outer_down, buf, rnd, 8, tex);
     }
 
   public:
@@ -268,9 +276,9 @@ class Moelli
     /// \return Randomized sprite.
     const Object& getSprite(unsigned seed) const
     {
-      bsd_srand(seed);
+      Random rnd(seed);
 
-      return m_sprites[urand(NUM_SPRITES)]->getObject();
+      return m_sprites[rnd.urand(NUM_SPRITES)]->getObject();
     }
 
     /// Update this to GPU.
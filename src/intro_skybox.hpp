@@ -135,14 +135,16 @@ class Skybox
     }
 
     /// Generate noise images.
-    void generateNoise()
+    ///
+    /// \param rnd Random number generator.
+    void generateNoise(Random &rnd)
     {
-      bsd_srand(5);
+      rnd.srand(5);
 
       for(unsigned ii = 0, aa = 8, bb = 4; (9 > ii); ++ii, aa = aa * 9 / 5, bb = bb * 9 / 5)
       {
         m_noise_images[ii] = new ImageGray(aa, bb);
-        m_noise_images[ii]->noise();
+        m_noise_images[ii]->noise(rnd);
       }
     }
 
@@ -150,10 +152,12 @@ class Skybox
     /// Construct the skybox.
     ///
     /// \param buf Buffer to insert to.
+    /// \param rnd Random number generator.
     /// \param size Size (radius).
     /// \param func Coloring function.
     /// \param detail Coloring detail.
-    void construct(GeometryBuffer &buffer, float size, SkyboxColoringFunc func, unsigned detail = 256)
+    void construct(GeometryBuffer &buffer, Random &rnd, float size, SkyboxColoringFunc func,
+        unsigned detail = 256)
     {
       LogicalMesh msh;
 
@@ -167,7 +171,7 @@ class Skybox
         m_objects[ii] = new Object(m_mesh->getBlock(ii), mat4::identity(), &m_textures[ii]);
       }
 
-      generateNoise();
+      generateNoise(rnd);
 
       m_images[0] = colorWall(0.0f, func, detail);
       m_images[1] = colorWall(static_cast<float>(M_PI), func, detail);
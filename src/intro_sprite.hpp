@@ -45,7 +45,7 @@ class SpriteBase
       // Faces in inverse order since this will be looking at camera.
       msh.addFace(1, 0, 3, 2U);
 
-      m_mesh = msh.insert(buf, 0);
+      m_mesh = msh.insert(buf);
     }
 
   public:
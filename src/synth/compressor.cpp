@@ -22,6 +22,16 @@ void Compressor::load(const BusData &bus) {
 }
 #endif
 
+void Compressor::serialize(Snapshot &snapshot) const {
+    snapshot.write(amp);
+    snapshot.write(out);
+}
+
+void Compressor::restore(Snapshot &snapshot) {
+    snapshot.read(amp);
+    snapshot.read(out);
+}
+
 void Compressor::run(sample_t input[2]) {
     out[0] = clamp_f(input[0] * amp,
 		     static_cast<sample_t>(-1.0),
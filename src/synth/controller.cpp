@@ -38,6 +38,18 @@ Controller::Controller(Type _type, Range _range,
     update(0, _initial_midi);
 }
 
+void Controller::serialize(Snapshot &snapshot) const {
+    snapshot.write(prev_timestamp);
+    snapshot.write(value);
+    snapshot.write(prev_midi_value);
+}
+
+void Controller::restore(Snapshot &snapshot) {
+    snapshot.read(prev_timestamp);
+    snapshot.read(value);
+    snapshot.read(prev_midi_value);
+}
+
 void Controller::update(unsigned long long timestamp, int midi_value) {
     unused(timestamp);
     if (midi_value != prev_midi_value) {
@@ -2,6 +2,7 @@
 #define _CONTROLLER_H_
 
 #include "types.hpp"
+#include "snapshot.hpp"
 #include <limits>
 
 class Controller {
@@ -33,6 +34,8 @@ public:
 	       sample_t _initial_midi);
     void update(unsigned long long timestamp, int midi_value);
     sample_t get_value() const { return value; }
+    void serialize(Snapshot &snapshot) const;
+    void restore(Snapshot &snapshot);
 };
 
 #endif // _CONTROLLER_H_
@@ -44,6 +44,23 @@ void Delay::load(const BusData &bus) {
 }
 #endif
    
+// Only the first delay[i] samples of each channel are ever used.
+void Delay::serialize(Snapshot &snapshot) const {
+    for (size_t i = 0; i < 2; i++) {
+	snapshot.write(&buffer[i * delay_length_max], delay[i] * sizeof(sample_t));
+    }
+    snapshot.write(buffer_pos);
+    snapshot.write(out);
+}
+
+void Delay::restore(Snapshot &snapshot) {
+    for (size_t i = 0; i < 2; i++) {
+	snapshot.read(&buffer[i * delay_length_max], delay[i] * sizeof(sample_t));
+    }
+    snapshot.read(buffer_pos);
+    snapshot.read(out);
+}
+
 void Delay::run(sample_t input[2]) {
     if (wet_gain == 0.0) {
 	// If wet gain is zero, assume dry gain 1
@@ -2,6 +2,7 @@
 #define _DELAY_H_
 
 #include "types.hpp"
+#include "snapshot.hpp"
 #include <cstdlib>
 
 #ifdef WITH_JSON_LOADER
@@ -32,6 +33,8 @@ public:
     void load(const BusData &bus);
 #endif
     void run(sample_t input[2]);
+    void serialize(Snapshot &snapshot) const;
+    void restore(Snapshot &snapshot);
 };
 
 #endif // _DELAY_H_
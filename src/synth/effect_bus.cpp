@@ -20,6 +20,18 @@ void EffectBus::load(const BusData &bus) {
 }
 #endif
 
+void EffectBus::serialize(Snapshot &snapshot) const {
+    delay.serialize(snapshot);
+    compressor.serialize(snapshot);
+    snapshot.write(out);
+}
+
+void EffectBus::restore(Snapshot &snapshot) {
+    delay.restore(snapshot);
+    compressor.restore(snapshot);
+    snapshot.read(out);
+}
+
 void EffectBus::run(sample_t input[2]) {
     delay.run(input);
     compressor.run(delay.out);
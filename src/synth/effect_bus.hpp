@@ -2,6 +2,7 @@
 #define _EFFECT_BUS_H_
 #include "delay.hpp"
 #include "compressor.hpp"
+#include "snapshot.hpp"
 
 #ifdef WITH_JSON_LOADER
 #include <json/json.h>
@@ -25,6 +26,8 @@ public:
     void load(const BusData &bus);
 #endif
     void run(sample_t input[2]);
+    void serialize(Snapshot &snapshot) const;
+    void restore(Snapshot &snapshot);
 };
 
 #endif // _EFFECT_BUS_H_
@@ -39,6 +39,9 @@ GhostSyn::GhostSyn() {
 }
 
 GhostSyn::~GhostSyn() {
+    for (auto buffer : bus_input_buffers) {
+	delete buffer;
+    }
 }
 
 void GhostSyn::set_instrument_active(int instrument, bool state) {
@@ -216,6 +219,38 @@ void GhostSyn::handle_control_change(int channel, int control, int value) {
     }
 }
 
+void GhostSyn::serialize(Snapshot &snapshot) const {
+    snapshot.write(noise_state);
+    for (auto &voice : voices) {
+	voice.serialize(snapshot);
+    }
+    for (auto &ctrl_set : rt_controls) {
+	for (auto &ctrl : ctrl_set) {
+	    ctrl.serialize(snapshot);
+	}
+    }
+    snapshot.write_vector(sustain_controls);
+    for (auto &bus : effect_buses) {
+	bus.serialize(snapshot);
+    }
+}
+
+void GhostSyn::restore(Snapshot &snapshot) {
+    snapshot.read(noise_state);
+    for (auto &voice : voices) {
+	voice.restore(snapshot);
+    }
+    for (auto &ctrl_set : rt_controls) {
+	for (auto &ctrl : ctrl_set) {
+	    ctrl.restore(snapshot);
+	}
+    }
+    snapshot.read_vector(sustain_controls);
+    for (auto &bus : effect_buses) {
+	bus.restore(snapshot);
+    }
+}
+
 void GhostSyn::zero_bus_inputs(size_t frame_count) {
     for (auto buffer : bus_input_buffers) {
 	memset(buffer->data(), 0, sizeof(sample_t) * frame_count * NUM_CHANNELS);
@@ -226,17 +261,26 @@ void GhostSyn::zero_master_out(size_t frame_count) {
     memset(master_out, 0, sizeof(sample_t) * frame_count * NUM_CHANNELS);
 }
 
+bool GhostSyn::voice_audible(const Voice &voice) const {
+    if (voice.instrument < 0 || !active_instruments[voice.instrument] ||
+	(!voice.pressed && !voice.sustained)) {
+	return false;
+    }
+    int dest_bus = instrument_bus_connections[voice.instrument];
+    return dest_bus >= 0 && active_buses[dest_bus];
+}
+
+bool GhostSyn::bus_audible(size_t bus) const {
+    int dest_bus = bus_bus_connections[bus];
+    return active_buses[bus] && (dest_bus < 0 || active_buses[dest_bus]);
+}
+
 void GhostSyn::process_voices(size_t frame_count) {
     for (auto &voice : voices) {
-
-	if (voice.instrument >= 0 && active_instruments[voice.instrument] &&
-	    (voice.pressed || voice.sustained)) {
+	if (voice_audible(voice)) {
 	    int dest_bus = instrument_bus_connections[voice.instrument];
-
-	    if (dest_bus >= 0 && active_buses[dest_bus]) {
-		sample_t *out = bus_input_buffers[dest_bus]->data();
-		voice.run(rt_controls[voice.instrument], out, frame_count);
-	    }
+	    sample_t *out = bus_input_buffers[dest_bus]->data();
+	    voice.run(rt_controls[voice.instrument], out, frame_count, noise_state);
 	}
     }
 }
@@ -248,7 +292,7 @@ void GhostSyn::process_effect_buses(size_t frame_count) {
 	sample_t *in = bus_input_buffers[source_bus]->data();
 	sample_t *out;
 
-	if (!active_buses[source_bus] || (dest_bus >= 0 && !active_buses[dest_bus])) {
+	if (!bus_audible(source_bus)) {
 	    continue;
 	}
 
@@ -268,14 +312,146 @@ void GhostSyn::process_effect_buses(size_t frame_count) {
     }
 }
 
+void GhostSyn::voice_task(void *task_ctx, size_t idx) {
+    GhostSyn *synth = static_cast<GhostSyn *>(task_ctx);
+    VoiceTask &task = synth->voice_tasks[idx];
+    Voice &voice = synth->voices[task.voice];
+    const size_t frame_count = synth->parallel_frame_count;
+    sample_t *out = synth->voice_out.data() + task.voice * MIX_BUF_LEN * NUM_CHANNELS;
+
+    memset(out, 0, sizeof(sample_t) * frame_count * NUM_CHANNELS);
+    task.frames_rendered = voice.run(synth->rt_controls[voice.instrument], out, frame_count,
+				     task.noise_state);
+}
+
+void GhostSyn::process_voices_parallel(size_t frame_count) {
+    // Each voice starts from the noise state it would have in serial order.
+    size_t num_tasks = 0;
+    for (unsigned int i = 0; i < POLYPHONY; ++i) {
+	const Voice &voice = voices[i];
+	if (voice_audible(voice)) {
+	    VoiceTask &task = voice_tasks[num_tasks++];
+	    task.voice = i;
+	    task.dest_bus = instrument_bus_connections[voice.instrument];
+	    task.noise_state = noise_state;
+	    noise_state = Voice::noise_advance(noise_state, voice.noise_steps(frame_count));
+	}
+    }
+
+    parallel_frame_count = frame_count;
+    parallel_for(parallel_pool, num_tasks, voice_task, this);
+
+    for (size_t i = 0; i < num_tasks; ++i) {
+	const VoiceTask &task = voice_tasks[i];
+	const sample_t *in = voice_out.data() + task.voice * MIX_BUF_LEN * NUM_CHANNELS;
+	sample_t *out = bus_input_buffers[task.dest_bus]->data();
+	for (size_t j = 0; j < task.frames_rendered * NUM_CHANNELS; ++j) {
+	    out[j] += in[j];
+	}
+    }
+}
+
+void GhostSyn::bus_task(void *task_ctx, size_t idx) {
+    GhostSyn *synth = static_cast<GhostSyn *>(task_ctx);
+    const unsigned int bus = synth->bus_tasks[idx];
+    EffectBus &effect_bus = synth->effect_buses[bus];
+    sample_t *in = synth->bus_input_buffers[bus]->data();
+    sample_t *out = synth->bus_out.data() + bus * MIX_BUF_LEN * NUM_CHANNELS;
+
+    for (size_t frame = 0; frame < synth->parallel_frame_count; ++frame) {
+	effect_bus.run(in);
+	out[0] = effect_bus.out[0];
+	out[1] = effect_bus.out[1];
+	in += 2;
+	out += 2;
+    }
+}
+
+void GhostSyn::process_effect_buses_parallel(size_t frame_count) {
+    // Serial processing runs buses in index order, so a bus only receives
+    // output from lower numbered buses. Buses whose inputs are complete run
+    // concurrently, one level of the bus graph at a time.
+    const size_t num_buses = bus_bus_connections.size();
+    int max_level = -1;
+    for (size_t i = 0; i < num_buses; ++i) {
+	bus_rendered[i] = false;
+	bus_levels[i] = -1;
+	if (bus_audible(i)) {
+	    int level = 0;
+	    for (size_t j = 0; j < i; ++j) {
+		if (bus_levels[j] >= level && bus_bus_connections[j] == static_cast<int>(i)) {
+		    level = bus_levels[j] + 1;
+		}
+	    }
+	    bus_levels[i] = level;
+	    max_level = std::max(max_level, level);
+	}
+    }
+
+    parallel_frame_count = frame_count;
+    for (int level = 0; level <= max_level; ++level) {
+	bus_tasks.clear();
+	for (unsigned int i = 0; i < num_buses; ++i) {
+	    if (bus_levels[i] != level) {
+		continue;
+	    }
+	    // Mix output of lower numbered buses in index order.
+	    sample_t *out = bus_input_buffers[i]->data();
+	    for (size_t j = 0; j < i; ++j) {
+		if (bus_rendered[j] && bus_bus_connections[j] == static_cast<int>(i)) {
+		    const sample_t *in = bus_out.data() + j * MIX_BUF_LEN * NUM_CHANNELS;
+		    for (size_t k = 0; k < frame_count * NUM_CHANNELS; ++k) {
+			out[k] += in[k];
+		    }
+		}
+	    }
+	    bus_tasks.push_back(i);
+	}
+	parallel_for(parallel_pool, bus_tasks.size(), bus_task, this);
+	for (unsigned int bus : bus_tasks) {
+	    bus_rendered[bus] = true;
+	}
+    }
+
+    for (size_t i = 0; i < num_buses; ++i) {
+	if (bus_rendered[i] && bus_bus_connections[i] == -1) {
+	    const sample_t *in = bus_out.data() + i * MIX_BUF_LEN * NUM_CHANNELS;
+	    for (size_t k = 0; k < frame_count * NUM_CHANNELS; ++k) {
+		master_out[k] += in[k];
+	    }
+	}
+    }
+}
+
+void GhostSyn::set_parallel(ParallelFor func, void *pool) {
+    parallel_for = func;
+    parallel_pool = pool;
+    if (parallel_for) {
+	const unsigned num_buses = static_cast<unsigned>(bus_bus_connections.size());
+	voice_out.resize(POLYPHONY * MIX_BUF_LEN * NUM_CHANNELS);
+	bus_out.resize(static_cast<unsigned>(num_buses * MIX_BUF_LEN * NUM_CHANNELS));
+	bus_rendered.resize(num_buses);
+	bus_levels.resize(num_buses);
+    }
+}
+
+void GhostSyn::process(size_t frame_count) {
+    zero_master_out(frame_count);
+    zero_bus_inputs(frame_count);
+    if (parallel_for) {
+	process_voices_parallel(frame_count);
+	process_effect_buses_parallel(frame_count);
+    } else {
+	process_voices(frame_count);
+	process_effect_buses(frame_count);
+    }
+}
+
 void GhostSyn::render(float *out_buf[2], uint32_t offset, uint32_t sample_count) {
     while (sample_count > 0) {
 	size_t frames_to_render = std::min(MIX_BUF_LEN, static_cast<size_t>(sample_count));
 
-	zero_master_out(frames_to_render);
-	zero_bus_inputs(frames_to_render);
-	process_voices(frames_to_render);
-	process_effect_buses(frames_to_render);
+	process(frames_to_render);
 
 	for (size_t frame = 0; frame < frames_to_render; ++frame) {
 	    out_buf[0][frame + offset] = clamp_f(master_out[frame * 2],
@@ -295,10 +471,7 @@ void GhostSyn::render_interleaved(float *out_buf, uint32_t frame_count) {
     while (frame_count > 0) {
 	size_t frames_to_render = std::min(MIX_BUF_LEN, static_cast<size_t>(frame_count));
 
-	zero_master_out(frames_to_render);
-	zero_bus_inputs(frames_to_render);
-	process_voices(frames_to_render);
-	process_effect_buses(frames_to_render);
+	process(frames_to_render);
 
 	for (size_t frame = 0; frame < frames_to_render * 2; ++frame) {
 	    *(out_buf++) = clamp_f(master_out[frame],
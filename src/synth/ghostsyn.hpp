@@ -10,6 +10,7 @@
 #include "voice.hpp"
 #include "rt_controls.hpp"
 #include "effect_bus.hpp"
+#include "snapshot.hpp"
 #include <stdint.h>
 #include <string>
 
@@ -59,10 +60,47 @@ private:
 
     sample_t master_out[MIX_BUF_LEN * NUM_CHANNELS];
 
+    // Noise generator shared by all voices.
+    uint32_t noise_state = Voice::NOISE_SEED;
+
+public:
+    // Runs task(task_ctx, i) for every i in [0, count), possibly
+    // concurrently. Returns when all tasks are finished.
+    typedef void (*TaskFunc)(void *task_ctx, size_t idx);
+    typedef void (*ParallelFor)(void *pool, size_t count, TaskFunc task, void *task_ctx);
+
+private:
+    // Parallel rendering. Voices and buses render into private buffers,
+    // which are then mixed in the same order as in serial rendering, so
+    // the result is identical regardless of scheduling.
+    struct VoiceTask {
+	unsigned int voice;
+	int dest_bus;
+	uint32_t noise_state;
+	size_t frames_rendered;
+    };
+
+    ParallelFor parallel_for = nullptr;
+    void *parallel_pool = nullptr;
+    size_t parallel_frame_count = 0;
+    VoiceTask voice_tasks[POLYPHONY];
+    Vector<unsigned int> bus_tasks;
+    Vector<bool> bus_rendered;
+    Vector<int> bus_levels;
+    Vector<sample_t> voice_out;
+    Vector<sample_t> bus_out;
+
     void zero_bus_inputs(size_t frame_count);
     void zero_master_out(size_t frame_count);
+    bool voice_audible(const Voice &voice) const;
+    bool bus_audible(size_t bus) const;
     void process_voices(size_t frame_count);
     void process_effect_buses(size_t frame_count);
+    void process_voices_parallel(size_t frame_count);
+    void process_effect_buses_parallel(size_t frame_count);
+    void process(size_t frame_count);
+    static void voice_task(void *task_ctx, size_t idx);
+    static void bus_task(void *task_ctx, size_t idx);
     
 public:
     GhostSyn();
@@ -71,6 +109,9 @@ public:
     void set_instrument_active(int instrument, bool state);
     void set_bus_active(int bus, bool state);
     void set_force_out_bus(int bus);
+    // Render voices and buses through the given parallel_for. Pass nullptr
+    // to render serially.
+    void set_parallel(ParallelFor func, void *pool);
     static const int OUT_BUS_DEFAULT = -1;
 
 #ifdef WITH_JSON_LOADER
@@ -89,6 +130,12 @@ public:
     void handle_note_off(int channel, int midi_note, int velocity);
     void handle_control_change(int channel, int control, int value);
     void handle_pitch_bend(int channel, int value_1, int value_2);
+
+    // Save or load the rendering state: voices, realtime controls and
+    // effect buses. Restoring requires the same session to be loaded.
+    // Check snapshot.good() after restore().
+    void serialize(Snapshot &snapshot) const;
+    void restore(Snapshot &snapshot);
     static const int MIDI_NUM_CHANNELS = 16;
 };
 
@@ -0,0 +1,43 @@
+#include "snapshot.hpp"
+#include <algorithm>
+#include <cstring>
+
+void Snapshot::write(const void *src, size_t size) {
+    size_t pos = bytes.size();
+    // Grow geometrically, seq::resize() allocates only what is asked for.
+    if (pos + size > bytes.capacity()) {
+	bytes.resize(static_cast<unsigned>(std::max(pos + size, 2 * pos)));
+    }
+    bytes.resize(static_cast<unsigned>(pos + size));
+    memcpy(bytes.data() + pos, src, size);
+}
+
+void Snapshot::read(void *dst, size_t size) {
+    if (!ok || read_pos + size > bytes.size()) {
+	ok = false;
+	memset(dst, 0, size);
+	return;
+    }
+    memcpy(dst, bytes.data() + read_pos, size);
+    read_pos += size;
+}
+
+void Snapshot::rewind() {
+    read_pos = 0;
+    ok = true;
+}
+
+void Snapshot::clear() {
+    bytes.clear();
+    rewind();
+}
+
+void Snapshot::resize(size_t size) {
+    bytes.resize(static_cast<unsigned>(size));
+    rewind();
+}
+
+bool Snapshot::operator==(const Snapshot &other) const {
+    return bytes.size() == other.bytes.size() &&
+	(bytes.size() == 0 || memcmp(&bytes[0], &other.bytes[0], bytes.size()) == 0);
+}
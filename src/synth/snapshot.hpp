@@ -0,0 +1,54 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Flat binary image of synth state. Objects append their state with
+// serialize() and read it back in the same order with restore(). Only
+// state that changes during rendering is stored, so restoring requires
+// the same session to be loaded.
+class Snapshot {
+    Vector<uint8_t> bytes;
+    size_t read_pos = 0;
+    bool ok = true;
+
+public:
+    void write(const void *src, size_t size);
+    void read(void *dst, size_t size);
+
+    template <class T> void write(const T &value) {
+	write(&value, sizeof(T));
+    }
+    template <class T> void read(T &value) {
+	read(&value, sizeof(T));
+    }
+
+    template <class T> void write_vector(const Vector<T> &vec) {
+	for (T value : vec) {
+	    write(value);
+	}
+    }
+    template <class T> void read_vector(Vector<T> &vec) {
+	for (size_t i = 0; i < vec.size(); ++i) {
+	    T value;
+	    read(value);
+	    vec[i] = value;
+	}
+    }
+
+    // False if a read ran past the end of the data.
+    bool good() const { return ok; }
+    // Start reading from the beginning again.
+    void rewind();
+    void clear();
+
+    size_t size() const { return bytes.size(); }
+    uint8_t *data() { return bytes.data(); }
+    void resize(size_t size);
+
+    bool operator==(const Snapshot &other) const;
+};
+
+#endif // _SNAPSHOT_H_
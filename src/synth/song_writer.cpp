@@ -1,61 +1,174 @@
 #include "compiled_song.hpp"
 #include "ghostsyn.hpp"
-
-#include "SDL_thread.h"
+#include "snapshot.hpp"
+#include "song_writer.hpp"
 
 #ifdef WITH_WRITER_MAIN
 #include <sndfile.h>
 #endif // WITH_WRITER_MAIN
 
-#define USE_THREADS 0
+#if defined(USE_LD)
+#include <cstdio>
+#include <string>
+#endif
 
 #define SONG_FRAMES (190 * 44100)
 #define SONG_SAMPLES (SONG_FRAMES * 2)
 #define BUFFER_LENGTH (SONG_SAMPLES * sizeof(float))
 
+// Number of threads used for rendering, including the calling thread.
+#define RENDER_THREADS static_cast<unsigned int>(dnload_SDL_GetCPUCount())
+
 static const size_t frames_per_row = 5000;
 
-struct thread_settings {
-#if 0
-    std::vector<bool> active_instruments;
-    std::vector<bool> active_buses;
-#endif
-    float *out_buf;
-    size_t bytes;
+// Worker threads for GhostSyn::ParallelFor. Tasks are handed out one at a
+// time; the calling thread works on them too.
+struct RenderPool {
+    static const unsigned int MAX_THREADS = 16;
+
+    SDL_mutex *mutex;
+    SDL_cond *work_cond;
+    SDL_cond *done_cond;
+    SDL_Thread *threads[MAX_THREADS];
+    unsigned int num_threads;
+
+    GhostSyn::TaskFunc task;
+    void *task_ctx;
+    size_t task_count;
+    size_t task_next;
+    size_t tasks_done;
+    unsigned int generation;
+    bool quit;
 };
 
-int generate_audio_thread(void *ctx) {
-    struct thread_settings *settings = reinterpret_cast<struct thread_settings *>(ctx);
-#if 0
-    const std::vector<bool> &active_instruments = settings->active_instruments;
-    const std::vector<bool> &active_buses = settings->active_buses;
-#endif
-    float *dst = static_cast<float *>(settings->out_buf);
-    size_t bytes = settings->bytes;
+const unsigned int RenderPool::MAX_THREADS;
 
-    GhostSyn synth;
-    synth.load_session(buses, num_buses, instruments, num_instruments);
+// Run tasks of the current batch until none are left. Mutex must be held.
+static void render_pool_work(RenderPool *pool) {
+    while (pool->task_next < pool->task_count) {
+	size_t idx = pool->task_next++;
+	dnload_SDL_UnlockMutex(pool->mutex);
+	pool->task(pool->task_ctx, idx);
+	dnload_SDL_LockMutex(pool->mutex);
+	if (++pool->tasks_done == pool->task_count) {
+	    dnload_SDL_CondSignal(pool->done_cond);
+	}
+    }
+}
 
-#if 0
-    for (size_t i = 0; i < active_instruments.size(); ++i) {
-	synth.set_instrument_active(i, active_instruments[i]);
+static int render_pool_thread(void *ctx) {
+    RenderPool *pool = static_cast<RenderPool *>(ctx);
+    unsigned int generation = 0;
+
+    dnload_SDL_LockMutex(pool->mutex);
+    for (;;) {
+	while (!pool->quit && pool->generation == generation) {
+	    dnload_SDL_CondWait(pool->work_cond, pool->mutex);
+	}
+	if (pool->quit) {
+	    break;
+	}
+	generation = pool->generation;
+	render_pool_work(pool);
     }
+    dnload_SDL_UnlockMutex(pool->mutex);
+    return 0;
+}
+
+static void render_pool_parallel_for(void *ctx, size_t count, GhostSyn::TaskFunc task, void *task_ctx) {
+    RenderPool *pool = static_cast<RenderPool *>(ctx);
 
-    for (size_t i = 0; i < active_buses.size(); ++i) {
-	synth.set_bus_active(i, active_buses[i]);
+    dnload_SDL_LockMutex(pool->mutex);
+    pool->task = task;
+    pool->task_ctx = task_ctx;
+    pool->task_count = count;
+    pool->task_next = 0;
+    pool->tasks_done = 0;
+    ++pool->generation;
+    for (unsigned int i = 0; i < pool->num_threads; ++i) {
+	dnload_SDL_CondSignal(pool->work_cond);
     }
-#endif
+    render_pool_work(pool);
+    while (pool->tasks_done < pool->task_count) {
+	dnload_SDL_CondWait(pool->done_cond, pool->mutex);
+    }
+    dnload_SDL_UnlockMutex(pool->mutex);
+}
 
-    int playing_notes[16] = { 0 };
-    int playing_instruments[16] = { 0 };
-    size_t bytes_written = 0;
+static void render_pool_init(RenderPool *pool, unsigned int num_threads) {
+    pool->mutex = dnload_SDL_CreateMutex();
+    pool->work_cond = dnload_SDL_CreateCond();
+    pool->done_cond = dnload_SDL_CreateCond();
+    pool->num_threads = std::min(num_threads, RenderPool::MAX_THREADS);
+    pool->task_count = 0;
+    pool->task_next = 0;
+    pool->tasks_done = 0;
+    pool->generation = 0;
+    pool->quit = false;
+    for (unsigned int i = 0; i < pool->num_threads; ++i) {
+	pool->threads[i] = dnload_SDL_CreateThread(render_pool_thread, "render", pool);
+    }
+}
 
-    for (int order_pos = 0; order[order_pos] >= 0; ++order_pos) {
+static void render_pool_quit(RenderPool *pool) {
+    dnload_SDL_LockMutex(pool->mutex);
+    pool->quit = true;
+    for (unsigned int i = 0; i < pool->num_threads; ++i) {
+	dnload_SDL_CondSignal(pool->work_cond);
+    }
+    dnload_SDL_UnlockMutex(pool->mutex);
+    for (unsigned int i = 0; i < pool->num_threads; ++i) {
+	dnload_SDL_WaitThread(pool->threads[i], NULL);
+    }
+    dnload_SDL_DestroyCond(pool->done_cond);
+    dnload_SDL_DestroyCond(pool->work_cond);
+    dnload_SDL_DestroyMutex(pool->mutex);
+}
+
+static const size_t rows_per_pattern = sizeof(TrackerPattern::rows) / sizeof(TrackerRow);
+static const size_t samples_per_pattern = rows_per_pattern * frames_per_row * 2;
+
+// Sequencer state carried over from one row to the next.
+struct SequencerState {
+    int playing_notes[16];
+    int playing_instruments[16];
+};
+
+static void sequencer_init(SequencerState &state) {
+    for (size_t i = 0; i < 16; ++i) {
+	state.playing_notes[i] = 0;
+	state.playing_instruments[i] = 0;
+    }
+}
+
+static int song_length() {
+    int num_orders = 0;
+    while (order[num_orders] >= 0) {
+	++num_orders;
+    }
+    return num_orders;
+}
+
+// Render patterns order[order_begin] .. order[order_end - 1] to their
+// place in out_buf, which holds bytes of interleaved stereo. Returns false
+// if the end of out_buf was reached or rendering was stopped.
+//
+// If stream is given, progress is published after every row. Rows that
+// were already published are not written again, as they may be playing.
+static bool render_orders(GhostSyn &synth, SequencerState &state, int order_begin, int order_end,
+			  float *out_buf, size_t bytes, AudioStream *stream) {
+    int *playing_notes = state.playing_notes;
+    int *playing_instruments = state.playing_instruments;
+    float *dst = out_buf + order_begin * samples_per_pattern;
+    size_t bytes_written = order_begin * samples_per_pattern * sizeof(float);
+    Vector<float> scratch;
+
+    for (int order_pos = order_begin; order_pos < order_end; ++order_pos) {
 	const TrackerPattern &current_pattern = patterns[order[order_pos]];
 	for (auto &row : current_pattern.rows) {
 
 	    if (bytes_written + (frames_per_row * 2 * sizeof(float))>= bytes) {
-		return 0;
+		return false;
 	    }
 	    
 	    size_t track_idx = 0;
@@ -85,75 +198,270 @@ int generate_audio_thread(void *ctx) {
 
 		++track_idx;
 	    }
-	    synth.render_interleaved(dst, frames_per_row);
+	    float *row_dst = dst;
+	    if (stream && bytes_written < stream->ready.load(std::memory_order_acquire)) {
+		scratch.resize(frames_per_row * 2);
+		row_dst = scratch.data();
+	    }
+	    synth.render_interleaved(row_dst, frames_per_row);
 	    dst += frames_per_row * 2;
 	    bytes_written += frames_per_row * 2 * sizeof(float);
+
+	    if (stream) {
+		if (bytes_written > stream->ready.load(std::memory_order_relaxed)) {
+		    stream->ready.store(bytes_written, std::memory_order_release);
+		}
+		if (stream->quit.load(std::memory_order_relaxed)) {
+		    return false;
+		}
+	    }
 	}
     }
-    return 0;
+    return true;
 }
 
-void generate_audio(void *data, const size_t length) {
-    (void)length; // TODO
-#if USE_THREADS
-    float *master_out = reinterpret_cast<float *>(data);
-    struct thread_settings settings[4] = {
-#if 1
-	{ {true, true, true, true, true, true, true, true, true, true},
-	  {true, true, true, true, true, true, true, true} },
-	{ {false, false, false, false, false, false, false, false, false, false},
-	  {false, false, false, false, false, false, false, false} },
-	{ {false, false, false, false, false, false, false, false, false, false},
-	  {false, false, false, false, false, false, false, false} },
-	{ {false, false, false, false, false, false, false, false, false, false},
-	  {false, false, false, false, false, false, false, false} }
-#else
-
-	{ {true, true, false, false, false, false, false, false, false, false},
-	  {true, true, false, false, false, false, false, false} },
-	
-	{ {false, false, true, true, false, false, false, false, false, false,},
-	  {false, false, true, true, false, false, false, false} },
-	
-	{ {false, false, false, false, true, true, false, false, false, false},
-	{false, false, false, false, true, true, true, true} },
-	
-	{ {false, false, false, false, false, false, true, true, true, true},
-	  {false, false, false, false, false, false, true, true} }
-#endif
-    };
+static void checkpoint_save(Snapshot &checkpoint, const GhostSyn &synth, const SequencerState &state) {
+    checkpoint.clear();
+    synth.serialize(checkpoint);
+    checkpoint.write(state);
+}
 
-    SDL_Thread *audio_threads[4];
-    
-    for (size_t i = 0; i < 4; ++i) {
-	settings[i].out_buf = new float[BUFFER_LENGTH];
-	audio_threads[i] = SDL_CreateThread(generate_audio_thread, "x", &settings[i]);
+// Render the song into out_buf, which holds bytes of interleaved stereo.
+// If pool is given, voices and buses are rendered in parallel. If
+// checkpoints is given, the state after each pattern is saved there and
+// the number of checkpoints is returned.
+static int render_song(float *out_buf, size_t bytes, RenderPool *pool, Snapshot *checkpoints,
+		       AudioStream *stream) {
+    GhostSyn synth;
+    synth.load_session(buses, num_buses, instruments, num_instruments);
+    if (pool) {
+	synth.set_parallel(render_pool_parallel_for, pool);
     }
-    for (size_t i = 0; i < 4; ++i) {
-	SDL_WaitThread(audio_threads[i], NULL);
+
+    SequencerState state;
+    sequencer_init(state);
+
+    int num_orders = song_length();
+    for (int order_pos = 0; order_pos < num_orders; ++order_pos) {
+	bool more = render_orders(synth, state, order_pos, order_pos + 1, out_buf, bytes, stream);
+	if (checkpoints) {
+	    checkpoint_save(checkpoints[order_pos], synth, state);
+	}
+	if (!more) {
+	    return order_pos + 1;
+	}
     }
-    
-    for (size_t i = 0; i < 4; ++i) {
-	float *out = master_out;
-	float *in = settings[i].out_buf;
-	for (size_t k = 0; k < SONG_SAMPLES; ++k) {
-	    *(out++) += *(in++);
+    return num_orders;
+}
+
+#if defined(USE_LD)
+// Time-sliced rendering, developer builds only. Segments can only start
+// from checkpoints saved by an earlier render, so it needs a checkpoint
+// file given with set_song_checkpoints(). A serial render saves the synth
+// state after every pattern into the file. Later renders start every
+// pattern from the previous checkpoint and render them all concurrently.
+// A segment is accepted only if its end state equals the next checkpoint,
+// so stale checkpoints are detected and the song is rendered serially
+// again.
+//
+// Without a checkpoint file, and in release builds, the song is rendered
+// serially in time as before, with voices and buses still spread over the
+// render pool.
+static std::string checkpoint_filename;
+static const uint32_t checkpoint_magic = 0x50435347; // "GSCP"
+
+void set_song_checkpoints(const std::string &filename) {
+    checkpoint_filename = filename;
+}
+
+static void hash_add(uint64_t &hash, const void *data, size_t size) {
+    const uint8_t *iter = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+	hash = (hash ^ iter[i]) * 1099511628211ULL;
+    }
+}
+
+// Hash of everything the rendered audio depends on besides the code.
+static uint64_t song_hash(size_t bytes) {
+    uint64_t hash = 14695981039346656037ULL;
+    hash_add(hash, buses, sizeof(buses));
+    hash_add(hash, instruments, sizeof(instruments));
+    hash_add(hash, patterns, sizeof(patterns));
+    hash_add(hash, order, sizeof(order));
+    hash_add(hash, &frames_per_row, sizeof(frames_per_row));
+    hash_add(hash, &bytes, sizeof(bytes));
+    return hash;
+}
+
+static void checkpoints_write(Snapshot *checkpoints, int count, size_t bytes) {
+    FILE *fd = fopen(checkpoint_filename.c_str(), "wb");
+    if (fd == NULL) {
+	return;
+    }
+    uint64_t header[3] = { checkpoint_magic, song_hash(bytes), static_cast<uint64_t>(count) };
+    fwrite(header, sizeof(header), 1, fd);
+    for (int i = 0; i < count; ++i) {
+	uint64_t size = checkpoints[i].size();
+	fwrite(&size, sizeof(size), 1, fd);
+	fwrite(checkpoints[i].data(), checkpoints[i].size(), 1, fd);
+    }
+    fclose(fd);
+}
+
+// Returns the number of checkpoints read, 0 if there are none for this song.
+static int checkpoints_read(Snapshot *checkpoints, int max_count, size_t bytes) {
+    FILE *fd = fopen(checkpoint_filename.c_str(), "rb");
+    if (fd == NULL) {
+	return 0;
+    }
+    uint64_t header[3];
+    int count = 0;
+    if (fread(header, sizeof(header), 1, fd) == 1 &&
+	header[0] == checkpoint_magic && header[1] == song_hash(bytes) &&
+	header[2] <= static_cast<uint64_t>(max_count)) {
+	count = static_cast<int>(header[2]);
+	for (int i = 0; i < count; ++i) {
+	    uint64_t size;
+	    if (fread(&size, sizeof(size), 1, fd) != 1) {
+		count = 0;
+		break;
+	    }
+	    checkpoints[i].resize(size);
+	    if (fread(checkpoints[i].data(), size, 1, fd) != 1) {
+		count = 0;
+		break;
+	    }
 	}
     }
-    // run master effects
+    fclose(fd);
+    return count;
+}
+
+struct SegmentTasks {
+    float *out_buf;
+    size_t bytes;
+    Snapshot *checkpoints;
+    bool *valid;
+    bool *done;
+    int count;
+    // Patterns before this one are valid and published to stream.
+    int published;
+    RenderPool *pool;
+    AudioStream *stream;
+};
+
+// Record the result of a pattern, then publish the patterns that are
+// finished and valid up to the first one that is not. Results are written
+// under the pool mutex, so the samples of every published pattern happen
+// before the store that publishes them.
+static void segment_publish(SegmentTasks *tasks, int order_pos, bool valid) {
+    dnload_SDL_LockMutex(tasks->pool->mutex);
+    tasks->valid[order_pos] = valid;
+    tasks->done[order_pos] = true;
+    if (!tasks->stream) {
+	dnload_SDL_UnlockMutex(tasks->pool->mutex);
+	return;
+    }
+    int pos = tasks->published;
+    while (pos < tasks->count && tasks->done[pos] && tasks->valid[pos]) {
+	++pos;
+    }
+    if (pos > tasks->published) {
+	tasks->published = pos;
+	size_t ready = std::min(pos * samples_per_pattern * sizeof(float), tasks->bytes);
+	tasks->stream->ready.store(ready, std::memory_order_release);
+    }
+    dnload_SDL_UnlockMutex(tasks->pool->mutex);
+}
+
+static void render_segment(void *task_ctx, size_t idx) {
+    SegmentTasks *tasks = static_cast<SegmentTasks *>(task_ctx);
+    int order_pos = static_cast<int>(idx);
+
+    GhostSyn *synth = new GhostSyn();
+    synth->load_session(buses, num_buses, instruments, num_instruments);
+
+    SequencerState state;
+    sequencer_init(state);
+    bool valid = !(tasks->stream && tasks->stream->quit.load(std::memory_order_relaxed));
+    if (valid && order_pos > 0) {
+	Snapshot &start = tasks->checkpoints[order_pos - 1];
+	start.rewind();
+	synth->restore(start);
+	start.read(state);
+	valid = start.good();
+    }
+
+    if (valid) {
+	render_orders(*synth, state, order_pos, order_pos + 1, tasks->out_buf, tasks->bytes, NULL);
+	Snapshot end;
+	checkpoint_save(end, *synth, state);
+	valid = (end == tasks->checkpoints[order_pos]);
+    }
+    delete synth;
+
+    segment_publish(tasks, order_pos, valid);
+}
+
+// Render count patterns concurrently from checkpoints. Returns false if
+// any of the checkpoints did not match.
+static bool render_segments(float *out_buf, size_t bytes, RenderPool *pool,
+			    Snapshot *checkpoints, int count, AudioStream *stream) {
+    bool *valid = new bool[count];
+    bool *done = new bool[count];
+    for (int i = 0; i < count; ++i) {
+	done[i] = false;
+    }
+    SegmentTasks tasks = { out_buf, bytes, checkpoints, valid, done, count, 0, pool, stream };
+    render_pool_parallel_for(pool, static_cast<size_t>(count), render_segment, &tasks);
 
-#else // USE_THREADS
-    struct thread_settings settings[1] = {
-	{
-#if 0
-    {{true, true, true, true, true, true, true, true, true, true},
-     {true, true, true, true, true, true, true, true},
+    bool ret = true;
+    for (int i = 0; i < count; ++i) {
+	ret = ret && valid[i];
+    }
+    delete [] done;
+    delete [] valid;
+    return ret;
+}
 #endif
-     NULL, 0}};
-    settings[0].out_buf = reinterpret_cast<float *>(data);
-    settings[0].bytes = length;
-    generate_audio_thread(settings);
+
+void generate_audio(void *data, const size_t length, AudioStream *stream) {
+    float *out_buf = reinterpret_cast<float *>(data);
+    const unsigned int num_threads = RENDER_THREADS;
+
+    RenderPool pool;
+    RenderPool *pool_ptr = NULL;
+    if (num_threads > 1) {
+	render_pool_init(&pool, num_threads - 1);
+	pool_ptr = &pool;
+    }
+
+#if defined(USE_LD)
+    if (!checkpoint_filename.empty()) {
+	int num_orders = song_length();
+	Snapshot *checkpoints = new Snapshot[num_orders];
+	int count = pool_ptr ? checkpoints_read(checkpoints, num_orders, length) : 0;
+	if (!count || !render_segments(out_buf, length, pool_ptr, checkpoints, count, stream)) {
+	    count = render_song(out_buf, length, pool_ptr, checkpoints, stream);
+	    if (!stream || !stream->quit.load(std::memory_order_relaxed)) {
+		checkpoints_write(checkpoints, count, length);
+	    }
+	}
+	delete [] checkpoints;
+    } else
 #endif
+    {
+	render_song(out_buf, length, pool_ptr, NULL, stream);
+    }
+
+    // Whatever is left past the last row stays silent.
+    if (stream) {
+	stream->ready.store(length, std::memory_order_release);
+    }
+
+    if (pool_ptr) {
+	render_pool_quit(pool_ptr);
+    }
 }
 
 #ifdef WITH_WRITER_MAIN
@@ -0,0 +1,30 @@
+#ifndef _SONG_WRITER_H_
+#define _SONG_WRITER_H_
+
+#include <atomic>
+#include <cstddef>
+
+// Progress of a streaming render. generate_audio() publishes how many
+// bytes from the start of the buffer are final, so playback can start
+// while the rest of the song is still being rendered. Setting quit stops
+// rendering early.
+struct AudioStream {
+    std::atomic<size_t> ready;
+    std::atomic<bool> quit;
+};
+
+// Render the song into data, which holds length bytes of interleaved
+// stereo floats. If stream is given, progress is published there.
+void generate_audio(void *data, const size_t length, AudioStream *stream = NULL);
+
+#if defined(USE_LD)
+#include <string>
+
+// Render the song in time slices from checkpoints in the given file, empty
+// to render serially. If the file is missing or stale, the song is
+// rendered serially and the file is written. Release builds always render
+// serially.
+void set_song_checkpoints(const std::string &filename);
+#endif
+
+#endif // _SONG_WRITER_H_
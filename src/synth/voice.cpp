@@ -4,6 +4,14 @@
 #include "utils.hpp"
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VOICE_SIMD_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VOICE_SIMD_NEON
+#endif
+
 static const uint32_t notetable[13] = {
     0,
     0x4c5504 * 4,
@@ -28,6 +36,9 @@ Voice::Voice() {
     for (size_t i = 0; i < osc_shapes.size(); ++i) {
 	osc_shapes[i] = Instrument::OscShape::SAW;
     }
+    for (size_t i = 0; i < GlobalConfig::max_oscs_per_voice; ++i) {
+	osc_increments[i] = 0;
+    }
     out[0] = out[1] = 0.0f;
 }
 
@@ -49,6 +60,46 @@ void Voice::set_off() {
     fade_ctr = 300;
 }
 
+void Voice::serialize(Snapshot &snapshot) const {
+    snapshot.write_vector(osc_ctr);
+    snapshot.write_vector(params);
+    snapshot.write_vector(osc_pitches);
+    snapshot.write(osc_increments);
+    snapshot.write(mod_ctr);
+    snapshot.write(fade_ctr);
+    snapshot.write(instrument);
+    snapshot.write(note);
+    snapshot.write(octave);
+    snapshot.write(pressed);
+    snapshot.write(sustained);
+    snapshot.write_vector(osc_shapes);
+    snapshot.write(flt_p1);
+    snapshot.write(flt_p2);
+    snapshot.write(flt_modulated_cutoff);
+    snapshot.write(flt_fb_amount);
+    snapshot.write(out);
+}
+
+void Voice::restore(Snapshot &snapshot) {
+    snapshot.read_vector(osc_ctr);
+    snapshot.read_vector(params);
+    snapshot.read_vector(osc_pitches);
+    snapshot.read(osc_increments);
+    snapshot.read(mod_ctr);
+    snapshot.read(fade_ctr);
+    snapshot.read(instrument);
+    snapshot.read(note);
+    snapshot.read(octave);
+    snapshot.read(pressed);
+    snapshot.read(sustained);
+    snapshot.read_vector(osc_shapes);
+    snapshot.read(flt_p1);
+    snapshot.read(flt_p2);
+    snapshot.read(flt_modulated_cutoff);
+    snapshot.read(flt_fb_amount);
+    snapshot.read(out);
+}
+
 void Voice::run_modulation(const Vector<Controller> &rt_controls) {
     static const int num_modulations = 3;
     static const int mod_dests[] = {
@@ -92,67 +143,204 @@ void Voice::run_modulation(const Vector<Controller> &rt_controls) {
 		     (flt_modulated_cutoff * 3.296875f - 0.00497436523438f));
 }
 
-sample_t Voice::filter(sample_t in) {
-    const sample_t feedback = flt_fb_amount * (flt_p1 - flt_p2);
-    flt_p1 = (in * flt_modulated_cutoff +
-	      flt_p1 * (1 - flt_modulated_cutoff) +
-	      feedback +
-	      std::numeric_limits<sample_t>::min());
-    flt_p2 = (flt_p1 * flt_modulated_cutoff * 2 +
-	      flt_p2 * (1 - flt_modulated_cutoff * 2) +
-	      std::numeric_limits<sample_t>::min());
-    
-    return flt_p2;
+// Oscillator phase to waveform: output = ((phase >> 1) - bias) & mask + offset.
+// Noise and silent (zero increment) oscillators are handled separately.
+static void osc_shape_params(Instrument::OscShape shape, uint32_t &mask, uint32_t &offset) {
+    offset = 0;
+    if (shape == Instrument::SQUARE1) {
+	mask = 0x80000000;
+	offset = 0x40000000;
+    } else if (shape == Instrument::SQUARE2) {
+	mask = 0xc0000000;
+    } else {
+	mask = 0xffffffff;
+    }
 }
 
-sample_t Voice::oscillator() {
-    int64_t osc_out = 0;
-    static int32_t rnd = 239823982;
-    
+// Noise is shared by all voices, so it is stepped in rendering order.
+static const uint32_t NOISE_MULTIPLIER = 23498321;
+
+static int32_t noise_next(uint32_t &noise_state) {
+    noise_state *= NOISE_MULTIPLIER;
+    return static_cast<int32_t>(noise_state);
+}
+
+uint32_t Voice::noise_advance(uint32_t noise_state, size_t steps) {
+    uint32_t mul = NOISE_MULTIPLIER;
+    for (; steps > 0; steps >>= 1) {
+	if (steps & 1) {
+	    noise_state *= mul;
+	}
+	mul *= mul;
+    }
+    return noise_state;
+}
+
+size_t Voice::noise_steps(size_t frame_count) const {
+    size_t num_noise = 0;
     for (size_t i = 0; i < osc_pitches.size(); ++i) {
 	if (osc_shapes[i] == Instrument::NOISE) {
-	    rnd = (rnd * 23498320) + rnd;
-	    osc_out += rnd;
-	} else {
-	    if (osc_increments[i] != 0) {
-		osc_ctr[i] += osc_increments[i];
-		int32_t osc_int = (osc_ctr[i] >> 1) - (1 << 30);
-
-		if (osc_shapes[i] == Instrument::SQUARE1) {
-		    osc_int &= 0x80000000;
-		    osc_int += 0x40000000;
-		} else if (osc_shapes[i] == Instrument::SQUARE2) {
-		    osc_int &= 0xc0000000;
-		}
-		osc_out += osc_int;
+	    ++num_noise;
+	}
+    }
+    if (fade_ctr > 0) {
+	frame_count = std::min(frame_count, static_cast<size_t>(fade_ctr - 1));
+    }
+    return frame_count * OVERSAMPLE_FACTOR * num_noise;
+}
+
+void Voice::oscillator_block(sample_t *dst, size_t sample_count, uint32_t &noise_state) {
+    static const uint32_t bias = 1u << 30;
+    int64_t acc[MAX_BLOCK_SAMPLES];
+    uint32_t ctr[GlobalConfig::max_oscs_per_voice];
+    uint32_t inc[GlobalConfig::max_oscs_per_voice];
+    uint32_t mask[GlobalConfig::max_oscs_per_voice];
+    uint32_t offset[GlobalConfig::max_oscs_per_voice];
+    size_t osc_idx[GlobalConfig::max_oscs_per_voice];
+    size_t num_active = 0;
+    size_t num_noise = 0;
+
+    for (size_t i = 0; i < osc_pitches.size(); ++i) {
+	if (osc_shapes[i] == Instrument::NOISE) {
+	    ++num_noise;
+	} else if (osc_increments[i] != 0) {
+	    ctr[num_active] = osc_ctr[i];
+	    inc[num_active] = static_cast<uint32_t>(osc_increments[i]);
+	    osc_shape_params(osc_shapes[i], mask[num_active], offset[num_active]);
+	    osc_idx[num_active] = i;
+	    ++num_active;
+	}
+    }
+
+    // Phase accumulators are independent over time, so the sample_count
+    // (a multiple of OVERSAMPLE_FACTOR) samples are computed four at a time.
+#if defined(VOICE_SIMD_SSE2)
+    {
+	const __m128i vbias = _mm_set1_epi32(static_cast<int32_t>(bias));
+	__m128i vctr[GlobalConfig::max_oscs_per_voice];
+	__m128i vstep[GlobalConfig::max_oscs_per_voice];
+	__m128i vmask[GlobalConfig::max_oscs_per_voice];
+	__m128i voffset[GlobalConfig::max_oscs_per_voice];
+	for (size_t k = 0; k < num_active; ++k) {
+	    vctr[k] = _mm_set_epi32(static_cast<int32_t>(ctr[k] + inc[k] * 4),
+				    static_cast<int32_t>(ctr[k] + inc[k] * 3),
+				    static_cast<int32_t>(ctr[k] + inc[k] * 2),
+				    static_cast<int32_t>(ctr[k] + inc[k]));
+	    vstep[k] = _mm_set1_epi32(static_cast<int32_t>(inc[k] * 4));
+	    vmask[k] = _mm_set1_epi32(static_cast<int32_t>(mask[k]));
+	    voffset[k] = _mm_set1_epi32(static_cast<int32_t>(offset[k]));
+	}
+	for (size_t i = 0; i < sample_count; i += 4) {
+	    __m128i lo = _mm_setzero_si128();
+	    __m128i hi = _mm_setzero_si128();
+	    for (size_t k = 0; k < num_active; ++k) {
+		__m128i osc_int = _mm_sub_epi32(_mm_srli_epi32(vctr[k], 1), vbias);
+		osc_int = _mm_add_epi32(_mm_and_si128(osc_int, vmask[k]), voffset[k]);
+		const __m128i sign = _mm_srai_epi32(osc_int, 31);
+		lo = _mm_add_epi64(lo, _mm_unpacklo_epi32(osc_int, sign));
+		hi = _mm_add_epi64(hi, _mm_unpackhi_epi32(osc_int, sign));
+		vctr[k] = _mm_add_epi32(vctr[k], vstep[k]);
+	    }
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + i), lo);
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + i + 2), hi);
+	}
+    }
+#elif defined(VOICE_SIMD_NEON)
+    {
+	const uint32x4_t vbias = vdupq_n_u32(bias);
+	uint32x4_t vctr[GlobalConfig::max_oscs_per_voice];
+	uint32x4_t vstep[GlobalConfig::max_oscs_per_voice];
+	uint32x4_t vmask[GlobalConfig::max_oscs_per_voice];
+	uint32x4_t voffset[GlobalConfig::max_oscs_per_voice];
+	for (size_t k = 0; k < num_active; ++k) {
+	    const uint32_t init[4] = {
+		ctr[k] + inc[k], ctr[k] + inc[k] * 2, ctr[k] + inc[k] * 3, ctr[k] + inc[k] * 4
+	    };
+	    vctr[k] = vld1q_u32(init);
+	    vstep[k] = vdupq_n_u32(inc[k] * 4);
+	    vmask[k] = vdupq_n_u32(mask[k]);
+	    voffset[k] = vdupq_n_u32(offset[k]);
+	}
+	for (size_t i = 0; i < sample_count; i += 4) {
+	    int64x2_t lo = vdupq_n_s64(0);
+	    int64x2_t hi = vdupq_n_s64(0);
+	    for (size_t k = 0; k < num_active; ++k) {
+		uint32x4_t osc_uint = vsubq_u32(vshrq_n_u32(vctr[k], 1), vbias);
+		osc_uint = vaddq_u32(vandq_u32(osc_uint, vmask[k]), voffset[k]);
+		const int32x4_t osc_int = vreinterpretq_s32_u32(osc_uint);
+		lo = vaddw_s32(lo, vget_low_s32(osc_int));
+		hi = vaddw_s32(hi, vget_high_s32(osc_int));
+		vctr[k] = vaddq_u32(vctr[k], vstep[k]);
 	    }
+	    vst1q_s64(acc + i, lo);
+	    vst1q_s64(acc + i + 2, hi);
+	}
+    }
+#else
+    for (size_t i = 0; i < sample_count; ++i) {
+	int64_t osc_out = 0;
+	for (size_t k = 0; k < num_active; ++k) {
+	    const uint32_t phase = ctr[k] + inc[k] * static_cast<uint32_t>(i + 1);
+	    osc_out += static_cast<int32_t>((((phase >> 1) - bias) & mask[k]) + offset[k]);
+	}
+	acc[i] = osc_out;
+    }
+#endif
+
+    for (size_t k = 0; k < num_active; ++k) {
+	osc_ctr[osc_idx[k]] = ctr[k] + inc[k] * static_cast<uint32_t>(sample_count);
+    }
+
+    const sample_t amp = params[Instrument::PARAM_AMP_INIT];
+    for (size_t i = 0; i < sample_count; ++i) {
+	int64_t osc_out = acc[i];
+	for (size_t k = 0; k < num_noise; ++k) {
+	    osc_out += noise_next(noise_state);
 	}
+	dst[i] = osc_out * amp;
     }
-    return osc_out * params[Instrument::PARAM_AMP_INIT];
 }
 
-void Voice::run(const Vector<Controller> &rt_controls, sample_t *out,
-		size_t frame_count) {
-    const sample_t scale = params[Instrument::PARAM_VOLUME] / OVERSAMPLE_FACTOR / (sample_t(1LL << 32));
+void Voice::filter_block(sample_t *samples, size_t sample_count) {
+    // Filter state is kept in locals for the duration of the block.
+    sample_t p1 = flt_p1;
+    sample_t p2 = flt_p2;
+    const sample_t cutoff = flt_modulated_cutoff;
+    const sample_t fb_amount = flt_fb_amount;
+
+    for (size_t i = 0; i < sample_count; ++i) {
+	const sample_t feedback = fb_amount * (p1 - p2);
+	p1 = (samples[i] * cutoff +
+	      p1 * (1 - cutoff) +
+	      feedback +
+	      std::numeric_limits<sample_t>::min());
+	p2 = (p1 * cutoff * 2 +
+	      p2 * (1 - cutoff * 2) +
+	      std::numeric_limits<sample_t>::min());
+	samples[i] = p2;
+    }
+
+    flt_p1 = p1;
+    flt_p2 = p2;
+}
+
+// Render a block of frames over which modulation stays constant and the
+// note cut fade does not finish.
+void Voice::run_block(sample_t *out, size_t frame_count, sample_t scale, uint32_t &noise_state) {
+    sample_t samples[MAX_BLOCK_SAMPLES];
+    const size_t sample_count = frame_count * OVERSAMPLE_FACTOR;
+
+    oscillator_block(samples, sample_count, noise_state);
+    filter_block(samples, sample_count);
+
+    const sample_t *in = samples;
     for (size_t frame = 0; frame < frame_count; ++frame) {
 	if (fade_ctr > 0) {
 	    --fade_ctr;
-	    if (fade_ctr == 0) {
-		pressed = false;
-		break;
-	    }
 	}
 	sample_t sum = 0.0;
-	if (mod_ctr <= 0) {
-	    run_modulation(rt_controls);
-	    // this must divide the number of frames for a tracker row evenly.
-	    mod_ctr = 20;
-	}
-	--mod_ctr;
 	for (unsigned int i = 0; i < OVERSAMPLE_FACTOR; ++i) {
-	    sample_t tmp = oscillator();
-	    tmp = filter(tmp);
-	    sum += tmp;
+	    sum += *(in++);
 	}
 	sum *= scale;
 	if (fade_ctr > 0) {
@@ -162,3 +350,31 @@ void Voice::run(const Vector<Controller> &rt_controls, sample_t *out,
 	*(out++) += sum;
     }
 }
+
+size_t Voice::run(const Vector<Controller> &rt_controls, sample_t *out,
+		  size_t frame_count, uint32_t &noise_state) {
+    const sample_t scale = params[Instrument::PARAM_VOLUME] / OVERSAMPLE_FACTOR / (sample_t(1LL << 32));
+    size_t frames_rendered = 0;
+    while (frame_count > 0) {
+	// The note cut fade ends at the start of a frame.
+	if (fade_ctr == 1) {
+	    fade_ctr = 0;
+	    pressed = false;
+	    break;
+	}
+	if (mod_ctr <= 0) {
+	    run_modulation(rt_controls);
+	    mod_ctr = MODULATION_INTERVAL;
+	}
+	size_t block = std::min(frame_count, static_cast<size_t>(mod_ctr));
+	if (fade_ctr > 0) {
+	    block = std::min(block, static_cast<size_t>(fade_ctr - 1));
+	}
+	run_block(out, block, scale, noise_state);
+	mod_ctr -= static_cast<int>(block);
+	out += block * 2;
+	frame_count -= block;
+	frames_rendered += block;
+    }
+    return frames_rendered;
+}
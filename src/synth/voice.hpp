@@ -4,10 +4,15 @@
 #include "instrument.hpp"
 #include "controller.hpp"
 #include "globalconfig.hpp"
+#include "snapshot.hpp"
 #include <cstdint>
 
 class Voice {
     static const unsigned int OVERSAMPLE_FACTOR = 4;
+    // Frames between envelope updates. This must divide the number of
+    // frames for a tracker row evenly.
+    static const int MODULATION_INTERVAL = 20;
+    static const unsigned int MAX_BLOCK_SAMPLES = MODULATION_INTERVAL * OVERSAMPLE_FACTOR;
 
     Vector<uint32_t> osc_ctr;
     // Current voice params. Initialized from instrument on note on,
@@ -16,8 +21,9 @@ class Voice {
     Vector<sample_t> osc_pitches;
     int32_t osc_increments[GlobalConfig::max_oscs_per_voice];
 
-    sample_t oscillator();
-    sample_t filter(sample_t in);
+    void oscillator_block(sample_t *dst, size_t sample_count, uint32_t &noise_state);
+    void filter_block(sample_t *samples, size_t sample_count);
+    void run_block(sample_t *out, size_t frame_count, sample_t scale, uint32_t &noise_state);
     void run_modulation(const Vector<Controller> &rt_controls);
 
     int mod_ctr = 0;
@@ -47,7 +53,18 @@ public:
     void set_off();
     void set_param(size_t param_idx, sample_t value);
 
-    void run(const Vector<Controller> &rt_controls, sample_t *out, const size_t frame_count);
+    // Returns the number of frames rendered, which is less than frame_count
+    // if the note cut fade ends. noise_state is the shared noise generator.
+    size_t run(const Vector<Controller> &rt_controls, sample_t *out, const size_t frame_count,
+	       uint32_t &noise_state);
+    // Number of noise generator steps the next run() of frame_count frames takes.
+    size_t noise_steps(size_t frame_count) const;
+
+    static const uint32_t NOISE_SEED = 239823982;
+    static uint32_t noise_advance(uint32_t noise_state, size_t steps);
+
+    void serialize(Snapshot &snapshot) const;
+    void restore(Snapshot &snapshot);
 };
 
 #endif // _VOICE_H_
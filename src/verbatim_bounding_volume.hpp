@@ -41,7 +41,10 @@ class BoundingVolume
   public:
     /// \brief Constructor.
     ///
-    /// \param msh Mesh to construct from.
+    /// Transforms the precalculated object space box of the block, the volume is exact for rotations that map
+    /// axes onto axes and conservative otherwise.
+    ///
+    /// \param block Index block to construct from.
     /// \param transform Transform to use.
     BoundingVolume(const IndexBlock &block, const mat4 &transform) :
       m_x_min(FLT_MAX),
@@ -51,17 +54,30 @@ class BoundingVolume
       m_z_min(FLT_MAX),
       m_z_max(-FLT_MAX)
     {
-      for(unsigned ii = 0, ee = block.getIndexCount(); (ii != ee); ++ii)
+      const vec3 &bmin = block.getBoundsMin();
+      const vec3 &bmax = block.getBoundsMax();
+
+      // Block without faces has no extent.
+      if(bmin[0] <= bmax[0])
       {
-        unsigned vertex_index = block.getIndex(ii);
-        vec3 transformed_vertex = transform * block.getVertex(vertex_index).getPosition();
-
-        m_x_min = std::min(m_x_min, transformed_vertex[0]);
-        m_x_max = std::max(m_x_max, transformed_vertex[0]);
-        m_y_min = std::min(m_y_min, transformed_vertex[1]);
-        m_y_max = std::max(m_y_max, transformed_vertex[1]);
-        m_z_min = std::min(m_z_min, transformed_vertex[2]);
-        m_z_max = std::max(m_z_max, transformed_vertex[2]);
+        vec3 center = transform * ((bmin + bmax) * 0.5f);
+        vec3 extent = (bmax - bmin) * 0.5f;
+        vec3 world_extent(0.0f, 0.0f, 0.0f);
+
+        for(unsigned ii = 0; (3 > ii); ++ii)
+        {
+          for(unsigned jj = 0; (3 > jj); ++jj)
+          {
+            world_extent[ii] += std::abs(transform[jj * 4 + ii]) * extent[jj];
+          }
+        }
+
+        m_x_min = center[0] - world_extent[0];
+        m_x_max = center[0] + world_extent[0];
+        m_y_min = center[1] - world_extent[1];
+        m_y_max = center[1] + world_extent[1];
+        m_z_min = center[2] - world_extent[2];
+        m_z_max = center[2] + world_extent[2];
       }
       m_center = (vec3(m_x_max, m_y_max, m_z_max) + vec3(m_x_min, m_y_min, m_z_min)) * 0.5f;
     }
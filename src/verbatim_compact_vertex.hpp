@@ -0,0 +1,106 @@
+#ifndef VERBATIM_COMPACT_VERTEX_HPP
+#define VERBATIM_COMPACT_VERTEX_HPP
+
+#include "verbatim_vertex.hpp"
+
+/// Compact vertex class.
+///
+/// Vertex for static geometry. Position is quantized into 16-bit integers in units of a per-mesh scale,
+/// bone weights and references are dropped.
+class CompactVertex
+{
+  public:
+    /// Position offset.
+    static const ptrdiff_t POSITION_OFFSET = 0;
+
+    /// Texcoord offset.
+    static const ptrdiff_t TEXCOORD_OFFSET = 4 * sizeof(int16_t);
+
+    /// Normal offset.
+    static const ptrdiff_t NORMAL_OFFSET = TEXCOORD_OFFSET + sizeof(ivec4);
+
+    /// Color offset.
+    static const ptrdiff_t COLOR_OFFSET = NORMAL_OFFSET + sizeof(ivec4);
+
+    /// Largest quantized position component.
+    static const int POSITION_LIMIT = 32767;
+
+  private:
+    /// Quantized position data, last component is padding.
+    int16_t m_position[4];
+
+    /// Texcoord data.
+    ivec4 m_texcoord;
+
+    /// Normal data.
+    ivec4 m_normal;
+
+    /// Color data.
+    uvec4 m_color;
+
+  public:
+    /// Constructor.
+    ///
+    /// \param op Full vertex, position must be on the grid of given scale.
+    /// \param scale Position scale.
+    CompactVertex(const Vertex &op, float scale) :
+      m_texcoord(op.getTexcoord()),
+      m_normal(op.getNormal()),
+      m_color(op.getColor())
+    {
+      for(unsigned ii = 0; (3 > ii); ++ii)
+      {
+        m_position[ii] = quantize(op.getPosition()[ii], scale);
+      }
+      m_position[3] = 0;
+    }
+
+  private:
+    /// Quantize a position component.
+    ///
+    /// \param value Position component.
+    /// \param scale Position scale.
+    /// \return Nearest quantized value.
+    static int16_t quantize(float value, float scale)
+    {
+      float ret = value / scale;
+
+      return static_cast<int16_t>((ret >= 0.0f) ? (ret + 0.5f) : (ret - 0.5f));
+    }
+
+  public:
+    /// Get position scale for given extent.
+    ///
+    /// Scale is a power of two, so quantized positions convert back to floating point exactly.
+    ///
+    /// \param extent Largest absolute position component.
+    /// \return Position scale.
+    static float get_position_scale(float extent)
+    {
+      float ret = 1.0f;
+
+      while(extent > ret * static_cast<float>(POSITION_LIMIT))
+      {
+        ret *= 2.0f;
+      }
+      while((extent <= ret * static_cast<float>(POSITION_LIMIT / 2)) && ((1.0f / 65536.0f) < ret))
+      {
+        ret *= 0.5f;
+      }
+      return ret;
+    }
+
+    /// Snap a position onto the grid of given scale.
+    ///
+    /// \param op Position.
+    /// \param scale Position scale.
+    /// \return Position as it is after quantization.
+    static vec3 snap_position(const vec3 &op, float scale)
+    {
+      return vec3(static_cast<float>(quantize(op[0], scale)) * scale,
+          static_cast<float>(quantize(op[1], scale)) * scale,
+          static_cast<float>(quantize(op[2], scale)) * scale);
+    }
+};
+
+#endif
@@ -6,11 +6,29 @@
 #include "verbatim_face.hpp"
 #include "verbatim_mesh.hpp"
 
+#include <atomic>
+
 /// Compiled mesh.
 ///
 /// Generated by precalculation from logical mesh.
 class CompiledMesh
 {
+  private:
+    /// Post-transform vertex cache size assumed when ordering faces.
+    static const unsigned VERTEX_CACHE_SIZE = 16;
+
+#if defined(USE_LD)
+  private:
+    /// Vertex cache misses before ordering faces.
+    static std::atomic<unsigned> g_cache_misses_before;
+
+    /// Vertex cache misses after ordering faces.
+    static std::atomic<unsigned> g_cache_misses_after;
+
+    /// Number of faces ordered.
+    static std::atomic<unsigned> g_cache_faces;
+#endif
+
   private:
     /// Vertex array.
     seq<Vertex> m_vertices;
@@ -38,33 +56,398 @@ class CompiledMesh
     /// Append caps to geometry buffer.
     ///
     /// \param buffer Target buffer.
-    /// \param object_id Object id to use.
-    /// \param exists Add real or unreal edges?
-    void appendCaps(GeometryBuffer &buffer, unsigned object_id, bool exists) const
+    /// \param order Cap indices in bucket order.
+    /// \param first First index into order.
+    /// \param last One past last index into order.
+    /// \param base First edge vertex of the mesh being inserted.
+    void appendCaps(GeometryBuffer &buffer, const seq<unsigned> &order, unsigned first, unsigned last,
+        unsigned base) const
     {
-      for(const Cap &vv : m_caps)
+      for(unsigned ii = first; (last > ii); ++ii)
       {
-        if((vv.getBlockId() == object_id) && (vv.isReal() == exists))
-        {
-          buffer.addCap(vv.getCorner(0), vv.getCorner(1), vv.getCorner(2), vv.getNormal());
-        }
+        const Cap &vv = m_caps[order[ii]];
+        buffer.addCap(vv.getCorner(0), vv.getCorner(1), vv.getCorner(2), vv.getNormal(), base);
       }
     }
 
     /// Append edges to geometry buffer.
     ///
     /// \param buffer Target buffer.
-    /// \param object_id Object id to use.
-    /// \param exists Add real or unreal edges?
-    void appendEdges(GeometryBuffer &buffer, unsigned object_id, bool exists) const
+    /// \param order Edge indices in bucket order.
+    /// \param first First index into order.
+    /// \param last One past last index into order.
+    void appendEdges(GeometryBuffer &buffer, const seq<unsigned> &order, unsigned first, unsigned last) const
+    {
+      for(unsigned ii = first; (last > ii); ++ii)
+      {
+        buffer.addEdge(m_edges[order[ii]]);
+      }
+    }
+
+    /// Bucket elements by block id.
+    ///
+    /// Stable counting sort. Every block has two buckets, real elements are put in the first one and non-real
+    /// elements in the second one if splitting. Elements with block id out of range are dropped.
+    ///
+    /// \param elements Elements to bucket.
+    /// \param split_real Put non-real elements into the second bucket of the block?
+    /// \param order Element indices in bucket order.
+    /// \param offsets Start of every bucket in order, followed by the total count.
+    template<typename T> void bucketElements(const seq<T> &elements, bool split_real, seq<unsigned> &order,
+        seq<unsigned> &offsets) const
     {
-      for(const Edge &vv : m_edges)
+      unsigned bucket_count = m_block_count * 2;
+
+      offsets.resize(bucket_count + 1);
+      for(unsigned &vv : offsets)
       {
-        if((vv.getBlockId() == object_id) && (vv.isReal() == exists))
+        vv = 0;
+      }
+      for(const T &vv : elements)
+      {
+        if(m_block_count > vv.getBlockId())
         {
-          buffer.addEdge(vv);
+          ++offsets[get_bucket(vv, split_real) + 1];
         }
       }
+      for(unsigned ii = 1; (bucket_count >= ii); ++ii)
+      {
+        offsets[ii] += offsets[ii - 1];
+      }
+
+      // Fill using a running position for each bucket, then restore bucket starts.
+      order.resize(offsets[bucket_count]);
+      for(unsigned ii = 0; (elements.size() > ii); ++ii)
+      {
+        const T &vv = elements[ii];
+
+        if(m_block_count > vv.getBlockId())
+        {
+          order[offsets[get_bucket(vv, split_real)]++] = ii;
+        }
+      }
+      for(unsigned ii = bucket_count; (0 < ii); --ii)
+      {
+        offsets[ii] = offsets[ii - 1];
+      }
+      offsets[0] = 0;
+    }
+
+    /// Get bucket of an element.
+    ///
+    /// \param op Element.
+    /// \param split_real Put non-real elements into the second bucket of the block?
+    /// \return Bucket index.
+    static unsigned get_bucket(const Element &op, bool split_real)
+    {
+      return op.getBlockId() * 2 + ((split_real && !op.isReal()) ? 1 : 0);
+    }
+
+    /// Count vertex cache misses when drawing faces in current order.
+    ///
+    /// Simulates a FIFO cache of VERTEX_CACHE_SIZE entries.
+    ///
+    /// \return Number of cache misses.
+    unsigned countCacheMisses() const
+    {
+      seq<unsigned> inserted;
+      unsigned ret = 0;
+
+      // Number of the miss that inserted the vertex into the cache, 0 if never inserted.
+      inserted.resize(m_vertices.size());
+      for(const Face &vv : m_faces)
+      {
+        for(unsigned ii = 0; (3 > ii); ++ii)
+        {
+          unsigned idx = vv.getIndex(ii);
+
+          if((0 == inserted[idx]) || (ret - inserted[idx] >= VERTEX_CACHE_SIZE))
+          {
+            ++ret;
+            inserted[idx] = ret;
+          }
+        }
+      }
+      return ret;
+    }
+
+    /// Merge identical vertices.
+    ///
+    /// Faces are compiled with vertices of their own, but neighboring faces often end up with identical
+    /// vertex data. Sharing these is what allows the vertex cache to work.
+    void weldVertices()
+    {
+      unsigned vertex_count = m_vertices.size();
+      HashChain chain(vertex_count);
+      seq<unsigned> remap;
+      unsigned next = 0;
+
+      remap.resize(vertex_count);
+      for(unsigned ii = 0; (vertex_count > ii); ++ii)
+      {
+        const Vertex &vv = m_vertices[ii];
+        unsigned hash = hash_vertex(vv);
+        unsigned found = HashChain::END;
+
+        for(unsigned jj = chain.first(hash); (HashChain::END != jj); jj = chain.next(jj))
+        {
+          if(m_vertices[jj] == vv)
+          {
+            found = jj;
+            break;
+          }
+        }
+        if(HashChain::END != found)
+        {
+          remap[ii] = found;
+          continue;
+        }
+
+        if(next != ii)
+        {
+          m_vertices[next] = vv;
+        }
+        chain.add(hash, next);
+        remap[ii] = next;
+        ++next;
+      }
+      while(m_vertices.size() > next)
+      {
+        m_vertices.pop_back();
+      }
+
+      for(Face &vv : m_faces)
+      {
+        vv.remapIndices(remap.getData());
+      }
+    }
+
+    /// Get hash of vertex data.
+    ///
+    /// \param op Vertex.
+    /// \return Hash.
+    static unsigned hash_vertex(const Vertex &op)
+    {
+      const vec3 &pos = op.getPosition();
+      ivec4 tex = op.getTexcoord();
+      unsigned ret = 0;
+
+      for(unsigned ii = 0; (3 > ii); ++ii)
+      {
+        ret = HashChain::combine(ret, static_cast<unsigned>(static_cast<int>(pos[ii] * 1024.0f)));
+      }
+      for(unsigned ii = 0; (4 > ii); ++ii)
+      {
+        ret = HashChain::combine(ret, static_cast<unsigned>(tex[ii]));
+        ret = HashChain::combine(ret, static_cast<unsigned>(op.getNormal()[ii]));
+      }
+      return ret;
+    }
+
+    /// Order faces for post-transform vertex cache locality.
+    ///
+    /// Uses Tipsify (Sander, Nehab and Barczak 2007) separately on every run of faces with the same block id
+    /// and existence, so runs stay intact.
+    void orderFaces()
+    {
+      unsigned vertex_count = m_vertices.size();
+      unsigned face_count = m_faces.size();
+      seq<unsigned> adjacency_base;
+      seq<unsigned> adjacency_fill;
+      seq<unsigned> adjacency;
+      seq<unsigned> live;
+      seq<unsigned> cache_time;
+      seq<unsigned> dead_end;
+      seq<unsigned> candidates;
+      seq<unsigned> order;
+      seq<bool> emitted;
+
+      // Faces of every vertex in ascending order.
+      adjacency_base.resize(vertex_count + 1);
+      for(const Face &vv : m_faces)
+      {
+        for(unsigned ii = 0; (3 > ii); ++ii)
+        {
+          ++adjacency_base[vv.getIndex(ii) + 1];
+        }
+      }
+      for(unsigned ii = 1; (vertex_count >= ii); ++ii)
+      {
+        adjacency_base[ii] += adjacency_base[ii - 1];
+      }
+      adjacency_fill.resize(vertex_count);
+      for(unsigned ii = 0; (vertex_count > ii); ++ii)
+      {
+        adjacency_fill[ii] = adjacency_base[ii];
+      }
+      adjacency.resize(face_count * 3);
+      for(unsigned ii = 0; (face_count > ii); ++ii)
+      {
+        for(unsigned jj = 0; (3 > jj); ++jj)
+        {
+          adjacency[adjacency_fill[m_faces[ii].getIndex(jj)]++] = ii;
+        }
+      }
+
+      live.resize(vertex_count);
+      cache_time.resize(vertex_count);
+      emitted.resize(face_count);
+
+      for(unsigned first = 0, last = 0; (face_count > first); first = last)
+      {
+        for(last = first + 1; (face_count > last) && !Element::qsort_cmp_element(m_faces[first], m_faces[last]);
+            ++last) { }
+
+        for(unsigned ii = first * 3; (last * 3 > ii); ++ii)
+        {
+          unsigned idx = m_faces[ii / 3].getIndex(ii % 3);
+          live[idx] = 0;
+          cache_time[idx] = 0;
+        }
+        for(unsigned ii = first * 3; (last * 3 > ii); ++ii)
+        {
+          ++live[m_faces[ii / 3].getIndex(ii % 3)];
+        }
+
+        unsigned time = VERTEX_CACHE_SIZE + 1;
+        unsigned cursor = first * 3;
+        unsigned fanning = m_faces[first].getIndex(0);
+        dead_end.clear();
+
+        for(;;)
+        {
+          // Emit all remaining faces around fanning vertex.
+          candidates.clear();
+          for(unsigned ii = adjacency_base[fanning]; (adjacency_base[fanning + 1] > ii); ++ii)
+          {
+            unsigned face = adjacency[ii];
+
+            if((first > face) || (last <= face) || emitted[face])
+            {
+              continue;
+            }
+            emitted[face] = true;
+            order.push_back(face);
+
+            for(unsigned jj = 0; (3 > jj); ++jj)
+            {
+              unsigned idx = m_faces[face].getIndex(jj);
+
+              dead_end.push_back(idx);
+              candidates.push_back(idx);
+              --live[idx];
+              if(time - cache_time[idx] > VERTEX_CACHE_SIZE)
+              {
+                cache_time[idx] = time;
+                ++time;
+              }
+            }
+          }
+
+          // Next fanning vertex is the one that stays in cache longest, if it will still be in cache after all
+          // its faces have been emitted.
+          unsigned next = HashChain::END;
+          int best = -1;
+          for(unsigned idx : candidates)
+          {
+            if(0 < live[idx])
+            {
+              int priority = 0;
+
+              if(time - cache_time[idx] + 2 * live[idx] <= VERTEX_CACHE_SIZE)
+              {
+                priority = static_cast<int>(time - cache_time[idx]);
+              }
+              if(priority > best)
+              {
+                best = priority;
+                next = idx;
+              }
+            }
+          }
+          // Dead end, try recently referenced vertices and then in input order.
+          while((HashChain::END == next) && !dead_end.empty())
+          {
+            unsigned idx = dead_end.back();
+            dead_end.pop_back();
+            if(0 < live[idx])
+            {
+              next = idx;
+            }
+          }
+          for(; (HashChain::END == next) && (last * 3 > cursor); ++cursor)
+          {
+            unsigned idx = m_faces[cursor / 3].getIndex(cursor % 3);
+            if(0 < live[idx])
+            {
+              next = idx;
+            }
+          }
+          if(HashChain::END == next)
+          {
+            break;
+          }
+          fanning = next;
+        }
+      }
+
+      seq<Face> faces(face_count);
+      for(unsigned vv : order)
+      {
+        faces.push_back(m_faces[vv]);
+      }
+      for(unsigned ii = 0; (face_count > ii); ++ii)
+      {
+        m_faces[ii] = faces[ii];
+      }
+    }
+
+    /// Order vertices in the order faces first refer to them.
+    ///
+    /// Improves pre-transform vertex fetch locality.
+    void orderVertices()
+    {
+      unsigned vertex_count = m_vertices.size();
+      seq<unsigned> remap;
+      unsigned next = 0;
+
+      remap.resize(vertex_count);
+      for(unsigned &vv : remap)
+      {
+        vv = HashChain::END;
+      }
+      for(const Face &vv : m_faces)
+      {
+        for(unsigned ii = 0; (3 > ii); ++ii)
+        {
+          unsigned idx = vv.getIndex(ii);
+          if(HashChain::END == remap[idx])
+          {
+            remap[idx] = next++;
+          }
+        }
+      }
+      for(unsigned &vv : remap)
+      {
+        if(HashChain::END == vv)
+        {
+          vv = next++;
+        }
+      }
+
+      seq<Vertex> vertices(vertex_count);
+      for(const Vertex &vv : m_vertices)
+      {
+        vertices.push_back(vv);
+      }
+      for(unsigned ii = 0; (vertex_count > ii); ++ii)
+      {
+        m_vertices[remap[ii]] = vertices[ii];
+      }
+      for(Face &vv : m_faces)
+      {
+        vv.remapIndices(remap.getData());
+      }
     }
 
   public:
@@ -135,15 +518,21 @@ class CompiledMesh
 
     /// Insert object into a vertex buffer.
     ///
-    /// \param op Geometry buffer to insert to.
-    /// \return Compiled mesh as result of insertion.
-    MeshUptr insert(GeometryBuffer &op) const
+    /// If the geometry buffer is full, the object is inserted into the next page of it.
+    ///
+    /// \param buffer Geometry buffer to insert to.
+    /// \return Compiled mesh as result of insertion or empty if the object does not fit even an empty page.
+    MeshUptr insert(GeometryBuffer &buffer) const
     {
-      if(!op.fitsVertices(m_vertices.size()) || !op.fitsEdgeVertices(m_caps.size() * 3))
+      unsigned edge_vertex_count = m_edges.size() * 4 + m_caps.size() * 3;
+      GeometryBuffer &op = buffer.getPage(m_vertices.size(), edge_vertex_count);
+
+      if(!op.fitsVertices(m_vertices.size()) || !op.fitsEdgeVertices(edge_vertex_count))
       {
         return MeshUptr();
       }
-      MeshUptr ret(new Mesh(op));
+      MeshUptr ret(new Mesh(op, op.getVertexCount(), op.getEdgeVertexCount()));
+      op.addMesh(*ret);
 
       // Vertices first.
       unsigned vertex_base = op.getVertexCount();
@@ -152,6 +541,17 @@ class CompiledMesh
         op.addVertex(vv);
       }
 
+      // Bucket all primitives by block once.
+      seq<unsigned> face_order;
+      seq<unsigned> face_offsets;
+      seq<unsigned> edge_order;
+      seq<unsigned> edge_offsets;
+      seq<unsigned> cap_order;
+      seq<unsigned> cap_offsets;
+      bucketElements(m_faces, false, face_order, face_offsets);
+      bucketElements(m_edges, true, edge_order, edge_offsets);
+      bucketElements(m_caps, true, cap_order, cap_offsets);
+
       // Add objects, one object at a time.
       for(unsigned ii = 0; (m_block_count > ii); ++ii)
       {
@@ -160,43 +560,42 @@ class CompiledMesh
         unsigned face_count_full = 0;
 
         // Real faces.
-        for(const Face &vv : m_faces)
+        for(unsigned jj = face_offsets[ii * 2], ee = face_offsets[ii * 2 + 1]; (ee > jj); ++jj)
         {
-          if(vv.getBlockId() == ii)
+          const Face &vv = m_faces[face_order[jj]];
+
+          face_count_full += 3;
+          if(vv.isReal())
           {
-            face_count_full += 3;
-            if(vv.isReal())
-            {
-              face_count += 3;
+            face_count += 3;
 #if defined(USE_LD)
-              if(face_count != face_count_full)
-              {
-                std::ostringstream sstr;
-                sstr << "face order problem for object " << ii;
-                BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
-              }
-#endif
+            if(face_count != face_count_full)
+            {
+              std::ostringstream sstr;
+              sstr << "face order problem for object " << ii;
+              BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
             }
-            op.addIndex(vv.getConvertedIndex(vertex_base, 0));
-            op.addIndex(vv.getConvertedIndex(vertex_base, 1));
-            op.addIndex(vv.getConvertedIndex(vertex_base, 2));
+#endif
           }
+          op.addIndex(vv.getConvertedIndex(vertex_base, 0));
+          op.addIndex(vv.getConvertedIndex(vertex_base, 1));
+          op.addIndex(vv.getConvertedIndex(vertex_base, 2));
         }
 
         unsigned edge_base = op.getEdgeIndexCount();
         // Real edges.
-        appendEdges(op, ii, true);
+        appendEdges(op, edge_order, edge_offsets[ii * 2], edge_offsets[ii * 2 + 1]);
         unsigned edge_count = op.getEdgeIndexCount() - edge_base;
         // Non-real edges.
-        appendEdges(op, ii, false);
+        appendEdges(op, edge_order, edge_offsets[ii * 2 + 1], edge_offsets[ii * 2 + 2]);
         unsigned edge_count_full = op.getEdgeIndexCount() - edge_base;
 
         unsigned cap_base = op.getEdgeIndexCount();
         // Real caps.
-        appendCaps(op, ii, true);
+        appendCaps(op, cap_order, cap_offsets[ii * 2], cap_offsets[ii * 2 + 1], ret->getEdgeVertexBase());
         unsigned cap_count = op.getEdgeIndexCount() - cap_base;
         // Non-real caps.
-        appendCaps(op, ii, false);
+        appendCaps(op, cap_order, cap_offsets[ii * 2 + 1], cap_offsets[ii * 2 + 2], ret->getEdgeVertexBase());
         unsigned cap_count_full = op.getEdgeIndexCount() - cap_base;
   
         // Append to mesh.
@@ -222,7 +621,8 @@ class CompiledMesh
 
     /// Optimize a compiled mesh.
     ///
-    /// Removes redundant vertices and faces.
+    /// Removes redundant vertices and faces, then merges identical vertices and orders faces and vertices for
+    /// vertex cache locality.
     void optimize()
     {
 #if defined(USE_LD)
@@ -237,8 +637,8 @@ class CompiledMesh
           if(m_faces.size() > ii + 1)
           {
             m_faces[ii] = m_faces.back();
-            m_faces.pop_back();
           }
+          m_faces.pop_back();
         }
         else
         {
@@ -250,8 +650,38 @@ class CompiledMesh
       dnload_qsort(m_faces.getData(), m_faces.size(), sizeof(Face), Face::qsort_cmp_face);
       dnload_qsort(m_edges.getData(), m_edges.size(), sizeof(Edge), Edge::qsort_cmp_edge);
       dnload_qsort(m_caps.getData(), m_caps.size(), sizeof(Cap), Cap::qsort_cmp_cap);
+
+#if defined(USE_LD)
+      g_cache_misses_before += countCacheMisses();
+#endif
+      weldVertices();
+      orderFaces();
+      orderVertices();
+#if defined(USE_LD)
+      g_cache_misses_after += countCacheMisses();
+      g_cache_faces += m_faces.size();
+#endif
     }
 
+#if defined(USE_LD)
+  public:
+    /// Static accessor.
+    ///
+    /// \return Average vertex cache miss ratio of all compiled meshes before ordering faces.
+    static float get_acmr_before()
+    {
+      return static_cast<float>(g_cache_misses_before) / static_cast<float>(std::max(g_cache_faces.load(), 1u));
+    }
+
+    /// Static accessor.
+    ///
+    /// \return Average vertex cache miss ratio of all compiled meshes after ordering faces.
+    static float get_acmr_after()
+    {
+      return static_cast<float>(g_cache_misses_after) / static_cast<float>(std::max(g_cache_faces.load(), 1u));
+    }
+#endif
+
 #if defined(USE_LD)
   public:
     /// Output to stream.
@@ -265,6 +695,12 @@ class CompiledMesh
 #endif
 };
 
+#if defined(USE_LD)
+std::atomic<unsigned> CompiledMesh::g_cache_misses_before(0);
+std::atomic<unsigned> CompiledMesh::g_cache_misses_after(0);
+std::atomic<unsigned> CompiledMesh::g_cache_faces(0);
+#endif
+
 /// Smart pointer type.
 typedef uptr<CompiledMesh> CompiledMeshUptr;
 
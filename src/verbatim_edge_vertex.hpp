@@ -48,6 +48,13 @@ class EdgeVertex
     {
       return m_position;
     }
+    /// Setter.
+    ///
+    /// \param op New position.
+    void setPosition(const vec3 &op)
+    {
+      m_position = op;
+    }
 
     /// Accessor.
     ///
@@ -97,6 +97,19 @@ class Face : public Element
       return m_index[idx];
     }
 
+    /// Remap corner indices.
+    ///
+    /// Winding is preserved.
+    ///
+    /// \param op Table of new indices, indexed by old index.
+    void remapIndices(const unsigned *op)
+    {
+      for(unsigned ii = 0; (3 > ii); ++ii)
+      {
+        m_index[ii] = op[m_index[ii]];
+      }
+    }
+
     /// Accessor.
     ///
     /// \return Normal.
@@ -0,0 +1,84 @@
+#ifndef VERBATIM_FRUSTUM_HPP
+#define VERBATIM_FRUSTUM_HPP
+
+#include "verbatim_bounding_volume.hpp"
+
+/// Frustum class.
+///
+/// Clipping planes extracted from a clip space transformation, used for culling bounding volumes.
+class Frustum
+{
+  private:
+    /// Number of clipping planes.
+    static const unsigned PLANE_COUNT = 6;
+
+  private:
+    /// Plane normals, pointing inside.
+    vec3 m_normals[PLANE_COUNT];
+
+    /// Plane distances.
+    float m_distances[PLANE_COUNT];
+
+  public:
+    /// Empty constructor.
+    Frustum() { }
+
+    /// Constructor.
+    ///
+    /// Planes are not normalized, they are only used for sidedness tests.
+    ///
+    /// \param op Clip space transformation (projection * camera).
+    explicit Frustum(const mat4 &op)
+    {
+      for(unsigned ii = 0; (3 > ii); ++ii)
+      {
+        vec3 nor(op[ii], op[4 + ii], op[8 + ii]);
+        vec3 nor_w(op[3], op[7], op[11]);
+        float dist = op[12 + ii];
+        float dist_w = op[15];
+
+        m_normals[ii * 2 + 0] = nor_w + nor;
+        m_distances[ii * 2 + 0] = dist_w + dist;
+        m_normals[ii * 2 + 1] = nor_w - nor;
+        m_distances[ii * 2 + 1] = dist_w - dist;
+      }
+    }
+
+  public:
+    /// Tell if a box is at least partially inside.
+    ///
+    /// Conservative, boxes near frustum corners may be reported visible.
+    ///
+    /// \param pmin Minimum corner.
+    /// \param pmax Maximum corner.
+    /// \return True if yes, false if no.
+    bool isVisible(const vec3 &pmin, const vec3 &pmax) const
+    {
+      for(unsigned ii = 0; (PLANE_COUNT > ii); ++ii)
+      {
+        const vec3 &nor = m_normals[ii];
+        vec3 corner((nor[0] >= 0.0f) ? pmax[0] : pmin[0],
+            (nor[1] >= 0.0f) ? pmax[1] : pmin[1],
+            (nor[2] >= 0.0f) ? pmax[2] : pmin[2]);
+
+        if(dot(nor, corner) + m_distances[ii] < 0.0f)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /// Tell if a bounding volume is at least partially inside.
+    ///
+    /// \param op Bounding volume.
+    /// \return True if yes, false if no.
+    bool isVisible(const BoundingVolume &op) const
+    {
+      vec3 pmin(op.getMinX(), op.getMinY(), op.getMinZ());
+      vec3 pmax(op.getMaxX(), op.getMaxY(), op.getMaxZ());
+      return isVisible(pmin, pmax);
+    }
+};
+
+#endif
@@ -2,25 +2,39 @@
 #define VERBATIM_GEOMETRY_BUFFER_HPP
 
 #include "verbatim_edge_buffer.hpp"
+#include "verbatim_hash_chain.hpp"
 #include "verbatim_index_buffer.hpp"
+#include "verbatim_uptr.hpp"
+
+// Forward declaration.
+class Mesh;
 
 /// Geometry buffer.
 ///
 /// Collection of other buffer data.
+///
+/// GPU buffers are only created when the geometry buffer is updated, so geometry buffers can also be used
+/// as staging areas that are later merged into another geometry buffer.
+///
+/// Compact geometry buffers upload vertices as compact vertices. Their positions are snapped to the
+/// quantization grid of each mesh when updated.
+///
+/// Indices are 16-bit. When a geometry buffer is full, data goes to the next page, another geometry buffer
+/// chained after this one. Meshes and index blocks refer to the page they were inserted into.
 class GeometryBuffer
 {
   private:
     /// Vertex buffer.
-    VertexBuffer m_vertex_buffer;
+    uptr<VertexBuffer> m_vertex_buffer;
 
     /// Index buffer.
-    IndexBuffer m_index_buffer;
+    uptr<IndexBuffer> m_index_buffer;
 
     /// Edge buffer.
-    EdgeBuffer m_edge_buffer;
+    uptr<EdgeBuffer> m_edge_buffer;
 
     /// Edge index buffer.
-    IndexBuffer m_edge_index_buffer;
+    uptr<IndexBuffer> m_edge_index_buffer;
 
     /// Vertex array.
     seq<Vertex> m_vertices;
@@ -34,21 +48,50 @@ class GeometryBuffer
     /// Edge index array.
     seq<uint16_t> m_edge_indices;
 
+    /// Meshes inserted into this geometry buffer.
+    seq<Mesh*> m_meshes;
+
+    /// Hash chain of edge vertices for finding cap corners.
+    uptr<HashChain> m_edge_vertex_chain;
+
+    /// Number of edge vertices added to the hash chain.
+    unsigned m_edge_vertex_chain_count;
+
+    /// Next page, used when this geometry buffer is full.
+    uptr<GeometryBuffer> m_next_page;
+
+    /// Are vertices uploaded as compact vertices?
+    bool m_compact;
+
   private:
     /// Find a matching edge vertex or if not found, append it.
     ///
+    /// Returns the first matching edge vertex at or after given base, as a linear search from it would. Edge
+    /// vertices of earlier meshes are not shared, since they are snapped with the scale of their own mesh.
+    ///
     /// \param pos Position
     /// \param nor Normal.
+    /// \param base First edge vertex that may be matched.
     /// \return Index of vertex found or appended.
-    unsigned appendVertex(const vec3 &pos, const ivec4 &nor)
+    unsigned appendVertex(const vec3 &pos, const ivec4 &nor, unsigned base)
     {
-      for(unsigned ii = 0, ee = m_edge_vertices.size(); (ii != ee); ++ii)
+      unsigned ret = HashChain::END;
+
+      updateEdgeVertexChain();
+
+      // Vertices were added in ascending order, so last match in the bucket is the first one.
+      for(unsigned ii = m_edge_vertex_chain->first(hash_edge_vertex(pos, nor)); (HashChain::END != ii);
+          ii = m_edge_vertex_chain->next(ii))
       {
-        if(m_edge_vertices[ii].matches(pos, nor))
+        if((base <= ii) && m_edge_vertices[ii].matches(pos, nor))
         {
-          return ii;
+          ret = ii;
         }
       }
+      if(HashChain::END != ret)
+      {
+        return ret;
+      }
 
       m_edge_vertices.emplace_back(pos, nor);
 #if defined(USE_LD)
@@ -60,6 +103,69 @@ class GeometryBuffer
       return m_edge_vertices.size() - 1;
     }
 
+    /// Add all edge vertices not yet in the hash chain to it.
+    ///
+    /// Hash chain is rebuilt with twice the capacity when it fills up.
+    void updateEdgeVertexChain()
+    {
+      unsigned count = m_edge_vertices.size();
+
+      if(!m_edge_vertex_chain || (m_edge_vertex_chain->getCapacity() <= count))
+      {
+        m_edge_vertex_chain = new HashChain((count + 1) * 2);
+        m_edge_vertex_chain_count = 0;
+      }
+
+      for(; (count > m_edge_vertex_chain_count); ++m_edge_vertex_chain_count)
+      {
+        const EdgeVertex &vv = m_edge_vertices[m_edge_vertex_chain_count];
+        m_edge_vertex_chain->add(hash_edge_vertex(vv.getPosition(), vv.getNormal()), m_edge_vertex_chain_count);
+      }
+    }
+
+    /// Get hash of edge vertex data.
+    ///
+    /// Position is quantized, so all equal positions hash the same.
+    ///
+    /// \param pos Position.
+    /// \param nor Normal.
+    /// \return Hash.
+    static unsigned hash_edge_vertex(const vec3 &pos, const ivec4 &nor)
+    {
+      unsigned ret = 0;
+
+      for(unsigned ii = 0; (3 > ii); ++ii)
+      {
+        ret = HashChain::combine(ret, static_cast<unsigned>(static_cast<int>(pos[ii] * 1024.0f)));
+      }
+      for(unsigned ii = 0; (4 > ii); ++ii)
+      {
+        ret = HashChain::combine(ret, static_cast<unsigned>(nor[ii]));
+      }
+      return ret;
+    }
+
+    /// Quantize the vertices of every mesh.
+    ///
+    /// Positions of vertices and edge vertices are snapped to the grid of their mesh.
+    ///
+    /// \param dst Destination array for compact vertices.
+    void compactVertices(seq<CompactVertex> &dst);
+
+  public:
+    /// Constructor.
+    ///
+    /// \param compact True to upload vertices as compact vertices.
+    explicit GeometryBuffer(bool compact = false) :
+      m_edge_vertex_chain_count(0),
+      m_compact(compact) { }
+
+  private:
+    /// Deleted copy constructor.
+    GeometryBuffer(const GeometryBuffer&) = delete;
+    /// Deleted assignment.
+    GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
   public:
     /// Add cap.
     ///
@@ -71,11 +177,12 @@ class GeometryBuffer
     /// \param v2 Second vertex.
     /// \param v3 Third vertex.
     /// \param nor Normal.
-    void addCap(const vec3 &v1, const vec3 &v2, const vec3 &v3, const ivec4 &nor)
+    /// \param base First edge vertex of the mesh being inserted.
+    void addCap(const vec3 &v1, const vec3 &v2, const vec3 &v3, const ivec4 &nor, unsigned base)
     {
-      unsigned c1 = appendVertex(v1, nor);
-      unsigned c2 = appendVertex(v2, nor);
-      unsigned c3 = appendVertex(v3, nor);
+      unsigned c1 = appendVertex(v1, nor, base);
+      unsigned c2 = appendVertex(v2, nor, base);
+      unsigned c3 = appendVertex(v3, nor, base);
 #if defined(USE_LD)
       if((0xFFFFU < c1) || (0xFFFFU < c2) || (0xFFFFU < c3))
       {
@@ -113,6 +220,22 @@ class GeometryBuffer
       m_edge_indices.push_back(static_cast<uint16_t>(edge_base + 3));
     }
 
+    /// Add edge index to this geometry buffer.
+    ///
+    /// \param op Edge index to add.
+    void addEdgeIndex(uint16_t op)
+    {
+      m_edge_indices.push_back(op);
+    }
+
+    /// Add edge vertex to this geometry buffer.
+    ///
+    /// \param op Edge vertex to add.
+    void addEdgeVertex(const EdgeVertex &op)
+    {
+      m_edge_vertices.push_back(op);
+    }
+
     /// Add face to this geometry buffer.
     ///
     /// \param op Index to add.
@@ -127,6 +250,16 @@ class GeometryBuffer
       m_indices.push_back(op);
     }
 
+    /// Add mesh to this geometry buffer.
+    ///
+    /// Meshes are relocated if this geometry buffer is merged into another. They must exist until then.
+    ///
+    /// \param op Mesh that has been inserted into this geometry buffer.
+    void addMesh(Mesh &op)
+    {
+      m_meshes.push_back(&op);
+    }
+
     /// Add vertex to this geometry buffer.
     ///
     /// \param op Vertex to add.
@@ -145,7 +278,7 @@ class GeometryBuffer
     ///
     /// \param op Number of offered vertices.
     /// \return True if fits, false if not.
-    bool fitsVertices(unsigned op)
+    bool fitsVertices(unsigned op) const
     {
       return (0xFFFFU >= (m_vertices.size() + op));
     }
@@ -153,11 +286,58 @@ class GeometryBuffer
     /// Tell if amount of edge vertices fits in this geometry buffer.
     ///
     /// \param Number of offered edges.
-    bool fitsEdgeVertices(unsigned op)
+    bool fitsEdgeVertices(unsigned op) const
     {
       return (0xFFFFU >= (m_edge_vertices.size() + op));
     }
 
+    /// Get page to insert data into.
+    ///
+    /// Returns the first page that fits given data, or an empty page if none do. Pages are created as
+    /// necessary.
+    ///
+    /// \param vertex_count Number of vertices to insert.
+    /// \param edge_vertex_count Number of edge vertices to insert.
+    /// \return This geometry buffer or one of the following pages.
+    GeometryBuffer& getPage(unsigned vertex_count, unsigned edge_vertex_count)
+    {
+      if((fitsVertices(vertex_count) && fitsEdgeVertices(edge_vertex_count)) ||
+          (m_vertices.empty() && m_edge_vertices.empty()))
+      {
+        return *this;
+      }
+      if(!m_next_page)
+      {
+        m_next_page = new GeometryBuffer(m_compact);
+      }
+      return m_next_page->getPage(vertex_count, edge_vertex_count);
+    }
+
+    /// Accessor.
+    ///
+    /// \param idx Index to access.
+    /// \return Edge index at given index.
+    unsigned getEdgeIndex(unsigned idx) const
+    {
+      return static_cast<unsigned>(m_edge_indices[idx]);
+    }
+
+    /// Accessor.
+    ///
+    /// \param idx Index to access.
+    /// \return Edge vertex at given index.
+    const EdgeVertex& getEdgeVertex(unsigned idx) const
+    {
+      return m_edge_vertices[idx];
+    }
+    /// Accessor.
+    ///
+    /// \return Edge vertex count.
+    unsigned getEdgeVertexCount() const
+    {
+      return m_edge_vertices.size();
+    }
+
     /// Accessor.
     ///
     /// \return Edge index count.
@@ -166,6 +346,14 @@ class GeometryBuffer
       return m_edge_indices.size();
     }
 
+    /// Accessor.
+    ///
+    /// \return Vertex buffer name or 0 if not yet updated.
+    GLuint getId() const
+    {
+      return m_vertex_buffer ? m_vertex_buffer->getId() : 0;
+    }
+
     /// Accessor.
     ///
     /// \param idx Index to access.
@@ -182,6 +370,30 @@ class GeometryBuffer
       return m_indices.size();
     }
 
+    /// Accessor.
+    ///
+    /// \param idx Index to access.
+    /// \return Mesh at given index.
+    const Mesh& getMesh(unsigned idx) const
+    {
+      return *(m_meshes[idx]);
+    }
+    /// Accessor.
+    ///
+    /// \return Mesh count.
+    unsigned getMeshCount() const
+    {
+      return m_meshes.size();
+    }
+
+    /// Accessor.
+    ///
+    /// \return Next page or NULL.
+    const GeometryBuffer* getNextPage() const
+    {
+      return m_next_page.get();
+    }
+
     /// Accessor.
     ///
     /// \param idx Index to access.
@@ -198,13 +410,51 @@ class GeometryBuffer
       return m_vertices.size();
     }
 
+    /// Merge another geometry buffer into this.
+    ///
+    /// Appends all data from given geometry buffer and relocates all meshes inserted into it to refer to
+    /// this geometry buffer instead. Given geometry buffer is left empty. Pages of given geometry buffer are
+    /// merged one at a time into the first page they fit.
+    ///
+    /// \param op Geometry buffer to merge.
+    void merge(GeometryBuffer &op);
+
+  private:
+    /// Append one page of another geometry buffer into this.
+    ///
+    /// \param op Geometry buffer page to append.
+    void append(GeometryBuffer &op);
+
+  public:
     /// Update this geometry buffer into the GPU.
     void update()
     {
-      m_vertex_buffer.update(m_vertices);
-      m_index_buffer.update(m_indices);
-      m_edge_buffer.update(m_edge_vertices);
-      m_edge_index_buffer.update(m_edge_indices);
+      if(!m_vertex_buffer)
+      {
+        m_vertex_buffer = new VertexBuffer(m_compact);
+        m_index_buffer = new IndexBuffer();
+        m_edge_buffer = new EdgeBuffer();
+        m_edge_index_buffer = new IndexBuffer();
+      }
+
+      if(m_compact)
+      {
+        seq<CompactVertex> compact_vertices;
+        compactVertices(compact_vertices);
+        m_vertex_buffer->update(compact_vertices);
+      }
+      else
+      {
+        m_vertex_buffer->update(m_vertices);
+      }
+      m_index_buffer->update(m_indices);
+      m_edge_buffer->update(m_edge_vertices);
+      m_edge_index_buffer->update(m_edge_indices);
+
+      if(m_next_page)
+      {
+        m_next_page->update();
+      }
     }
 
     /// Use this geometry buffer for rendering indexed geometry.
@@ -212,8 +462,8 @@ class GeometryBuffer
     /// \param op Program to use.
     void useGeometry(const Program &op) const
     {
-      m_vertex_buffer.use(op);
-      m_index_buffer.bind();
+      m_vertex_buffer->use(op);
+      m_index_buffer->bind();
     }
 
     /// Use this geometry buffer for rendering shadow volume data.
@@ -221,8 +471,8 @@ class GeometryBuffer
     /// \param op Program to use.
     void useShadow(const Program &op) const
     {
-      m_edge_buffer.use(op);
-      m_edge_index_buffer.bind();
+      m_edge_buffer->use(op);
+      m_edge_index_buffer->bind();
     }
 
     /// Unbind vertex buffer.
@@ -240,7 +490,19 @@ class GeometryBuffer
     /// \return Output stream.
     std::ostream& put(std::ostream &ostr) const
     {
-      return ostr << "[" << m_vertex_buffer << ", " << m_index_buffer << ", " << m_edge_buffer << "]";
+      if(!m_vertex_buffer)
+      {
+        ostr << "[" << m_vertices.size() << ", " << m_indices.size() << ", " << m_edge_vertices.size() << "]";
+      }
+      else
+      {
+        ostr << "[" << *m_vertex_buffer << ", " << *m_index_buffer << ", " << *m_edge_buffer << "]";
+      }
+      if(m_next_page)
+      {
+        ostr << " -> " << *m_next_page;
+      }
+      return ostr;
     }
 
     /// Stream output operator.
@@ -0,0 +1,452 @@
+#ifndef VERBATIM_GEOMETRY_CACHE_HPP
+#define VERBATIM_GEOMETRY_CACHE_HPP
+
+#include "verbatim_mesh.hpp"
+#include "verbatim_object_database.hpp"
+
+#include <map>
+
+/// Geometry cache.
+///
+/// Developer aid for skipping generation of static geometry. Stores geometry buffers with the meshes inserted
+/// into them, object databases referring to those meshes and other generator output as byte arrays in a binary
+/// file. Data is written and read in the same order, so meshes are identified by the order they were written
+/// in.
+///
+/// Cache file is only valid for the build that wrote it. It is identified by a format version and a key
+/// computed by the user from the generator inputs. Objects in cached object databases may not have textures.
+class GeometryCache
+{
+  private:
+    /// Identifier at start of file.
+    static const uint32_t MAGIC = 0x43475656u;
+
+    /// File format version, increment when the layout changes.
+    static const uint32_t VERSION = 2;
+
+  private:
+    /// Data after the header.
+    seq<uint8_t> m_data;
+
+    /// Read position.
+    unsigned m_position;
+
+    /// Has cache been loaded from a file?
+    bool m_loaded;
+
+    /// Meshes read from the cache, owned by the cache.
+    seq<Mesh*> m_meshes;
+
+    /// Identifiers (mesh, block) of index blocks written into the cache.
+    std::map<const IndexBlock*, std::pair<unsigned, unsigned> > m_block_ids;
+
+    /// Number of meshes written into the cache.
+    unsigned m_mesh_count;
+
+  private:
+    /// Deleted copy constructor.
+    GeometryCache(const GeometryCache&) = delete;
+    /// Deleted assignment.
+    GeometryCache& operator=(const GeometryCache&) = delete;
+
+  public:
+    /// Constructor.
+    GeometryCache() :
+      m_position(0),
+      m_loaded(false),
+      m_mesh_count(0) { }
+
+    /// Destructor.
+    ~GeometryCache()
+    {
+      for(Mesh *vv : m_meshes)
+      {
+        delete vv;
+      }
+    }
+
+  private:
+    /// Read raw data.
+    ///
+    /// \param size Size of data in bytes.
+    /// \return Pointer to data.
+    const void* read(unsigned size)
+    {
+      if(m_data.size() < m_position + size)
+      {
+        std::ostringstream sstr;
+        sstr << "geometry cache truncated at " << m_position << " reading " << size << " bytes";
+        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+      }
+      const void *ret = m_data.getData() + m_position;
+      // Keep all data aligned to 4 bytes.
+      m_position += (size + 3) & ~3u;
+      return ret;
+    }
+
+    /// Read a value.
+    ///
+    /// \return Value read.
+    uint32_t readValue()
+    {
+      return *static_cast<const uint32_t*>(read(sizeof(uint32_t)));
+    }
+
+    /// Write raw data.
+    ///
+    /// \param data Data to write.
+    /// \param size Size of data in bytes.
+    void write(const void *data, unsigned size)
+    {
+      const uint8_t *iter = static_cast<const uint8_t*>(data);
+
+      for(unsigned ii = 0; (size > ii); ++ii)
+      {
+        m_data.push_back(iter[ii]);
+      }
+      // Keep all data aligned to 4 bytes.
+      for(unsigned ii = size; (ii & 3u); ++ii)
+      {
+        m_data.push_back(0);
+      }
+    }
+
+    /// Write a value.
+    ///
+    /// \param op Value to write.
+    void writeValue(uint32_t op)
+    {
+      write(&op, sizeof(op));
+    }
+
+    /// Read an index run.
+    ///
+    /// \return Index run read.
+    IndexRun readIndexRun()
+    {
+      unsigned base = readValue();
+      unsigned count = readValue();
+      unsigned count_full = readValue();
+      return IndexRun(base, count, count_full);
+    }
+
+    /// Write an index run.
+    ///
+    /// \param op Index run to write.
+    void writeIndexRun(const IndexRun &op)
+    {
+      writeValue(op.getBase());
+      writeValue(op.getCount());
+      writeValue(op.getCountFull());
+    }
+
+    /// Read one geometry buffer page.
+    ///
+    /// \param dst Geometry buffer page to read into, must be empty.
+    void readPage(GeometryBuffer &dst)
+    {
+      unsigned vertex_count = readValue();
+      const Vertex *vertices = static_cast<const Vertex*>(read(vertex_count * sizeof(Vertex)));
+      for(unsigned ii = 0; (vertex_count > ii); ++ii)
+      {
+        dst.addVertex(vertices[ii]);
+      }
+
+      unsigned index_count = readValue();
+      const uint16_t *indices = static_cast<const uint16_t*>(read(index_count * sizeof(uint16_t)));
+      for(unsigned ii = 0; (index_count > ii); ++ii)
+      {
+        dst.addIndex(indices[ii]);
+      }
+
+      unsigned edge_vertex_count = readValue();
+      const EdgeVertex *edge_vertices =
+        static_cast<const EdgeVertex*>(read(edge_vertex_count * sizeof(EdgeVertex)));
+      for(unsigned ii = 0; (edge_vertex_count > ii); ++ii)
+      {
+        dst.addEdgeVertex(edge_vertices[ii]);
+      }
+
+      unsigned edge_index_count = readValue();
+      const uint16_t *edge_indices = static_cast<const uint16_t*>(read(edge_index_count * sizeof(uint16_t)));
+      for(unsigned ii = 0; (edge_index_count > ii); ++ii)
+      {
+        dst.addEdgeIndex(edge_indices[ii]);
+      }
+
+      for(unsigned ii = 0, ee = readValue(); (ee > ii); ++ii)
+      {
+        unsigned vertex_base = readValue();
+        unsigned edge_vertex_base = readValue();
+        Mesh *msh = new Mesh(dst, vertex_base, edge_vertex_base);
+
+        m_meshes.push_back(msh);
+        dst.addMesh(*msh);
+
+        for(unsigned jj = 0, kk = readValue(); (kk > jj); ++jj)
+        {
+          IndexRun faces = readIndexRun();
+          IndexRun edges = readIndexRun();
+          IndexRun caps = readIndexRun();
+          msh->addIndexBlock(faces, edges, caps);
+        }
+      }
+    }
+
+    /// Write one geometry buffer page.
+    ///
+    /// \param op Geometry buffer page to write.
+    void writePage(const GeometryBuffer &op)
+    {
+      writeValue(op.getVertexCount());
+      for(unsigned ii = 0, ee = op.getVertexCount(); (ee > ii); ++ii)
+      {
+        write(&op.getVertex(ii), sizeof(Vertex));
+      }
+
+      seq<uint16_t> indices;
+      for(unsigned ii = 0, ee = op.getIndexCount(); (ee > ii); ++ii)
+      {
+        indices.push_back(static_cast<uint16_t>(op.getIndex(ii)));
+      }
+      writeValue(indices.size());
+      write(indices.getData(), indices.getSizeBytes());
+
+      writeValue(op.getEdgeVertexCount());
+      for(unsigned ii = 0, ee = op.getEdgeVertexCount(); (ee > ii); ++ii)
+      {
+        write(&op.getEdgeVertex(ii), sizeof(EdgeVertex));
+      }
+
+      seq<uint16_t> edge_indices;
+      for(unsigned ii = 0, ee = op.getEdgeIndexCount(); (ee > ii); ++ii)
+      {
+        edge_indices.push_back(static_cast<uint16_t>(op.getEdgeIndex(ii)));
+      }
+      writeValue(edge_indices.size());
+      write(edge_indices.getData(), edge_indices.getSizeBytes());
+
+      writeValue(op.getMeshCount());
+      for(unsigned ii = 0, ee = op.getMeshCount(); (ee > ii); ++ii)
+      {
+        const Mesh &msh = op.getMesh(ii);
+
+        writeValue(msh.getVertexBase());
+        writeValue(msh.getEdgeVertexBase());
+        writeValue(msh.getBlockCount());
+        for(unsigned jj = 0, kk = msh.getBlockCount(); (kk > jj); ++jj)
+        {
+          const IndexBlock &blk = msh.getBlock(jj);
+
+          writeIndexRun(blk.getFaces());
+          writeIndexRun(blk.getEdges());
+          writeIndexRun(blk.getCaps());
+          m_block_ids[&blk] = std::make_pair(m_mesh_count, jj);
+        }
+        ++m_mesh_count;
+      }
+    }
+
+  public:
+    /// Accessor.
+    ///
+    /// \return True if cache was loaded from a file and can be read from.
+    bool isLoaded() const
+    {
+      return m_loaded;
+    }
+
+    /// Load cache from a file.
+    ///
+    /// \param filename File to load.
+    /// \param key Key computed from generator inputs.
+    /// \return True if cache was loaded, false if file does not exist or is stale.
+    bool load(const std::string &filename, uint32_t key)
+    {
+      FILE *fd = fopen(filename.c_str(), "rb");
+      if(!fd)
+      {
+        return false;
+      }
+
+      uint32_t header[3];
+      if((3 != fread(header, sizeof(uint32_t), 3, fd)) || (MAGIC != header[0]) || (VERSION != header[1]) ||
+          (key != header[2]))
+      {
+        fclose(fd);
+        std::cout << "|geometry cache '" << filename << "' is stale\n";
+        return false;
+      }
+
+      uint8_t block[4096];
+      for(;;)
+      {
+        size_t bytes_read = fread(block, 1, sizeof(block), fd);
+        for(size_t ii = 0; (bytes_read > ii); ++ii)
+        {
+          m_data.push_back(block[ii]);
+        }
+        if(sizeof(block) > bytes_read)
+        {
+          break;
+        }
+      }
+      fclose(fd);
+
+      m_position = 0;
+      m_loaded = true;
+      return true;
+    }
+
+    /// Save cache into a file.
+    ///
+    /// \param filename File to save.
+    /// \param key Key computed from generator inputs.
+    void save(const std::string &filename, uint32_t key) const
+    {
+      FILE *fd = fopen(filename.c_str(), "wb");
+      if(!fd)
+      {
+        std::ostringstream sstr;
+        sstr << "could not open '" << filename << "' for writing";
+        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+      }
+
+      const uint32_t header[3] = { MAGIC, VERSION, key };
+      fwrite(header, sizeof(uint32_t), 3, fd);
+      fwrite(m_data.getData(), 1, m_data.size(), fd);
+      fclose(fd);
+
+      std::cout << "|geometry cache '" << filename << "': " << m_data.size() << " bytes\n";
+    }
+
+    /// Read a geometry buffer.
+    ///
+    /// Pages are merged into given geometry buffer in order. Meshes read are owned by the cache.
+    ///
+    /// \param dst Geometry buffer to read into.
+    void readGeometry(GeometryBuffer &dst)
+    {
+      for(unsigned ii = 0, ee = readValue(); (ee > ii); ++ii)
+      {
+        GeometryBuffer page;
+        readPage(page);
+        dst.merge(page);
+      }
+    }
+
+    /// Write a geometry buffer.
+    ///
+    /// Meshes written can then be referred to by objects in written object databases.
+    ///
+    /// \param op Geometry buffer to write.
+    void writeGeometry(const GeometryBuffer &op)
+    {
+      unsigned page_count = 0;
+      for(const GeometryBuffer *iter = &op; iter; iter = iter->getNextPage())
+      {
+        ++page_count;
+      }
+
+      writeValue(page_count);
+      for(const GeometryBuffer *iter = &op; iter; iter = iter->getNextPage())
+      {
+        writePage(*iter);
+      }
+    }
+
+    /// Read a byte array.
+    ///
+    /// \param dst Array to read into.
+    void readData(seq<uint8_t> &dst)
+    {
+      unsigned size = readValue();
+      const uint8_t *data = static_cast<const uint8_t*>(read(size));
+
+      dst.resize(size);
+      for(unsigned ii = 0; (size > ii); ++ii)
+      {
+        dst[ii] = data[ii];
+      }
+    }
+
+    /// Write a byte array.
+    ///
+    /// \param op Array to write.
+    void writeData(const seq<uint8_t> &op)
+    {
+      writeValue(op.size());
+      write(op.getData(), op.size());
+    }
+
+    /// Read an object database.
+    ///
+    /// \param dst Object database to read into.
+    void readDatabase(ObjectDatabase &dst)
+    {
+      seq<ObjectGroup*> groups;
+      for(unsigned ii = 0, ee = readValue(); (ee > ii); ++ii)
+      {
+        groups.push_back(dst.addGroup(readValue()));
+      }
+
+      for(unsigned ii = 0, ee = readValue(); (ee > ii); ++ii)
+      {
+        unsigned mesh_idx = readValue();
+        unsigned block_idx = readValue();
+        unsigned group_idx = readValue();
+        const mat4 &transform = *static_cast<const mat4*>(read(sizeof(mat4)));
+
+        if(m_meshes.size() <= mesh_idx)
+        {
+          std::ostringstream sstr;
+          sstr << "cached object refers to mesh " << mesh_idx << " out of " << m_meshes.size();
+          BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+        }
+        dst.addObject(m_meshes[mesh_idx]->getBlock(block_idx), transform,
+            (groups.size() > group_idx) ? groups[group_idx] : NULL);
+      }
+    }
+
+    /// Write an object database.
+    ///
+    /// All objects must refer to meshes in geometry buffers written earlier.
+    ///
+    /// \param op Object database to write.
+    void writeDatabase(const ObjectDatabase &op)
+    {
+      std::map<const ObjectGroup*, unsigned> group_ids;
+
+      writeValue(op.getGroupCount());
+      for(unsigned ii = 0, ee = op.getGroupCount(); (ee > ii); ++ii)
+      {
+        const ObjectGroup *grp = op.getGroup(ii);
+        writeValue(grp->getCount());
+        group_ids[grp] = ii;
+      }
+
+      writeValue(op.getObjectCount());
+      for(unsigned ii = 0, ee = op.getObjectCount(); (ee > ii); ++ii)
+      {
+        const Object &obj = op.getObject(ii);
+        std::map<const IndexBlock*, std::pair<unsigned, unsigned> >::const_iterator block_iter =
+          m_block_ids.find(&obj.getBlock());
+
+        if((m_block_ids.end() == block_iter) || obj.getTexture())
+        {
+          std::ostringstream sstr;
+          sstr << "object " << ii << " can not be cached";
+          BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+        }
+
+        std::map<const ObjectGroup*, unsigned>::const_iterator group_iter = group_ids.find(obj.getGroup());
+
+        writeValue(block_iter->second.first);
+        writeValue(block_iter->second.second);
+        writeValue((group_ids.end() != group_iter) ? group_iter->second : 0xFFFFFFFFu);
+        write(&obj.getTransform(), sizeof(mat4));
+      }
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef VERBATIM_HASH_CHAIN_HPP
+#define VERBATIM_HASH_CHAIN_HPP
+
+#include "verbatim_seq.hpp"
+
+/// Hash chain.
+///
+/// Buckets element indices by a hash computed by the user. Only indices are stored, the user compares the
+/// actual elements when walking a bucket. Bucket count is fixed on construction.
+class HashChain
+{
+  public:
+    /// Index marking end of chain.
+    static const unsigned END = 0xFFFFFFFFu;
+
+  private:
+    /// First element index of every bucket.
+    seq<unsigned> m_buckets;
+
+    /// Next element index for every element.
+    seq<unsigned> m_next;
+
+    /// Mask for bucket index.
+    unsigned m_mask;
+
+  private:
+    /// Deleted copy constructor.
+    HashChain(const HashChain&) = delete;
+    /// Deleted assignment.
+    HashChain& operator=(const HashChain&) = delete;
+
+  public:
+    /// Constructor.
+    ///
+    /// \param count Number of elements, indices must be smaller than this.
+    explicit HashChain(unsigned count)
+    {
+      unsigned bucket_count = 16;
+
+      while(bucket_count < count * 2)
+      {
+        bucket_count *= 2;
+      }
+      m_mask = bucket_count - 1;
+
+      m_next.resize(count);
+
+      m_buckets.resize(bucket_count);
+      for(unsigned &vv : m_buckets)
+      {
+        vv = END;
+      }
+    }
+
+  private:
+    /// Get bucket for a hash.
+    ///
+    /// \param hash Hash.
+    /// \return Bucket index.
+    unsigned getBucket(unsigned hash) const
+    {
+      return (hash ^ (hash >> 16)) & m_mask;
+    }
+
+  public:
+    /// Add an element.
+    ///
+    /// Elements in one bucket are walked in reverse order of adding.
+    ///
+    /// \param hash Hash of the element.
+    /// \param idx Element index.
+    void add(unsigned hash, unsigned idx)
+    {
+      unsigned &bucket = m_buckets[getBucket(hash)];
+
+#if defined(USE_LD)
+      if(m_next.size() <= idx)
+      {
+        std::ostringstream sstr;
+        sstr << "element index " << idx << " out of range (" << m_next.size() << ")";
+        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+      }
+#endif
+      m_next[idx] = bucket;
+      bucket = idx;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Number of elements that fit.
+    unsigned getCapacity() const
+    {
+      return m_next.size();
+    }
+
+    /// Get first element in a bucket.
+    ///
+    /// \param hash Hash to look for.
+    /// \return First element index or END.
+    unsigned first(unsigned hash) const
+    {
+      return m_buckets[getBucket(hash)];
+    }
+
+    /// Get next element in the same bucket.
+    ///
+    /// \param idx Current element index.
+    /// \return Next element index or END.
+    unsigned next(unsigned idx) const
+    {
+      return m_next[idx];
+    }
+
+  public:
+    /// Combine a value into a hash.
+    ///
+    /// \param hash Existing hash.
+    /// \param op Value to combine.
+    /// \return New hash.
+    static unsigned combine(unsigned hash, unsigned op)
+    {
+      return (hash ^ op) * 16777619u;
+    }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define VERBATIM_IMAGE_HPP
 
 #include "verbatim_gl.hpp"
+#include "verbatim_random.hpp"
 #include "verbatim_vec2.hpp"
 
 /// Base image class.
@@ -326,15 +327,16 @@ class Image
 
     /// Fill image with noise.
     ///
+    /// \param rnd Random number generator.
     /// \param nfloor Noise floor.
     /// \param nceil Noise ceiling.
-    void noise(float nfloor = 0.0f, float nceil = 1.0f)
+    void noise(Random &rnd, float nfloor = 0.0f, float nceil = 1.0f)
     {
       unsigned element_count = getWidth() * getHeight() * getChannelCount();
 
       for(unsigned ii = 0; (element_count > ii); ++ii)
       {
-        m_data[ii] = frand(nfloor, nceil);
+        m_data[ii] = rnd.frand(nfloor, nceil);
       }
     }
 
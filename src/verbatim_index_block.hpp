@@ -8,7 +8,7 @@ class IndexBlock
 {
   private:
     /// Referred geometry buffer.
-    const GeometryBuffer &m_buffer;
+    const GeometryBuffer *m_buffer;
 
     /// Face indices.
     IndexRun m_faces;
@@ -19,20 +19,45 @@ class IndexBlock
     /// Cap indices.
     IndexRun m_caps;
 
+    /// Scale of vertex positions, 1 unless vertices are compact.
+    float m_position_scale;
+
+    /// Minimum corner of vertex positions in object space.
+    vec3 m_bounds_min;
+
+    /// Maximum corner of vertex positions in object space.
+    vec3 m_bounds_max;
+
   public:
     /// Constructor.
     ///
+    /// Indices and vertices referred by face index run must already be in the buffer.
+    ///
     /// \param buffer Buffer reference.
-    /// \param vertex_base Vertex base offset.
     /// \param faces Index run for geometry.
     /// \param edges Index run for shadow extrusion.
     /// \param caps Index run for shadow caps.
     IndexBlock(const GeometryBuffer &buffer, const IndexRun &faces, const IndexRun &edges,
         const IndexRun &caps) :
-      m_buffer(buffer),
+      m_buffer(&buffer),
       m_faces(faces),
       m_edges(edges),
-      m_caps(caps) { }
+      m_caps(caps),
+      m_position_scale(1.0f),
+      m_bounds_min(FLT_MAX, FLT_MAX, FLT_MAX),
+      m_bounds_max(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+    {
+      for(unsigned ii = 0, ee = getIndexCount(); (ii != ee); ++ii)
+      {
+        const vec3 &pos = getVertex(getIndex(ii)).getPosition();
+
+        for(unsigned jj = 0; (3 > jj); ++jj)
+        {
+          m_bounds_min[jj] = std::min(m_bounds_min[jj], pos[jj]);
+          m_bounds_max[jj] = std::max(m_bounds_max[jj], pos[jj]);
+        }
+      }
+    }
 
   public:
     /// Draw indexed geometry.
@@ -40,17 +65,36 @@ class IndexBlock
     /// \param op Program to use for drawing.
     void drawGeometry(const Program &op, bool full = false) const
     {
-      m_buffer.useGeometry(op);
+      useGeometry(op);
 
+      drawFaces(full);
+    }
+
+    /// Draw faces only.
+    ///
+    /// Geometry must be in use.
+    ///
+    /// \param full Draw all faces or just real ones?
+    void drawFaces(bool full) const
+    {
       m_faces.drawTriangles(full);
     }
 
+    /// Use the geometry of this index block for drawing faces.
+    ///
+    /// \param op Program to use for drawing.
+    void useGeometry(const Program &op) const
+    {
+      m_buffer->useGeometry(op);
+      op.uniform('Z', m_position_scale);
+    }
+
     /// Draw shadow volume extruded data.
     ///
     /// \param op Program to use for drawing.
     void drawShadowEdges(const Program &op, bool full = false) const
     {
-      m_buffer.useShadow(op);
+      m_buffer->useShadow(op);
 
       m_edges.drawTriangles(full);
     }
@@ -60,18 +104,87 @@ class IndexBlock
     /// \param op Program to use for drawing.
     void drawShadowCaps(const Program &op, bool full = false) const
     {
-      m_buffer.useShadow(op);
+      m_buffer->useShadow(op);
 
       m_caps.drawTriangles(full);
     }
 
+    /// Move this index block into another geometry buffer.
+    ///
+    /// \param buffer New geometry buffer.
+    /// \param index_offset Offset of face indices in new geometry buffer.
+    /// \param edge_index_offset Offset of edge indices in new geometry buffer.
+    void relocate(const GeometryBuffer &buffer, unsigned index_offset, unsigned edge_index_offset)
+    {
+      m_buffer = &buffer;
+      m_faces.relocate(index_offset);
+      m_edges.relocate(edge_index_offset);
+      m_caps.relocate(edge_index_offset);
+    }
+
+    /// Setter.
+    ///
+    /// \param op New position scale.
+    void setPositionScale(float op)
+    {
+      m_position_scale = op;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Minimum corner of vertex positions.
+    const vec3& getBoundsMin() const
+    {
+      return m_bounds_min;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Maximum corner of vertex positions.
+    const vec3& getBoundsMax() const
+    {
+      return m_bounds_max;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Geometry buffer.
+    const GeometryBuffer& getBuffer() const
+    {
+      return *m_buffer;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Cap index run.
+    const IndexRun& getCaps() const
+    {
+      return m_caps;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Edge index run.
+    const IndexRun& getEdges() const
+    {
+      return m_edges;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Face index run.
+    const IndexRun& getFaces() const
+    {
+      return m_faces;
+    }
+
     /// Accessor.
     ///
     /// \param idx Index to access.
     /// \return Given index.
     unsigned getIndex(unsigned idx) const
     {
-      return m_buffer.getIndex(m_faces.getBase() + idx);
+      return m_buffer->getIndex(m_faces.getBase() + idx);
     }
     /// Accessor.
     ///
@@ -94,7 +207,7 @@ class IndexBlock
     /// \return Vertex at index.
     const Vertex& getVertex(unsigned idx) const
     {
-      return m_buffer.getVertex(idx);
+      return m_buffer->getVertex(idx);
     }
 };
 
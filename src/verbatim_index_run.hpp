@@ -37,6 +37,14 @@ class IndexRun
           static_cast<uint16_t*>(NULL) + m_base);
     }
 
+    /// Move this index run.
+    ///
+    /// \param op Offset to add to index base.
+    void relocate(unsigned op)
+    {
+      m_base += op;
+    }
+
     /// Accessor.
     ///
     /// \return Index base.
@@ -52,6 +60,13 @@ class IndexRun
     {
       return static_cast<unsigned>(m_count);
     }
+    /// Accessor.
+    ///
+    /// \return Count of all (also non-real) indices.
+    unsigned getCountFull() const
+    {
+      return static_cast<unsigned>(m_count_full);
+    }
 
 #if defined(USE_LD)
     /// Output to stream.
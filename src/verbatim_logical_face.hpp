@@ -5,6 +5,8 @@
 #include "verbatim_vec2.hpp"
 #include "verbatim_vec3.hpp"
 
+#include <atomic>
+
 /// Logical face class.
 ///
 /// Up to quads supported.
@@ -12,7 +14,7 @@ class LogicalFace : public Element
 {
 #if defined(USE_LD)
   private:
-    static unsigned g_degenerate_count;
+    static std::atomic<unsigned> g_degenerate_count;
 #endif
 
   private:
@@ -290,6 +292,17 @@ class LogicalFace : public Element
       return verify();
     }
 
+    /// Remap all vertex indices.
+    ///
+    /// \param op Table of new vertex indices, indexed by old vertex index.
+    void remapVertexIndices(const unsigned *op)
+    {
+      for(unsigned ii = 0; (m_num_corners > ii); ++ii)
+      {
+        m_indices[ii] = op[m_indices[ii]];
+      }
+    }
+
     /// Try to repair any inconsistencies in the face.
     ///
     /// \return True if the face is appropriate.
@@ -381,7 +394,7 @@ inline std::ostream& operator<<(std::ostream &lhs, const LogicalFace &rhs)
 #endif
 
 #if defined(USE_LD)
-unsigned LogicalFace::g_degenerate_count = 0;
+std::atomic<unsigned> LogicalFace::g_degenerate_count(0);
 #endif
 
 #endif
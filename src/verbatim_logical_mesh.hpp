@@ -2,8 +2,12 @@
 #define VERBATIM_LOGICAL_MESH_HPP
 
 #include "verbatim_compiled_mesh.hpp"
+#include "verbatim_hash_chain.hpp"
 #include "verbatim_logical_edge.hpp"
 #include "verbatim_logical_vertex.hpp"
+#include "verbatim_random.hpp"
+
+#include <atomic>
 
 /// Logical mesh.
 ///
@@ -13,10 +17,10 @@ class LogicalMesh
 #if defined(USE_LD)
   private:
     /// Number of discarded edges.
-    static unsigned g_discarded_edges;
+    static std::atomic<unsigned> g_discarded_edges;
 
     /// Number of discarded faces.
-    static unsigned g_discarded_faces;
+    static std::atomic<unsigned> g_discarded_faces;
 #endif
 
   private:
@@ -86,59 +90,123 @@ class LogicalMesh
       m_edges.emplace_back(c1, c2, lt, rt, block_id, exists);
     }
 
-    /// Add all edges between two faces.
+    /// Tell if an edge should be generated between two faces.
     ///
-    /// \param lt Left face index.
-    /// \param rt Right face index.
-    void addEdges(unsigned lt, unsigned rt)
+    /// \param ll Left face.
+    /// \param rr Right face.
+    /// \return True if faces may cast a shadow edge, false if not.
+    static bool is_shadow_edge(const LogicalFace &ll, const LogicalFace &rr)
     {
-      const LogicalFace &ll = m_faces[lt];
-      const LogicalFace &rr = m_faces[rt];
-
       if(!ll.hasShadow() || !rr.hasShadow() || (ll.getBlockId() != rr.getBlockId()))
       {
-        return;
+        return false;
       }
       ivec4 lnor(ll.getNormal());
       ivec4 rnor(rr.getNormal());
       if(sqr_error(lnor, rnor) < 3)
       {
 #if defined(USE_LD) && 0
-        std::cout << "not adding edge between same-facing faces: " << lt << ", " << rt << std::endl;
+        std::cout << "not adding edge between same-facing faces" << std::endl;
 #endif
-        return;
+        return false;
       }
+      return true;
+    }
 
-      unsigned c1 = ll.getIndex(0);
-      unsigned c2 = ll.getIndex(1);
-      unsigned c3 = ll.getIndex(2);
+    /// Get hash of a directed edge.
+    ///
+    /// \param c1 First corner.
+    /// \param c2 Second corner.
+    /// \return Hash.
+    static unsigned hash_edge(unsigned c1, unsigned c2)
+    {
+      return HashChain::combine(HashChain::combine(0, c1), c2);
+    }
 
-      if(rr.hasEdge(c2, c1))
-      {
-        addEdge(c1, c2, lt, rt);
-      }
-      if(rr.hasEdge(c3, c2))
+    /// Add all edges between faces.
+    ///
+    /// Directed face edges are hashed, the edge of a left face matches a right face with the same edge in
+    /// reverse direction. Edges are added in the same order as checking every face against every later
+    /// face would.
+    void addEdges()
+    {
+      unsigned face_count = m_faces.size();
+      seq<unsigned> corner_base(face_count);
+      seq<unsigned> corner_face;
+      seq<unsigned> found;
+
+      for(unsigned ii = 0; (face_count > ii); ++ii)
       {
-        addEdge(c2, c3, lt, rt);
+        corner_base.push_back(corner_face.size());
+        for(unsigned jj = 0, ee = m_faces[ii].getIndexCount(); (ee > jj); ++jj)
+        {
+          corner_face.push_back(ii);
+        }
       }
-      if(ll.isQuad())
+
+      HashChain chain(corner_face.size());
+      for(unsigned ii = 0; (face_count > ii); ++ii)
       {
-        unsigned c4 = ll.getIndex(3);
+        const LogicalFace &vv = m_faces[ii];
 
-        if(rr.hasEdge(c4, c3))
+        if(!vv.hasShadow())
         {
-          addEdge(c3, c4, lt, rt);
+          continue;
         }
-        if(rr.hasEdge(c1, c4))
+        for(unsigned jj = 0, ee = vv.getIndexCount(); (ee > jj); ++jj)
         {
-          addEdge(c4, c1, lt, rt);
+          unsigned c1 = vv.getIndex(jj);
+          unsigned c2 = vv.getIndex((jj + 1) % ee);
+
+          chain.add(hash_edge(c1, c2), corner_base[ii] + jj);
         }
       }
-      else
+
+      for(unsigned ii = 0; (face_count > ii); ++ii)
       {
-        if(rr.hasEdge(c1, c3))
+        const LogicalFace &ll = m_faces[ii];
+
+        if(!ll.hasShadow())
         {
-          addEdge(c3, c1, lt, rt);
+          continue;
+        }
+
+        // Collect (right face, corner) pairs in order.
+        found.clear();
+        for(unsigned jj = 0, ee = ll.getIndexCount(); (ee > jj); ++jj)
+        {
+          unsigned c1 = ll.getIndex(jj);
+          unsigned c2 = ll.getIndex((jj + 1) % ee);
+
+          for(unsigned kk = chain.first(hash_edge(c2, c1)); (HashChain::END != kk); kk = chain.next(kk))
+          {
+            unsigned rt = corner_face[kk];
+            const LogicalFace &rr = m_faces[rt];
+            unsigned corner = kk - corner_base[rt];
+
+            if((ii >= rt) || (rr.getIndex(corner) != c2) ||
+                (rr.getIndex((corner + 1) % rr.getIndexCount()) != c1) || !is_shadow_edge(ll, rr))
+            {
+              continue;
+            }
+
+            unsigned key = rt * 4 + jj;
+            unsigned pos = found.size();
+            found.push_back(key);
+            for(; (0 < pos) && (found[pos - 1] > key); --pos)
+            {
+              found[pos] = found[pos - 1];
+            }
+            found[pos] = key;
+          }
+        }
+
+        for(unsigned vv : found)
+        {
+          unsigned rt = vv / 4;
+          unsigned jj = vv % 4;
+
+          addEdge(ll.getIndex(jj), ll.getIndex((jj + 1) % ll.getIndexCount()), ii, rt);
         }
       }
     }
@@ -323,8 +391,9 @@ class LogicalMesh
     /// Results in a compiled mesh that can be inserted into a vertex buffer.
     ///
     /// \param flatten_seed Random seed for flattening texcoords, 0 to not flatten.
+    /// \param rnd Random number generator, required if flattening.
     /// \return Compiled mesh.
-    CompiledMeshUptr compile(bool flatten_seed = 0)
+    CompiledMeshUptr compile(bool flatten_seed = 0, Random *rnd = NULL)
     {
       // Perform pre-compilation tasks before doing anything else.
       compilePre();
@@ -348,13 +417,7 @@ class LogicalMesh
       }
 
       // Calculate edges when all face normals already calculated.
-      for(unsigned ii = 0, ee = m_faces.size(); (ee > ii); ++ii)
-      {
-        for(unsigned jj = ii + 1; (ee > jj); ++jj)
-        {
-          addEdges(ii, jj);
-        }
-      }
+      addEdges();
 
       for(LogicalVertex &vv : m_vertices)
       {
@@ -362,7 +425,7 @@ class LogicalMesh
       }
 
       // Compilation tasks done, perform post-compilation tasks.
-      compilePost(flatten_seed);
+      compilePost(flatten_seed, rnd);
 
       CompiledMeshUptr ret(new CompiledMesh(m_block_id + 1));
 
@@ -402,10 +465,17 @@ class LogicalMesh
     /// Prepare mesh for export - pre-compilation.
     ///
     /// \param flatten_seed Random seed for flattening texcoords, 0 to not flatten.
-    void compilePost(unsigned flatten_seed)
+    /// \param rnd Random number generator, required if flattening.
+    void compilePost(unsigned flatten_seed, Random *rnd)
     {
       if(0 != flatten_seed)
       {
+#if defined(USE_LD)
+        if(!rnd)
+        {
+          BOOST_THROW_EXCEPTION(std::runtime_error("flattening texcoords requires a random number generator"));
+        }
+#endif
         for(unsigned ii = 0; (m_faces.size() > ii); ++ii)
         {
           LogicalFace &vv = m_faces[ii];
@@ -415,10 +485,10 @@ class LogicalMesh
           unsigned sdbm_hash = static_cast<unsigned>(nn[0] + 128);
           sdbm_hash += static_cast<unsigned>(nn[1] + 128) + (sdbm_hash * 65599);
           sdbm_hash += static_cast<unsigned>(nn[2] + 128) + (sdbm_hash * 65599);
-          bsd_srand(sdbm_hash + flatten_seed);
+          rnd->srand(sdbm_hash + flatten_seed);
 
-          vec2 offset(frand(-1.0f, 1.0f), frand(-1.0f, 1.0f));
-          vec2 direction(frand(-1.0f, 1.0f), frand(-1.0f, 1.0f));
+          vec2 offset(rnd->frand(-1.0f, 1.0f), rnd->frand(-1.0f, 1.0f));
+          vec2 direction(rnd->frand(-1.0f, 1.0f), rnd->frand(-1.0f, 1.0f));
 
           vv.setTexcoord(offset, normalize(direction));
         }
@@ -448,57 +518,239 @@ class LogicalMesh
       }
 
       // Merge vertices that have identical location.
+      //
+      // Gives the same result as comparing every vertex against all vertices after it and swap-removing the
+      // matches in order, but candidates are looked up from a spatial hash and only faces referring to a
+      // merged vertex are touched. Faces refer to original vertex indices until the end.
+      unsigned vertex_count = m_vertices.size();
+      unsigned face_count = m_faces.size();
+      HashChain grid(vertex_count);
+      seq<unsigned> vertex_at(vertex_count);
+      seq<unsigned> vertex_pos(vertex_count);
+      seq<unsigned> face_at(face_count);
+      seq<unsigned> face_pos(face_count);
+      seq<unsigned> face_stamp(face_count);
+      seq<unsigned> ref_first(vertex_count);
+      seq<unsigned> ref_last(vertex_count);
+      seq<unsigned> ref_face(face_count * 4);
+      seq<unsigned> ref_next(face_count * 4);
+      seq<unsigned> matched;
+      seq<unsigned> removed;
+      unsigned stamp = 0;
+
+      for(unsigned ii = 0; (vertex_count > ii); ++ii)
+      {
+        int cell[3];
+
+        get_weld_cell(m_vertices[ii].getPosition(), cell);
+        grid.add(hash_weld_cell(cell), ii);
+        vertex_at.push_back(ii);
+        vertex_pos.push_back(ii);
+        ref_first.push_back(HashChain::END);
+        ref_last.push_back(HashChain::END);
+      }
+      for(unsigned ii = 0; (face_count > ii); ++ii)
+      {
+        const LogicalFace &vv = m_faces[ii];
+
+        face_at.push_back(ii);
+        face_pos.push_back(ii);
+        face_stamp.push_back(stamp);
+
+        for(unsigned jj = 0, ee = vv.getIndexCount(); (ee > jj); ++jj)
+        {
+          unsigned idx = vv.getIndex(jj);
+          unsigned node = ref_face.size();
+
+          ref_face.push_back(ii);
+          ref_next.push_back(HashChain::END);
+          if(HashChain::END == ref_first[idx])
+          {
+            ref_first[idx] = node;
+          }
+          else
+          {
+            ref_next[ref_last[idx]] = node;
+          }
+          ref_last[idx] = node;
+        }
+      }
+
       for(unsigned ii = 0; (m_vertices.size() > ii + 1); ++ii)
       {
-        LogicalVertex &vv = m_vertices[ii];
+        const LogicalVertex &vv = m_vertices[ii];
+        unsigned vertex_id = vertex_at[ii];
+        int cell[3];
 
-        for(unsigned jj = ii + 1; (m_vertices.size() > jj);)
+        get_weld_cell(vv.getPosition(), cell);
+
+        for(int dx = -1; (1 >= dx); ++dx)
         {
-          if(vv.matches(m_vertices[jj]))
+          for(int dy = -1; (1 >= dy); ++dy)
           {
+            for(int dz = -1; (1 >= dz); ++dz)
+            {
+              int neighbor[3] = { cell[0] + dx, cell[1] + dy, cell[2] + dz };
+
+              for(unsigned jj = grid.first(hash_weld_cell(neighbor)); (HashChain::END != jj); jj = grid.next(jj))
+              {
+                unsigned pos = vertex_pos[jj];
+                int other[3];
+
+                if((HashChain::END == pos) || (ii >= pos))
+                {
+                  continue;
+                }
+                // Hash collision may put a vertex into the bucket of another cell.
+                get_weld_cell(m_vertices[pos].getPosition(), other);
+                if((other[0] != neighbor[0]) || (other[1] != neighbor[1]) || (other[2] != neighbor[2]))
+                {
+                  continue;
+                }
+                if(vv.matches(m_vertices[pos]))
+                {
+                  matched.push_back(pos);
+                }
+              }
+            }
+          }
+        }
+
+        while(!matched.empty())
+        {
+          unsigned last = m_vertices.size() - 1;
+          unsigned pos = take_swap_remove(matched, last);
+          unsigned merged_id = vertex_at[pos];
+
 #if 0
-            std::cout << "merging vertices " << ii << " and " << jj << ": " << vv.getPosition() << ", " <<
-              m_vertices[jj].getPosition() << std::endl;
+          std::cout << "merging vertices " << ii << " and " << pos << ": " << vv.getPosition() << ", " <<
+            m_vertices[pos].getPosition() << std::endl;
 #endif
-            replaceVertexIndex(jj, ii);
-            if(m_vertices.size() > jj + 1)
+
+          // Replace merged vertex in all faces referring to it, move the references over.
+          ++stamp;
+          for(unsigned jj = ref_first[merged_id]; (HashChain::END != jj); jj = ref_next[jj])
+          {
+            unsigned face_id = ref_face[jj];
+            unsigned slot = face_pos[face_id];
+
+            if((HashChain::END == slot) || (stamp == face_stamp[face_id]))
             {
-              m_vertices[jj] = m_vertices.back();
-              replaceVertexIndex(m_vertices.size() - 1, jj);
+              continue;
+            }
+            face_stamp[face_id] = stamp;
+
+            if(!m_faces[slot].replaceVertexIndex(merged_id, vertex_id))
+            {
+              removed.push_back(slot);
             }
-            m_vertices.pop_back();
           }
-          else
+          if(HashChain::END != ref_first[merged_id])
+          {
+            if(HashChain::END == ref_first[vertex_id])
+            {
+              ref_first[vertex_id] = ref_first[merged_id];
+            }
+            else
+            {
+              ref_next[ref_last[vertex_id]] = ref_first[merged_id];
+            }
+            ref_last[vertex_id] = ref_last[merged_id];
+          }
+
+          while(!removed.empty())
           {
-            ++jj;
+            unsigned last_face = m_faces.size() - 1;
+            unsigned slot = take_swap_remove(removed, last_face);
+
+            face_pos[face_at[slot]] = HashChain::END;
+            if(slot != last_face)
+            {
+              m_faces[slot] = m_faces.back();
+              face_at[slot] = face_at[last_face];
+              face_pos[face_at[slot]] = slot;
+            }
+            m_faces.pop_back();
           }
+
+          vertex_pos[merged_id] = HashChain::END;
+          if(pos != last)
+          {
+            m_vertices[pos] = m_vertices.back();
+            vertex_at[pos] = vertex_at[last];
+            vertex_pos[vertex_at[pos]] = pos;
+          }
+          m_vertices.pop_back();
         }
       }
+
+      for(LogicalFace &vv : m_faces)
+      {
+        vv.remapVertexIndices(vertex_pos.getData());
+      }
     }
 
-    /// Replace face indices.
+    /// Get vertex welding cell of a position.
     ///
-    /// \param src Source face index.
-    /// \param dst Destination face index.
-    void replaceVertexIndex(unsigned src, unsigned dst)
+    /// Cells are twice the merge distance in size so vertices close enough to merge are always in the same
+    /// or adjacent cells, even with rounding.
+    ///
+    /// \param pos Position.
+    /// \param cell Cell coordinates output.
+    static void get_weld_cell(const vec3 &pos, int *cell)
     {
-      for(unsigned ii = 0; (m_faces.size() > ii);)
+      const float CELL_SCALE = 0.5f / LogicalVertex::MAX_POSITION_ERROR;
+
+      for(unsigned ii = 0; (3 > ii); ++ii)
       {
-        LogicalFace &vv = m_faces[ii];
+        cell[ii] = static_cast<int>(pos[ii] * CELL_SCALE);
+      }
+    }
+
+    /// Get hash of a vertex welding cell.
+    ///
+    /// \param cell Cell coordinates.
+    /// \return Hash.
+    static unsigned hash_weld_cell(const int *cell)
+    {
+      unsigned ret = HashChain::combine(0, static_cast<unsigned>(cell[0]));
+      ret = HashChain::combine(ret, static_cast<unsigned>(cell[1]));
+      return HashChain::combine(ret, static_cast<unsigned>(cell[2]));
+    }
+
+    /// Take next position to remove in a swap-removing scan.
+    ///
+    /// Scanning upwards and moving the last element into every removed position visits removed positions in
+    /// ascending order. An element moved from the end is checked again in its new position.
+    ///
+    /// \param pending Positions still to remove, modified.
+    /// \param last Position of the last element.
+    /// \return Position to remove.
+    static unsigned take_swap_remove(seq<unsigned> &pending, unsigned last)
+    {
+      unsigned min_idx = 0;
 
-        if(!vv.replaceVertexIndex(src, dst))
+      for(unsigned ii = 1; (pending.size() > ii); ++ii)
+      {
+        if(pending[ii] < pending[min_idx])
         {
-          if(m_faces.size() > ii + 1)
-          {
-            m_faces[ii] = m_faces.back();
-          }
-          m_faces.pop_back();
+          min_idx = ii;
         }
-        else
+      }
+
+      unsigned ret = pending[min_idx];
+      pending[min_idx] = pending.back();
+      pending.pop_back();
+
+      // Last element is moved into the removed position.
+      for(unsigned &vv : pending)
+      {
+        if(last == vv)
         {
-          ++ii;
+          vv = ret;
         }
       }
+      return ret;
     }
 
     /// Update normal of one face (owned by this mesh).
@@ -845,11 +1097,30 @@ class LogicalMesh
     ///
     /// Compiles a mesh and inserts it into a vertex buffer.
     ///
-    /// \param bufferp Target vertex buffer.
+    /// \param buffer Target vertex buffer.
+    MeshUptr insert(GeometryBuffer &buffer)
+    {
+      return insert(buffer, compile());
+    }
+    /// Insert into a vertex buffer.
+    ///
+    /// Compiles a mesh with flattened texture coordinates and inserts it into a vertex buffer.
+    ///
+    /// \param buffer Target vertex buffer.
+    /// \param rnd Random number generator.
     /// \param flatten_seed Random seed used in flattening the texture coordinates.
-    MeshUptr insert(GeometryBuffer &buffer, unsigned flatten_seed = 0)
+    MeshUptr insert(GeometryBuffer &buffer, Random &rnd, unsigned flatten_seed)
+    {
+      return insert(buffer, compile(flatten_seed, &rnd));
+    }
+
+  private:
+    /// Insert a compiled mesh into a vertex buffer.
+    ///
+    /// \param buffer Target vertex buffer.
+    /// \param msh Compiled mesh.
+    MeshUptr insert(GeometryBuffer &buffer, const CompiledMeshUptr &msh)
     {
-      CompiledMeshUptr msh = compile(flatten_seed);
       MeshUptr ret = msh->insert(buffer);
 
 #if defined(USE_LD)
@@ -863,6 +1134,7 @@ class LogicalMesh
       return ret;
     }
 
+  public:
     /// Accessor.
     ///
     /// \return Paint color.
@@ -957,8 +1229,8 @@ class LogicalMesh
 };
 
 #if defined(USE_LD)
-unsigned LogicalMesh::g_discarded_edges = 0;
-unsigned LogicalMesh::g_discarded_faces = 0;
+std::atomic<unsigned> LogicalMesh::g_discarded_edges(0);
+std::atomic<unsigned> LogicalMesh::g_discarded_faces(0);
 #endif
 
 #if defined(USE_LD)
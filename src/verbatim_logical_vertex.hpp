@@ -3,6 +3,8 @@
 
 #include "verbatim_logical_face.hpp"
 
+#include <atomic>
+
 /// Logical vertex class.
 ///
 /// Only limited number of faces can attach to a vertex.
@@ -18,13 +20,13 @@ class LogicalVertex
 #if defined(USE_LD)
   private:
     /// Minimum error encountered.
-    static float g_min_position_error;
+    static std::atomic<float> g_min_position_error;
 
     /// Minimum error encountered.
-    static float g_max_merge_error;
+    static std::atomic<float> g_max_merge_error;
 
     /// Number of vertices merged.
-    static unsigned g_merge_count;
+    static std::atomic<unsigned> g_merge_count;
 #endif
 
   private:
@@ -192,19 +194,15 @@ class LogicalVertex
       if(MAX_POSITION_ERROR >= error)
       {
 #if defined(USE_LD)
-        if(g_max_merge_error < error)
-        {
-          g_max_merge_error = error;
-        }
+        float prev = g_max_merge_error.load();
+        while((prev < error) && !g_max_merge_error.compare_exchange_weak(prev, error)) { }
         ++g_merge_count;
 #endif
         return true;
       }
 #if defined(USE_LD)
-      if(g_min_position_error > error)
-      {
-        g_min_position_error = error;
-      }
+      float prev = g_min_position_error.load();
+      while((prev > error) && !g_min_position_error.compare_exchange_weak(prev, error)) { }
 #endif
       return false;
     }
@@ -239,9 +237,9 @@ class LogicalVertex
 
 const float LogicalVertex::MAX_POSITION_ERROR = 0.01f;
 #if defined(USE_LD)
-float LogicalVertex::g_max_merge_error = 0.0f;
-float LogicalVertex::g_min_position_error = FLT_MAX;
-unsigned LogicalVertex::g_merge_count = 0;
+std::atomic<float> LogicalVertex::g_max_merge_error(0.0f);
+std::atomic<float> LogicalVertex::g_min_position_error(FLT_MAX);
+std::atomic<unsigned> LogicalVertex::g_merge_count(0);
 #endif
 
 #endif
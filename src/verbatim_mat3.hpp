@@ -2,6 +2,7 @@
 #define VERBATIM_MAT3_HPP
 
 #include "verbatim_quat.hpp"
+#include "verbatim_simd.hpp"
 #include "verbatim_vec3.hpp"
 
 /// If set to 1, rotation uses mathematically correct OpenGL right-hand-side orientation.
@@ -165,6 +166,31 @@ class mat3
       float x = op[1] / mag;
       float y = op[2] / mag;
       float z = op[3] / mag;
+#if defined(VERBATIM_SIMD_SSE) || defined(VERBATIM_SIMD_NEON)
+      // Eight of the nine products in two vector multiplies.
+      float w2 = 2.0f * w;
+      float x2 = 2.0f * x;
+      float y2 = 2.0f * y;
+      float products[8];
+#if defined(VERBATIM_SIMD_SSE)
+      _mm_storeu_ps(products + 0, _mm_mul_ps(_mm_setr_ps(w2, w2, w2, x2), _mm_setr_ps(x, y, z, x)));
+      _mm_storeu_ps(products + 4, _mm_mul_ps(_mm_setr_ps(x2, x2, y2, y2), _mm_setr_ps(y, z, y, z)));
+#else
+      const float lhs[8] = { w2, w2, w2, x2, x2, x2, y2, y2 };
+      const float rhs[8] = { x, y, z, x, y, z, y, z };
+      vst1q_f32(products + 0, vmulq_f32(vld1q_f32(lhs + 0), vld1q_f32(rhs + 0)));
+      vst1q_f32(products + 4, vmulq_f32(vld1q_f32(lhs + 4), vld1q_f32(rhs + 4)));
+#endif
+      float wx2 = products[0];
+      float wy2 = products[1];
+      float wz2 = products[2];
+      float xx2 = products[3];
+      float xy2 = products[4];
+      float xz2 = products[5];
+      float yy2 = products[6];
+      float yz2 = products[7];
+      float zz2 = 2.0f * z * z;
+#else
       float wx2 = 2.0f * w * x;
       float wy2 = 2.0f * w * y;
       float wz2 = 2.0f * w * z;
@@ -174,6 +200,7 @@ class mat3
       float xx2 = 2.0f * x * x;
       float yy2 = 2.0f * y * y;
       float zz2 = 2.0f * z * z;
+#endif
 
       // Using unit quaternion to matrix algo by J.M.P. van Wavaren at Id Software:
       // http://fabiensanglard.net/doom3_documentation/37726-293748.pdf
@@ -274,6 +274,35 @@ class mat4
     {
       mat4 ret;
 
+#if defined(VERBATIM_SIMD_SSE)
+      __m128 c0 = _mm_loadu_ps(m_data + 0);
+      __m128 c1 = _mm_loadu_ps(m_data + 4);
+      __m128 c2 = _mm_loadu_ps(m_data + 8);
+      __m128 c3 = _mm_loadu_ps(m_data + 12);
+
+      for(unsigned ii = 0; (ii < 16); ii += 4)
+      {
+        __m128 col = _mm_mul_ps(c0, _mm_set1_ps(rhs[ii + 0]));
+        col = _mm_add_ps(col, _mm_mul_ps(c1, _mm_set1_ps(rhs[ii + 1])));
+        col = _mm_add_ps(col, _mm_mul_ps(c2, _mm_set1_ps(rhs[ii + 2])));
+        col = _mm_add_ps(col, _mm_mul_ps(c3, _mm_set1_ps(rhs[ii + 3])));
+        _mm_storeu_ps(ret.m_data + ii, col);
+      }
+#elif defined(VERBATIM_SIMD_NEON)
+      float32x4_t c0 = vld1q_f32(m_data + 0);
+      float32x4_t c1 = vld1q_f32(m_data + 4);
+      float32x4_t c2 = vld1q_f32(m_data + 8);
+      float32x4_t c3 = vld1q_f32(m_data + 12);
+
+      for(unsigned ii = 0; (ii < 16); ii += 4)
+      {
+        float32x4_t col = vmulq_n_f32(c0, rhs[ii + 0]);
+        col = vaddq_f32(col, vmulq_n_f32(c1, rhs[ii + 1]));
+        col = vaddq_f32(col, vmulq_n_f32(c2, rhs[ii + 2]));
+        col = vaddq_f32(col, vmulq_n_f32(c3, rhs[ii + 3]));
+        vst1q_f32(ret.m_data + ii, col);
+      }
+#else
       for(unsigned ii = 0; (ii < 16); ii += 4)
       { 
         for(unsigned jj = 0; (jj < 4); ++jj)
@@ -284,11 +313,77 @@ class mat4
             m_data[12 + jj] * rhs[ii + 3];
         }
       }
+#endif
 
       return ret;
     }
 
   public:
+    /// Multiply matrices stored as structure of arrays.
+    ///
+    /// Component ii of matrix jj is stored at ii * stride + jj. Gives the same results as multiplying each
+    /// matrix separately.
+    ///
+    /// \param rhs Right-hand-side matrices.
+    /// \param dst Destination matrices.
+    /// \param stride Number of matrices, must be a multiple of four.
+    void multiplySoa(const float *rhs, float *dst, unsigned stride) const
+    {
+      for(unsigned jj = 0; (jj < stride); jj += 4)
+      {
+        for(unsigned ii = 0; (ii < 16); ii += 4)
+        {
+          const float *r0 = rhs + (ii + 0) * stride + jj;
+          const float *r1 = rhs + (ii + 1) * stride + jj;
+          const float *r2 = rhs + (ii + 2) * stride + jj;
+          const float *r3 = rhs + (ii + 3) * stride + jj;
+
+#if defined(VERBATIM_SIMD_SSE)
+          __m128 w0 = _mm_loadu_ps(r0);
+          __m128 w1 = _mm_loadu_ps(r1);
+          __m128 w2 = _mm_loadu_ps(r2);
+          __m128 w3 = _mm_loadu_ps(r3);
+
+          for(unsigned kk = 0; (kk < 4); ++kk)
+          {
+            __m128 row = _mm_mul_ps(_mm_set1_ps(m_data[0 + kk]), w0);
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m_data[4 + kk]), w1));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m_data[8 + kk]), w2));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m_data[12 + kk]), w3));
+            _mm_storeu_ps(dst + (ii + kk) * stride + jj, row);
+          }
+#elif defined(VERBATIM_SIMD_NEON)
+          float32x4_t w0 = vld1q_f32(r0);
+          float32x4_t w1 = vld1q_f32(r1);
+          float32x4_t w2 = vld1q_f32(r2);
+          float32x4_t w3 = vld1q_f32(r3);
+
+          for(unsigned kk = 0; (kk < 4); ++kk)
+          {
+            float32x4_t row = vmulq_n_f32(w0, m_data[0 + kk]);
+            row = vaddq_f32(row, vmulq_n_f32(w1, m_data[4 + kk]));
+            row = vaddq_f32(row, vmulq_n_f32(w2, m_data[8 + kk]));
+            row = vaddq_f32(row, vmulq_n_f32(w3, m_data[12 + kk]));
+            vst1q_f32(dst + (ii + kk) * stride + jj, row);
+          }
+#else
+          for(unsigned kk = 0; (kk < 4); ++kk)
+          {
+            float *row = dst + (ii + kk) * stride + jj;
+
+            for(unsigned ll = 0; (ll < 4); ++ll)
+            {
+              row[ll] = m_data[0 + kk] * r0[ll] +
+                m_data[4 + kk] * r1[ll] +
+                m_data[8 + kk] * r2[ll] +
+                m_data[12 + kk] * r3[ll];
+            }
+          }
+#endif
+        }
+      }
+    }
+
     /// Scale the 3x3 part of matrix directly.
     ///
     /// \param sx X scale.
@@ -10,18 +10,30 @@ class Mesh
 {
   private:
     /// Geomery buffer this object has been baked into.
-    const GeometryBuffer &m_buffer;
+    const GeometryBuffer *m_buffer;
 
     /// Index collections.
     seq<IndexBlock> m_blocks;
 
+    /// Offset of first vertex in geometry buffer.
+    unsigned m_vertex_base;
+
+    /// Offset of first edge vertex in geometry buffer.
+    unsigned m_edge_vertex_base;
+
   public:
     /// Constructor.
     ///
+    /// Vertices of the mesh run from given offsets until the offsets of the next mesh inserted into the
+    /// same geometry buffer.
+    ///
     /// \param geometry_buffer Vertex buffer bound to.
-    /// \param vertex_count Vertex count.
-    Mesh(const GeometryBuffer &geometry_buffer) :
-      m_buffer(geometry_buffer) { }
+    /// \param vertex_base Offset of first vertex in geometry buffer.
+    /// \param edge_vertex_base Offset of first edge vertex in geometry buffer.
+    Mesh(const GeometryBuffer &geometry_buffer, unsigned vertex_base, unsigned edge_vertex_base) :
+      m_buffer(&geometry_buffer),
+      m_vertex_base(vertex_base),
+      m_edge_vertex_base(edge_vertex_base) { }
 
     /// Destructor.
     ~Mesh() { }
@@ -33,7 +45,53 @@ class Mesh
     /// \param Edges Edges.
     void addIndexBlock(const IndexRun &faces, const IndexRun &edges, const IndexRun &caps)
     {
-      m_blocks.emplace_back(m_buffer, faces, edges, caps);
+      m_blocks.emplace_back(*m_buffer, faces, edges, caps);
+    }
+
+    /// Move this mesh into another geometry buffer.
+    ///
+    /// \param buffer New geometry buffer.
+    /// \param vertex_offset Offset of vertices in new geometry buffer.
+    /// \param index_offset Offset of face indices in new geometry buffer.
+    /// \param edge_vertex_offset Offset of edge vertices in new geometry buffer.
+    /// \param edge_index_offset Offset of edge indices in new geometry buffer.
+    void relocate(const GeometryBuffer &buffer, unsigned vertex_offset, unsigned index_offset,
+        unsigned edge_vertex_offset, unsigned edge_index_offset)
+    {
+      m_buffer = &buffer;
+      m_vertex_base += vertex_offset;
+      m_edge_vertex_base += edge_vertex_offset;
+      for(IndexBlock &vv : m_blocks)
+      {
+        vv.relocate(buffer, index_offset, edge_index_offset);
+      }
+    }
+
+    /// Set scale of vertex positions for all index blocks.
+    ///
+    /// \param op New position scale.
+    void setPositionScale(float op)
+    {
+      for(IndexBlock &vv : m_blocks)
+      {
+        vv.setPositionScale(op);
+      }
+    }
+
+    /// Accessor.
+    ///
+    /// \return Offset of first edge vertex in geometry buffer.
+    unsigned getEdgeVertexBase() const
+    {
+      return m_edge_vertex_base;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Offset of first vertex in geometry buffer.
+    unsigned getVertexBase() const
+    {
+      return m_vertex_base;
     }
 
     /// Accessor.
@@ -56,4 +114,141 @@ class Mesh
 /// Smart pointer type.
 typedef uptr<Mesh> MeshUptr;
 
+void GeometryBuffer::merge(GeometryBuffer &op)
+{
+  getPage(op.m_vertices.size(), op.m_edge_vertices.size()).append(op);
+
+  if(op.m_next_page)
+  {
+    merge(*op.m_next_page);
+    op.m_next_page.reset();
+  }
+}
+
+void GeometryBuffer::append(GeometryBuffer &op)
+{
+  unsigned vertex_base = m_vertices.size();
+  unsigned index_base = m_indices.size();
+  unsigned edge_vertex_base = m_edge_vertices.size();
+  unsigned edge_index_base = m_edge_indices.size();
+
+#if defined(USE_LD)
+  if(!fitsVertices(op.m_vertices.size()) || !fitsEdgeVertices(op.m_edge_vertices.size()))
+  {
+    std::ostringstream sstr;
+    sstr << "merging " << op.m_vertices.size() << " vertices and " << op.m_edge_vertices.size() <<
+      " edge vertices into geometry buffer of " << vertex_base << " vertices and " << edge_vertex_base <<
+      " edge vertices";
+    BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+  }
+#endif
+
+  for(const Vertex &vv : op.m_vertices)
+  {
+    m_vertices.push_back(vv);
+  }
+  for(uint16_t vv : op.m_indices)
+  {
+    m_indices.push_back(static_cast<uint16_t>(vv + vertex_base));
+  }
+  for(const EdgeVertex &vv : op.m_edge_vertices)
+  {
+    m_edge_vertices.push_back(vv);
+  }
+  for(uint16_t vv : op.m_edge_indices)
+  {
+    m_edge_indices.push_back(static_cast<uint16_t>(vv + edge_vertex_base));
+  }
+
+  for(Mesh *vv : op.m_meshes)
+  {
+    vv->relocate(*this, vertex_base, index_base, edge_vertex_base, edge_index_base);
+    m_meshes.push_back(vv);
+  }
+
+  op.m_vertices.clear();
+  op.m_indices.clear();
+  op.m_edge_vertices.clear();
+  op.m_edge_indices.clear();
+  op.m_meshes.clear();
+  op.m_edge_vertex_chain.reset();
+  op.m_edge_vertex_chain_count = 0;
+}
+
+void GeometryBuffer::compactVertices(seq<CompactVertex> &dst)
+{
+  for(unsigned ii = 0; (m_meshes.size() > ii); ++ii)
+  {
+    Mesh &msh = *(m_meshes[ii]);
+    bool last = (m_meshes.size() <= ii + 1);
+    unsigned vertex_end = last ? m_vertices.size() : m_meshes[ii + 1]->getVertexBase();
+    unsigned edge_vertex_end = last ? m_edge_vertices.size() : m_meshes[ii + 1]->getEdgeVertexBase();
+    float extent = 0.0f;
+
+#if defined(USE_LD)
+    if(dst.size() != msh.getVertexBase())
+    {
+      std::ostringstream sstr;
+      sstr << "mesh vertices start at " << msh.getVertexBase() << " instead of " << dst.size();
+      BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+    }
+    // Edge vertices are snapped per mesh, edges and caps may not refer to those of another mesh.
+    for(unsigned jj = 0; (msh.getBlockCount() > jj); ++jj)
+    {
+      const IndexBlock &blk = msh.getBlock(jj);
+      unsigned edge_index_begin = blk.getEdges().getBase();
+      unsigned edge_index_end = blk.getCaps().getBase() + blk.getCaps().getCountFull();
+
+      for(unsigned kk = edge_index_begin; (edge_index_end > kk); ++kk)
+      {
+        unsigned idx = m_edge_indices[kk];
+
+        if((msh.getEdgeVertexBase() > idx) || (edge_vertex_end <= idx))
+        {
+          std::ostringstream sstr;
+          sstr << "edge index " << idx << " outside of mesh edge vertices [" << msh.getEdgeVertexBase() <<
+            ", " << edge_vertex_end << "[";
+          BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+        }
+      }
+    }
+#endif
+
+    for(unsigned jj = msh.getVertexBase(); (vertex_end > jj); ++jj)
+    {
+      const vec3 &pos = m_vertices[jj].getPosition();
+      extent = std::max(extent, std::max(std::max(pos[0], -pos[0]), std::max(std::max(pos[1], -pos[1]),
+              std::max(pos[2], -pos[2]))));
+    }
+    float scale = CompactVertex::get_position_scale(extent);
+
+    // Edge vertices lie on the mesh surface, snapping them keeps shadow volumes closed against the geometry.
+    for(unsigned jj = msh.getVertexBase(); (vertex_end > jj); ++jj)
+    {
+      Vertex &vv = m_vertices[jj];
+      vv.setPosition(CompactVertex::snap_position(vv.getPosition(), scale));
+      dst.emplace_back(vv, scale);
+    }
+    for(unsigned jj = msh.getEdgeVertexBase(); (edge_vertex_end > jj); ++jj)
+    {
+      EdgeVertex &vv = m_edge_vertices[jj];
+      vv.setPosition(CompactVertex::snap_position(vv.getPosition(), scale));
+    }
+    msh.setPositionScale(scale);
+  }
+
+#if defined(USE_LD)
+  if(dst.size() != m_vertices.size())
+  {
+    std::ostringstream sstr;
+    sstr << "compacted " << dst.size() << " vertices out of " << m_vertices.size();
+    BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+  }
+#endif
+
+  // Snapped edge vertices no longer match their hashes.
+  m_edge_vertex_chain.reset();
+  m_edge_vertex_chain_count = 0;
+}
+
 #endif
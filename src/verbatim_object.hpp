@@ -61,17 +61,47 @@ class Object
       return m_bounding_volume.conflictsXZ(op);
     }
 
+    /// Tell if this object has an animated transform.
+    ///
+    /// Bounding volume of an animated object is only valid for the first frame.
+    ///
+    /// \return True if yes, false if no.
+    bool isAnimated() const
+    {
+      return (0.0f == m_transform[15]);
+    }
+
     /// Draw geometry of this object.
     ///
     /// \param prg Program to use.
     /// \param optimistic Can we be render in an optimistic manner?
     void drawGeometry(const Program &prg, bool optimistic) const
+    {
+      useGeometry(prg);
+
+      drawFaces(optimistic);
+    }
+
+    /// Draw faces of this object only.
+    ///
+    /// Geometry of this object must be in use.
+    ///
+    /// \param optimistic Can we be render in an optimistic manner?
+    void drawFaces(bool optimistic) const
+    {
+      m_block->drawFaces(!optimistic);
+    }
+
+    /// Use the geometry and texture of this object for drawing.
+    ///
+    /// \param prg Program to use.
+    void useGeometry(const Program &prg) const
     {
       if(m_texture)
       {
         m_texture->bind(0);
       }
-      m_block->drawGeometry(prg, !optimistic);
+      m_block->useGeometry(prg);
     }
 
     /// Draw shadow edges of this object.
@@ -92,6 +122,14 @@ class Object
       m_block->drawShadowCaps(prg, !optimistic);
     }
 
+    /// Accessor.
+    ///
+    /// \return Index block.
+    const IndexBlock& getBlock() const
+    {
+      return *m_block;
+    }
+
     /// Access bounding volume.
     ///
     /// \return Bounding volume reference.
@@ -126,6 +164,18 @@ class Object
       return m_group;
     }
 
+    /// Get draw state key.
+    ///
+    /// Objects with the same key use the same geometry buffer and texture.
+    ///
+    /// \return Key combining geometry buffer and texture names.
+    unsigned getStateKey() const
+    {
+      unsigned texture_id = m_texture ? m_texture->getId() : 0;
+
+      return (static_cast<unsigned>(m_block->getBuffer().getId()) << 16) | texture_id;
+    }
+
     /// Accessor.
     ///
     /// \return Texture.
@@ -2,6 +2,7 @@
 #define VERBATIM_OBJECT_DATABASE_HPP
 
 #include "verbatim_object_group.hpp"
+#include "verbatim_object_hierarchy.hpp"
 
 /// Object database.
 ///
@@ -15,6 +16,9 @@ class ObjectDatabase
     /// Complete meshes.
     seq<ObjectGroup*> m_groups;
 
+    /// Bounding volume hierarchy, empty unless built.
+    ObjectHierarchy m_hierarchy;
+
   public:
     /// Empty constructor.
     ObjectDatabase() { }
@@ -55,6 +59,47 @@ class ObjectDatabase
       }
     }
 
+    /// Add an object referring to one index block.
+    ///
+    /// \param block Index block to add.
+    /// \param transform Transform to use.
+    /// \param grp Object group created with addGroup() or NULL.
+    void addObject(const IndexBlock &block, const mat4 &transform, ObjectGroup *grp)
+    {
+      m_objects.emplace_back(block, transform, static_cast<const Texture*>(NULL), grp);
+    }
+
+    /// Add an empty object group.
+    ///
+    /// \param count Number of objects that will be added to the group.
+    /// \return Object group, owned by this object database.
+    ObjectGroup* addGroup(unsigned count)
+    {
+      ObjectGroup *ret = new ObjectGroup(count);
+      m_groups.push_back(ret);
+      return ret;
+    }
+
+    /// Merge another object database into this.
+    ///
+    /// Objects are appended in their original order. Given object database is left empty.
+    ///
+    /// \param op Object database to merge.
+    void merge(ObjectDatabase &op)
+    {
+      for(const Object &vv : op.m_objects)
+      {
+        m_objects.emplace_back(vv.getBlock(), vv.getTransform(), vv.getTexture(), vv.getGroup());
+      }
+      for(ObjectGroup *vv : op.m_groups)
+      {
+        m_groups.push_back(vv);
+      }
+
+      op.m_objects.clear();
+      op.m_groups.clear();
+    }
+
     /// Tell if a bounding volume conflicts with existing objects.
     ///
     /// Checks only on XZ-plane.
@@ -169,6 +214,30 @@ class ObjectDatabase
       }
     }
 
+    /// Accessor.
+    ///
+    /// \param idx Index of group to access.
+    /// \return Object group.
+    const ObjectGroup* getGroup(unsigned idx) const
+    {
+      return m_groups[idx];
+    }
+    /// Accessor.
+    ///
+    /// \return Object group count.
+    unsigned getGroupCount() const
+    {
+      return m_groups.size();
+    }
+
+    /// Accessor.
+    ///
+    /// \return Bounding volume hierarchy.
+    const ObjectHierarchy& getHierarchy() const
+    {
+      return m_hierarchy;
+    }
+
     /// Accessor.
     ///
     /// \param idx Index of object to access.
@@ -203,6 +272,14 @@ class ObjectDatabase
     {
       dnload_qsort(m_objects.getData(), m_objects.size(), sizeof(Object), Object::qsort_cmp_object);
     }
+
+    /// Build bounding volume hierarchy.
+    ///
+    /// Must be done after sorting, and again if objects are added afterwards.
+    void buildHierarchy()
+    {
+      m_hierarchy.build(m_objects.getData(), m_objects.size());
+    }
 };
 
 #endif
@@ -3,67 +3,51 @@
 
 #include "verbatim_object_reference.hpp"
 
+#include <atomic>
+
 /// Reference to one mesh.
 ///
-/// The object group algorithm is NOT thread-safe. only one thread can be generating states at a time when
-/// using object groups. However, this should not be a problem since the thread drawing should always be
-/// slower than the thread generating. If this is not the case, something is wrong already.
+/// Object group only identifies which objects belong together. Tracking of how many of them have been added
+/// during a frame is done by the state being generated, so several states may be generated at once.
 class ObjectGroup
 {
   private:
-    /// Object references.
-    seq<ObjectReference*> m_references;
+    /// Number of groups created so far.
+    static std::atomic<unsigned> g_group_count;
+
+  private:
+    /// Group id.
+    const unsigned m_id;
 
     /// Number of elements in the group.
     const unsigned m_count;
 
-    /// Currently rendered frame.
-    unsigned m_frame;
-
   public:
     /// Constructor.
     ///
     /// \param count Object reference count.
     ObjectGroup(unsigned count) :
-      m_references(count),
-      m_count(count),
-      m_frame(0xFFFFFFFFU) { }
+      m_id(g_group_count.fetch_add(1)),
+      m_count(count) { }
 
   public:
-    /// Add object reference.
+    /// Accessor.
     ///
-    /// \param frame Frame currently in progress.
-    /// \param ref Object reference.
-    void addObjectReference(unsigned frame, ObjectReference &ref)
+    /// \return Object reference count.
+    unsigned getCount() const
     {
-      if(frame != m_frame)
-      {
-        m_references.clear();
-        m_frame = frame;
-      }
-#if defined(USE_LD)
-      // Check for exceeded capacity, should never happen.
-      if(m_references.size() >= m_count)
-      {
-        std::ostringstream sstr;
-        sstr << "trying to render more than " << m_references.size() << " objects in a group";
-        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
-      }
-#endif
-      m_references.push_back(&ref);
+      return m_count;
+    }
 
-      // If we have added every object, we can check for optimism.
-      if(m_references.size() >= m_count)
-      {
-        for(ObjectReference *vv : m_references)
-        {
-          vv->setOptimistic(true);
-        }
-        return;
-      }
-      // Otherwise stay non-optimistic for now.
-      ref.setOptimistic(false);
+    /// Accessor.
+    ///
+    /// \return Group id.
+    unsigned getId() const
+    {
+      return m_id;
     }
 };
 
+std::atomic<unsigned> ObjectGroup::g_group_count(0);
+
 #endif
@@ -0,0 +1,213 @@
+#ifndef VERBATIM_OBJECT_HIERARCHY_HPP
+#define VERBATIM_OBJECT_HIERARCHY_HPP
+
+#include "verbatim_frustum.hpp"
+#include "verbatim_object.hpp"
+
+/// Object hierarchy.
+///
+/// Bounding volume hierarchy over the objects of an object database. Refers to objects by their index, so it
+/// must be rebuilt whenever the objects are added or reordered.
+class ObjectHierarchy
+{
+  private:
+    /// Maximum number of objects in a leaf node.
+    static const unsigned LEAF_SIZE = 8;
+
+    /// Hierarchy node.
+    ///
+    /// Nodes are stored depth-first, left child of a node is the node directly after it.
+    struct Node
+    {
+      /// Minimum corner.
+      vec3 m_min;
+
+      /// Maximum corner.
+      vec3 m_max;
+
+      /// First object index in index listing.
+      unsigned m_first;
+
+      /// Number of objects under this node.
+      unsigned m_count;
+
+      /// Right child node, zero for leaf nodes.
+      unsigned m_right;
+
+      /// Constructor.
+      ///
+      /// \param pmin Minimum corner.
+      /// \param pmax Maximum corner.
+      /// \param first First object index in index listing.
+      /// \param count Number of objects.
+      Node(const vec3 &pmin, const vec3 &pmax, unsigned first, unsigned count) :
+        m_min(pmin),
+        m_max(pmax),
+        m_first(first),
+        m_count(count),
+        m_right(0) { }
+    };
+
+  private:
+    /// Nodes.
+    seq<Node> m_nodes;
+
+    /// Indices of objects with bounds, in node order.
+    seq<unsigned> m_indices;
+
+    /// Indices of animated objects, these are not bounded by their volumes.
+    seq<unsigned> m_unbounded;
+
+  public:
+    /// Empty constructor.
+    ObjectHierarchy() { }
+
+  private:
+    /// Build a node and its children.
+    ///
+    /// \param objects Object array.
+    /// \param first First object index in index listing.
+    /// \param count Number of objects.
+    /// \return Index of built node.
+    unsigned buildNode(const Object *objects, unsigned first, unsigned count)
+    {
+      vec3 bmin(FLT_MAX, FLT_MAX, FLT_MAX);
+      vec3 bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      vec3 cmin(FLT_MAX, FLT_MAX, FLT_MAX);
+      vec3 cmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+      for(unsigned ii = first, ee = first + count; (ii < ee); ++ii)
+      {
+        const BoundingVolume &volume = objects[m_indices[ii]].getBoundingVolume();
+        const vec3 &center = volume.getCenter();
+
+        bmin = vec3(std::min(bmin[0], volume.getMinX()), std::min(bmin[1], volume.getMinY()),
+            std::min(bmin[2], volume.getMinZ()));
+        bmax = vec3(std::max(bmax[0], volume.getMaxX()), std::max(bmax[1], volume.getMaxY()),
+            std::max(bmax[2], volume.getMaxZ()));
+        for(unsigned jj = 0; (3 > jj); ++jj)
+        {
+          cmin[jj] = std::min(cmin[jj], center[jj]);
+          cmax[jj] = std::max(cmax[jj], center[jj]);
+        }
+      }
+
+      unsigned ret = m_nodes.size();
+      m_nodes.emplace_back(bmin, bmax, first, count);
+
+      if(LEAF_SIZE >= count)
+      {
+        return ret;
+      }
+
+      // Split at the middle of the longest axis of object centers.
+      vec3 extent = cmax - cmin;
+      unsigned axis = ((extent[0] >= extent[1]) && (extent[0] >= extent[2])) ? 0 :
+        ((extent[1] >= extent[2]) ? 1 : 2);
+      float split = (cmin[axis] + cmax[axis]) * 0.5f;
+      unsigned mid = first;
+
+      for(unsigned ii = first, ee = first + count; (ii < ee); ++ii)
+      {
+        if(objects[m_indices[ii]].getCenter()[axis] < split)
+        {
+          std::swap(m_indices[ii], m_indices[mid]);
+          ++mid;
+        }
+      }
+
+      // Centers all in the same spot, split evenly.
+      if((first == mid) || (first + count == mid))
+      {
+        mid = first + count / 2;
+      }
+
+      buildNode(objects, first, mid - first);
+      unsigned right = buildNode(objects, mid, first + count - mid);
+      m_nodes[ret].m_right = right;
+      return ret;
+    }
+
+    /// Collect objects under a node.
+    ///
+    /// \param test Test to perform on node bounds.
+    /// \param idx Node index.
+    /// \param dst Destination for object indices.
+    /// \return Number of objects rejected.
+    template<typename T> unsigned collectNode(const T &test, unsigned idx, seq<unsigned> &dst) const
+    {
+      const Node &node = m_nodes[idx];
+
+      if(!test.isVisible(node.m_min, node.m_max))
+      {
+        return node.m_count;
+      }
+
+      if(!node.m_right)
+      {
+        for(unsigned ii = node.m_first, ee = node.m_first + node.m_count; (ii < ee); ++ii)
+        {
+          dst.push_back(m_indices[ii]);
+        }
+        return 0;
+      }
+
+      return collectNode(test, idx + 1, dst) + collectNode(test, node.m_right, dst);
+    }
+
+  public:
+    /// Build the hierarchy.
+    ///
+    /// \param objects Object array.
+    /// \param count Number of objects.
+    void build(const Object *objects, unsigned count)
+    {
+      m_nodes.clear();
+      m_indices.clear();
+      m_unbounded.clear();
+
+      for(unsigned ii = 0; (ii < count); ++ii)
+      {
+        if(objects[ii].isAnimated())
+        {
+          m_unbounded.push_back(ii);
+        }
+        else
+        {
+          m_indices.push_back(ii);
+        }
+      }
+
+      if(!m_indices.empty())
+      {
+        buildNode(objects, 0, m_indices.size());
+      }
+    }
+
+    /// Collect objects passing a test.
+    ///
+    /// Whole nodes are accepted or rejected, accepted objects may still fail the test by themselves. Animated
+    /// objects are always accepted.
+    ///
+    /// \param test Test object with isVisible(min, max) method.
+    /// \param dst Destination for object indices.
+    /// \return Number of objects rejected.
+    template<typename T> unsigned collect(const T &test, seq<unsigned> &dst) const
+    {
+      for(unsigned vv : m_unbounded)
+      {
+        dst.push_back(vv);
+      }
+      return m_nodes.empty() ? 0 : collectNode(test, 0, dst);
+    }
+
+    /// Tell if the hierarchy has been built.
+    ///
+    /// \return True if empty, false if not.
+    bool empty() const
+    {
+      return (m_indices.empty() && m_unbounded.empty());
+    }
+};
+
+#endif
@@ -10,6 +10,16 @@
 /// As object, but contains both the object's own transformation and the full transformation.
 class ObjectReference
 {
+  public:
+    /// Visibility flag for screen space passes.
+    static const unsigned VISIBLE_VIEW = 1;
+
+    /// Visibility flag for light space passes.
+    static const unsigned VISIBLE_LIGHT = 2;
+
+    /// All visibility flags.
+    static const unsigned VISIBLE_ALL = VISIBLE_VIEW | VISIBLE_LIGHT;
+
   private:
     /// The object itself verbatim.
     const Object &m_object;
@@ -29,9 +39,21 @@ class ObjectReference
     /// Object world matrix (rotation-only).
     mat3 m_orientation;
 
+    /// Draw state key (geometry buffer and texture) for sorting.
+    unsigned m_state_key;
+
+    /// Depth of object origin in screen space for sorting.
+    float m_depth;
+
+    /// Visibility flags.
+    unsigned m_visibility;
+
     /// Can we render in an optimistic manner?
     bool m_optimistic;
 
+    /// Have screen and light space transformations been calculated?
+    bool m_transformed;
+
   public:
     /// Constructor.
     ///
@@ -49,7 +71,29 @@ class ObjectReference
       m_screen(screen * transform),
       m_light(light * transform),
       m_orientation(transform.getRotation()),
-      m_optimistic(true) { }
+      m_state_key(object.getStateKey()),
+      m_depth(std::max(m_screen[15], 0.0f)),
+      m_visibility(VISIBLE_ALL),
+      m_optimistic(true),
+      m_transformed(true) { }
+
+    /// Constructor.
+    ///
+    /// Screen and light space transformations must be set with setTransforms() before drawing.
+    ///
+    /// \param object Object to render.
+    /// \param transform Object's own world space transformation.
+    /// \param state Animation state (may be null).
+    ObjectReference(const Object &object, const mat4 &transform, const AnimationState *state) :
+      m_object(object),
+      m_animation_state(state),
+      m_world(transform),
+      m_orientation(transform.getRotation()),
+      m_state_key(object.getStateKey()),
+      m_depth(0.0f),
+      m_visibility(VISIBLE_ALL),
+      m_optimistic(true),
+      m_transformed(false) { }
 
   public:
     /// Draw this object reference.
@@ -57,6 +101,24 @@ class ObjectReference
     /// \param op Program to use.
     void drawGeometry(const Program &op) const
     {
+      m_object.useGeometry(op);
+
+      drawInstance(op);
+    }
+
+    /// Draw this object reference as one instance of a batch.
+    ///
+    /// Geometry of the object must already be in use.
+    ///
+    /// \param op Program to use.
+    void drawInstance(const Program &op) const
+    {
+#if defined(USE_LD)
+      if(!m_transformed)
+      {
+        BOOST_THROW_EXCEPTION(std::runtime_error("drawing object reference before transforming it"));
+      }
+#endif
       op.uniform('W', m_world);
       op.uniform('M', m_screen);
       op.uniform('S', m_light);
@@ -70,7 +132,7 @@ class ObjectReference
         op.uniform('E', bone_data, bone_count);
       }
 
-      m_object.drawGeometry(op, m_optimistic);
+      m_object.drawFaces(m_optimistic);
     }
 
     /// Draw shadow edges.
@@ -95,6 +157,69 @@ class ObjectReference
       m_object.drawShadowCaps(op, m_optimistic);
     }
 
+    /// Accessor.
+    ///
+    /// \return Object being referred to.
+    const Object& getObject() const
+    {
+      return m_object;
+    }
+
+    /// Tell if two object references can be drawn in the same batch.
+    ///
+    /// Objects in the same batch share geometry buffer and texture, but may be different index blocks.
+    ///
+    /// \param op Other object reference.
+    /// \return True if yes, false if no.
+    bool isBatchableWith(const ObjectReference &op) const
+    {
+      return ((&m_object.getBlock().getBuffer() == &op.m_object.getBlock().getBuffer()) &&
+          (m_object.getTexture() == op.m_object.getTexture()));
+    }
+
+    /// Tell if this object reference is visible in any of given passes.
+    ///
+    /// \param op Visibility flags.
+    /// \return True if yes, false if no.
+    bool isVisible(unsigned op) const
+    {
+      return (0 != (m_visibility & op));
+    }
+    /// Setter.
+    ///
+    /// \param op New visibility flags.
+    void setVisibility(unsigned op)
+    {
+      m_visibility = op;
+    }
+
+    /// Tell if screen and light space transformations have been set.
+    ///
+    /// \return True if yes, false if no.
+    bool isTransformed() const
+    {
+      return m_transformed;
+    }
+    /// Set screen and light space transformations.
+    ///
+    /// \param screen Full screen space transformation.
+    /// \param light Light space transformation.
+    void setTransforms(const mat4 &screen, const mat4 &light)
+    {
+      m_screen = screen;
+      m_light = light;
+      m_depth = std::max(screen[15], 0.0f);
+      m_transformed = true;
+    }
+
+    /// Accessor.
+    ///
+    /// \return World space transformation.
+    const mat4& getWorldTransform() const
+    {
+      return m_world;
+    }
+
     /// Tell if optimistic rendering is on.
     ///
     /// \return True if yes, false if no.
@@ -109,6 +234,30 @@ class ObjectReference
     {
       m_optimistic = op;
     }
+
+  public:
+    /// Comparison function for sorting object references into draw order.
+    ///
+    /// Sorts by draw state key first, then front-to-back.
+    ///
+    /// \param lhs Left-hand-side operand.
+    /// \param rhs Right-hand-side operand.
+    /// \return Comparison result.
+    static int qsort_cmp_object_reference(const void *lhs, const void *rhs)
+    {
+      const ObjectReference *aa = static_cast<const ObjectReference*>(lhs);
+      const ObjectReference *bb = static_cast<const ObjectReference*>(rhs);
+
+      if(aa->m_state_key != bb->m_state_key)
+      {
+        return (aa->m_state_key < bb->m_state_key) ? -1 : 1;
+      }
+      if(aa->m_depth != bb->m_depth)
+      {
+        return (aa->m_depth < bb->m_depth) ? -1 : 1;
+      }
+      return 0;
+    }
 };
 
 #endif
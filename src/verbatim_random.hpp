@@ -0,0 +1,99 @@
+#ifndef VERBATIM_RANDOM_HPP
+#define VERBATIM_RANDOM_HPP
+
+#include "bsd_rand.h"
+
+/// Random number generator context.
+///
+/// Produces the same sequences as bsd_srand() and bsd_rand(), but keeps its own state. All procedural
+/// generation takes a context explicitly, so generators do not share hidden state and can be run from
+/// several threads at once.
+class Random
+{
+  private:
+    /// Random state.
+    bsd_u_long m_next;
+
+  public:
+    /// Default constructor.
+    ///
+    /// Starts from the same state as bsd_rand() does before seeding.
+    Random()
+    {
+      srand(1);
+    }
+
+    /// Constructor.
+    ///
+    /// \param seed Initial seed.
+    explicit Random(unsigned seed)
+    {
+      srand(seed);
+    }
+
+  public:
+    /// Seed the generator.
+    ///
+    /// \param seed New seed.
+    void srand(unsigned seed)
+    {
+      // Same transform as bsd_srand().
+      m_next = (seed % 0x7ffffffe) + 1;
+    }
+
+    /// Random integer value.
+    ///
+    /// \return Random value.
+    int rand()
+    {
+      return bsd_rand_r(&m_next);
+    }
+
+    /// Boolean random value.
+    ///
+    /// \returns True or false.
+    bool brand()
+    {
+      return static_cast<bool>(rand() & 0x1);
+    }
+
+    /// Boolean random value that returns either of two floating point values.
+    ///
+    /// \param aa First floating point value.
+    /// \param bb Second floating point value.
+    /// \return Either aa or bb.
+    float brand(float aa, float bb)
+    {
+      return brand() ? aa : bb;
+    }
+
+    /// Random float value.
+    ///
+    /// \param op Given maximum value.
+    /// \return Random value between 0 and given value.
+    float frand(float op)
+    {
+      return static_cast<float>(rand() & 0xFFFF) * ((1.0f / 65535.0f) * op);
+    }
+
+    /// Random float value.
+    ///
+    /// \param minimum Given minimum value.
+    /// \param maximum Given maximum value.
+    /// \return Random value between minimum and maximum value.
+    float frand(float minimum, float maximum)
+    {
+      return frand(maximum - minimum) + minimum;
+    }
+
+    /// Random unsigned value.
+    ///
+    /// \param op Random cap.
+    /// \return Random value from range [0, op[
+    unsigned urand(unsigned op)
+    {
+      return static_cast<unsigned>(rand() % static_cast<int>(op));
+    }
+};
+
+#endif
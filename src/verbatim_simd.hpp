@@ -0,0 +1,23 @@
+#ifndef VERBATIM_SIMD_HPP
+#define VERBATIM_SIMD_HPP
+
+/// If set to 1, math kernels use SIMD instructions when compiling for a target that has them.
+///
+/// SIMD kernels perform the same operations in the same order as scalar code, so results do not change.
+#if !defined(VERBATIM_SIMD)
+#define VERBATIM_SIMD 1
+#endif
+
+#if defined(VERBATIM_SIMD) && VERBATIM_SIMD
+#if defined(__SSE__)
+/// Use SSE kernels.
+#define VERBATIM_SIMD_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+/// Use NEON kernels.
+#define VERBATIM_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #define VERBATIM_STATE_HPP
 
 #include "verbatim_frame_buffer.hpp"
+#include "verbatim_frustum.hpp"
 #include "verbatim_object_database.hpp"
 #include "verbatim_object_reference.hpp"
 
@@ -18,13 +19,128 @@ class State
     /// Size of random  storage.
     static const unsigned STORAGE_SIZE = static_cast<unsigned>('Z') + 1 - STORAGE_BASE;
 
+    /// Terminator for object group link lists.
+    static const unsigned GROUP_LINK_END = 0xFFFFFFFFU;
+
     /// Convenience typedef.
     typedef seq<ObjectReference> ObjectReferenceSeq;
 
+    /// Tracking of one object group within a state.
+    struct GroupTracker
+    {
+      /// Generation this tracker was last touched in.
+      unsigned m_generation;
+
+      /// Number of object references added.
+      unsigned m_added;
+
+      /// First link in list of added object references.
+      unsigned m_head;
+
+      /// Constructor.
+      GroupTracker() :
+        m_generation(0) { }
+    };
+
+    /// Link to an object reference in a group.
+    ///
+    /// Object references are addressed by index, since their storage may move while the state is filled.
+    struct GroupLink
+    {
+      /// Pass of the object reference.
+      unsigned m_pass;
+
+      /// Index of the object reference within the pass.
+      unsigned m_index;
+
+      /// Next link in list.
+      unsigned m_next;
+
+      /// Constructor.
+      ///
+      /// \param pass Pass.
+      /// \param index Index.
+      /// \param next Next link.
+      GroupLink(unsigned pass, unsigned index, unsigned next) :
+        m_pass(pass),
+        m_index(index),
+        m_next(next) { }
+    };
+
+    /// Run of object references drawn with the same geometry buffer and texture.
+    struct InstanceBatch
+    {
+      /// Index of first object reference in the pass.
+      unsigned m_first;
+
+      /// Number of object references.
+      unsigned m_count;
+
+      /// Constructor.
+      ///
+      /// \param first First object reference.
+      /// \param count Number of object references.
+      InstanceBatch(unsigned first, unsigned count) :
+        m_first(first),
+        m_count(count) { }
+    };
+
+    /// Convenience typedef.
+    typedef seq<InstanceBatch> InstanceBatchSeq;
+
+    /// Object hierarchy test against culling frustums.
+    class CullTest
+    {
+      private:
+        /// View frustum.
+        const Frustum &m_view;
+
+        /// Light frustum or NULL if light culling is not enabled.
+        const Frustum *m_light;
+
+      public:
+        /// Constructor.
+        ///
+        /// \param view View frustum.
+        /// \param light Light frustum or NULL.
+        CullTest(const Frustum &view, const Frustum *light) :
+          m_view(view),
+          m_light(light) { }
+
+      public:
+        /// Tell if a box may be visible to view or light.
+        ///
+        /// \param pmin Minimum corner.
+        /// \param pmax Maximum corner.
+        /// \return True if yes, false if no.
+        bool isVisible(const vec3 &pmin, const vec3 &pmax) const
+        {
+          return m_view.isVisible(pmin, pmax) || (m_light && m_light->isVisible(pmin, pmax));
+        }
+    };
+
   private:
     /// Object references.
     seq<ObjectReferenceSeq> m_objects;
 
+    /// Instance batches for every pass, empty if pass is not batched.
+    seq<InstanceBatchSeq> m_batches;
+
+    /// Number of objects culled for every pass.
+    seq<unsigned> m_culled;
+
+    /// Object indices collected from object hierarchies.
+    seq<unsigned> m_candidates;
+
+    /// World space transformations of a pass as structure of arrays.
+    seq<float> m_soa_world;
+
+    /// Screen space transformations of a pass as structure of arrays.
+    seq<float> m_soa_screen;
+
+    /// Light space transformations of a pass as structure of arrays.
+    seq<float> m_soa_light;
+
     /// Animation states.
     seq<AnimationState> m_animation_states;
 
@@ -43,9 +159,29 @@ class State
     /// Light direction.
     vec3 m_light_dir;
 
+    /// View frustum for culling.
+    Frustum m_view_frustum;
+
+    /// Is view frustum culling enabled?
+    bool m_view_culling;
+
+    /// Light frustum for culling.
+    Frustum m_light_frustum;
+
+    /// Is light frustum culling enabled?
+    bool m_light_culling;
+
+#if defined(USE_LD)
+    /// Has light been set after initialization?
+    bool m_light_set;
+#endif
+
     /// Current position (viewified camera does not provide this).
     vec3 m_position;
 
+    /// Camera position as given on initialization.
+    vec3 m_camera_position;
+
     /// Current frame id.
     int m_frame;
 
@@ -61,6 +197,20 @@ class State
     /// Boolean storage, for random variables.
     bool m_storage_bool[STORAGE_SIZE];
 
+    /// Object group trackers, indexed by group id.
+    seq<GroupTracker> m_group_trackers;
+
+    /// Object group links.
+    seq<GroupLink> m_group_links;
+
+    /// Current object group generation, increases every time state is initialized.
+    unsigned m_group_generation;
+
+  public:
+    /// Constructor.
+    State() :
+      m_group_generation(0) { }
+
   private:
     /// Get pass at index.
     ///
@@ -80,7 +230,276 @@ class State
       return m_objects[idx];
     }
 
+    /// Account for culled objects.
+    ///
+    /// \param pass Render pass id.
+    /// \param count Number of objects culled.
+    void addCulled(unsigned pass, unsigned count)
+    {
+      while(m_culled.size() <= pass)
+      {
+        m_culled.push_back(0);
+      }
+      m_culled[pass] += count;
+    }
+
+    /// Get visibility of an object.
+    ///
+    /// Without light culling, objects are visible to light if and only if they are visible to view. Objects not
+    /// visible at all are counted as culled for the pass.
+    ///
+    /// \param obj Object to test.
+    /// \param pass Render pass id.
+    /// \return Visibility flags, zero if object should not be added.
+    unsigned getVisibility(const Object &obj, unsigned pass)
+    {
+      if(obj.isAnimated())
+      {
+        return ObjectReference::VISIBLE_ALL;
+      }
+
+      const BoundingVolume &volume = obj.getBoundingVolume();
+      bool view = !m_view_culling || m_view_frustum.isVisible(volume);
+      bool light = view;
+
+      if(m_light_culling)
+      {
+#if defined(USE_LD)
+        if(!m_light_set)
+        {
+          BOOST_THROW_EXCEPTION(std::runtime_error("light culling enabled but light not set"));
+        }
+#endif
+        light = m_light_frustum.isVisible(volume);
+      }
+
+      if(!view && !light)
+      {
+        addCulled(pass, 1);
+        return 0;
+      }
+
+      return (view ? ObjectReference::VISIBLE_VIEW : 0) | (light ? ObjectReference::VISIBLE_LIGHT : 0);
+    }
+
+    /// Add a reference to render an object unless it is culled.
+    ///
+    /// \param object Object to queue for rendering.
+    /// \param pass Render pass id.
+    void addObjectCulled(const Object &object, unsigned pass)
+    {
+      unsigned visibility = getVisibility(object, pass);
+
+      if(visibility)
+      {
+        addObject(object, pass);
+        getPass(pass).back().setVisibility(visibility);
+      }
+    }
+
+    /// Draw object references visible in given passes.
+    ///
+    /// \param prg Program to use.
+    /// \param pass Which pass to draw.
+    /// \param visibility Visibility flags to draw.
+    void drawVisible(const Program &prg, unsigned pass, unsigned visibility) const
+    {
+      // Batched passes bind geometry buffer and texture only once per batch.
+      if((m_batches.size() > pass) && !m_batches[pass].empty())
+      {
+        const ObjectReferenceSeq &objects = m_objects[pass];
+
+        for(const InstanceBatch &vv : m_batches[pass])
+        {
+          const IndexBlock *block = NULL;
+
+          for(unsigned ii = vv.m_first, ee = vv.m_first + vv.m_count; (ee > ii); ++ii)
+          {
+            const ObjectReference &ref = objects[ii];
+
+            if(!ref.isVisible(visibility))
+            {
+              continue;
+            }
+
+            // Block within the same buffer only needs its own uniforms.
+            if(!block)
+            {
+              block = &ref.getObject().getBlock();
+              ref.getObject().useGeometry(prg);
+            }
+            else if(&ref.getObject().getBlock() != block)
+            {
+              block = &ref.getObject().getBlock();
+              block->useGeometry(prg);
+            }
+            ref.drawInstance(prg);
+          }
+        }
+        return;
+      }
+
+      if(m_objects.size() > pass)
+      {
+        for(const ObjectReference &vv : m_objects[pass])
+        {
+          if(vv.isVisible(visibility))
+          {
+            vv.drawGeometry(prg);
+          }
+        }
+      }
+    }
+
+    /// Add an object reference to a group.
+    ///
+    /// Once all objects in the group have been added during this state, all of them are rendered in an
+    /// optimistic manner. Until then, they stay non-optimistic.
+    ///
+    /// \param grp Object group.
+    /// \param pass Pass of the object reference.
+    /// \param index Index of the object reference within the pass.
+    void addGroupReference(const ObjectGroup &grp, unsigned pass, unsigned index)
+    {
+      unsigned id = grp.getId();
+
+      if(m_group_trackers.size() <= id)
+      {
+        m_group_trackers.resize(std::max(id + 1, m_group_trackers.size() * 2));
+      }
+
+      GroupTracker &tracker = m_group_trackers[id];
+      if(tracker.m_generation != m_group_generation)
+      {
+        tracker.m_generation = m_group_generation;
+        tracker.m_added = 0;
+        tracker.m_head = GROUP_LINK_END;
+      }
+#if defined(USE_LD)
+      // Check for exceeded capacity, should never happen.
+      if(tracker.m_added >= grp.getCount())
+      {
+        std::ostringstream sstr;
+        sstr << "trying to render more than " << tracker.m_added << " objects in a group";
+        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+      }
+#endif
+      m_group_links.emplace_back(pass, index, tracker.m_head);
+      tracker.m_head = m_group_links.size() - 1;
+      ++tracker.m_added;
+
+      // If we have added every object, we can check for optimism.
+      if(tracker.m_added >= grp.getCount())
+      {
+        for(unsigned ii = tracker.m_head; (GROUP_LINK_END != ii); ii = m_group_links[ii].m_next)
+        {
+          const GroupLink &link = m_group_links[ii];
+
+          m_objects[link.m_pass][link.m_index].setOptimistic(true);
+        }
+        return;
+      }
+      // Otherwise stay non-optimistic for now.
+      m_objects[pass][index].setOptimistic(false);
+    }
+
+    /// Calculate screen and light space transformations for object references of a pass.
+    ///
+    /// \param objects Object references.
+    void transformPass(ObjectReferenceSeq &objects)
+    {
+      unsigned count = objects.size();
+      unsigned stride = (count + 3) & ~3u;
+
+      m_soa_world.resize(stride * 16);
+      m_soa_screen.resize(stride * 16);
+      m_soa_light.resize(stride * 16);
+
+      for(unsigned ii = 0; (stride > ii); ++ii)
+      {
+        // Padding lanes are calculated but never read back.
+        for(unsigned jj = 0; (16 > jj); ++jj)
+        {
+          m_soa_world[jj * stride + ii] = (count > ii) ? objects[ii].getWorldTransform()[jj] : 0.0f;
+        }
+      }
+
+      m_screen_transform.multiplySoa(m_soa_world.getData(), m_soa_screen.getData(), stride);
+      m_light_transform.multiplySoa(m_soa_world.getData(), m_soa_light.getData(), stride);
+
+      for(unsigned ii = 0; (count > ii); ++ii)
+      {
+        ObjectReference &vv = objects[ii];
+
+        if(!vv.isTransformed())
+        {
+          mat4 screen;
+          mat4 light;
+
+          for(unsigned jj = 0; (16 > jj); ++jj)
+          {
+            screen[jj] = m_soa_screen[jj * stride + ii];
+            light[jj] = m_soa_light[jj * stride + ii];
+          }
+          vv.setTransforms(screen, light);
+        }
+      }
+    }
+
   public:
+    /// Calculate screen and light space transformations for all added object references.
+    ///
+    /// Must be called after all objects have been added and the light has been set, before drawing.
+    void transformObjects()
+    {
+      for(ObjectReferenceSeq &vv : m_objects)
+      {
+        if(!vv.empty())
+        {
+          transformPass(vv);
+        }
+      }
+    }
+
+    /// Group object references of a pass into instance batches.
+    ///
+    /// Sorts object references by geometry buffer and texture, then front-to-back, so all references drawn
+    /// with the same geometry buffer and texture are drawn in one batch. Must be called after object
+    /// references have been transformed. Order of drawing within the pass will not be preserved, so only
+    /// passes drawn without blending may be batched.
+    ///
+    /// \param pass Render pass id.
+    void buildInstanceBatches(unsigned pass)
+    {
+      if(m_objects.size() <= pass)
+      {
+        return;
+      }
+      if(m_batches.size() <= pass)
+      {
+        m_batches.resize(pass + 1);
+      }
+
+      ObjectReferenceSeq &objects = m_objects[pass];
+      InstanceBatchSeq &batches = m_batches[pass];
+
+      dnload_qsort(objects.getData(), objects.size(), sizeof(ObjectReference),
+          ObjectReference::qsort_cmp_object_reference);
+
+      batches.clear();
+      for(unsigned ii = 0; (objects.size() > ii);)
+      {
+        unsigned jj = ii + 1;
+
+        while((objects.size() > jj) && objects[ii].isBatchableWith(objects[jj]))
+        {
+          ++jj;
+        }
+        batches.emplace_back(ii, jj - ii);
+        ii = jj;
+      }
+    }
+
     /// Add a reference to render an object.
     ///
     /// \param object Object to queue for rendering.
@@ -90,16 +509,16 @@ class State
     void addObject(const Object &object, const mat4 &transform, unsigned pass = 0, bool optimistic = true,
         const AnimationState *state = NULL)
     {
-      ObjectGroup *grp = object.getGroup();      
+      const ObjectGroup *grp = object.getGroup();
+      ObjectReferenceSeq &objects = getPass(pass);
 
-      ObjectReference &vv = getPass(pass).emplace_back(object, m_screen_transform, m_light_transform,
-          transform, state);
+      ObjectReference &vv = objects.emplace_back(object, transform, state);
 
       if(grp)
       {
         if(optimistic)
         {
-          grp->addObjectReference(m_frame_count, vv);
+          addGroupReference(*grp, pass, objects.size() - 1);
         }
         else
         {
@@ -152,15 +571,44 @@ class State
 
     /// Add everything from an object database.
     ///
+    /// If the database has a hierarchy and view culling is enabled, objects are collected through the hierarchy
+    /// and added in hierarchy order.
+    ///
     /// \param db Database.
     /// \param pass Render pass id.
     void addObjectDatabase(const ObjectDatabase &db, unsigned pass = 0)
     {
+      const ObjectHierarchy &hierarchy = db.getHierarchy();
+
+      // Without view culling nothing would be culled.
+      if(m_view_culling && !hierarchy.empty())
+      {
+        CullTest test(m_view_frustum, m_light_culling ? &m_light_frustum : NULL);
+
+        m_candidates.clear();
+        addCulled(pass, hierarchy.collect(test, m_candidates));
+        addObjectDatabase(db, m_candidates, pass);
+        return;
+      }
+
       for(unsigned ii = 0; (ii < db.getObjectCount()); ++ii)
       {
         const Object& obj = db.getObject(ii);
 
-        addObject(obj, pass);
+        addObjectCulled(obj, pass);
+      }
+    }
+
+    /// Add objects from an object database by index.
+    ///
+    /// \param db Database.
+    /// \param indices Indices of objects to add.
+    /// \param pass Render pass id.
+    void addObjectDatabase(const ObjectDatabase &db, const seq<unsigned> &indices, unsigned pass = 0)
+    {
+      for(unsigned vv : indices)
+      {
+        addObjectCulled(db.getObject(vv), pass);
       }
     }
 
@@ -207,7 +655,7 @@ class State
             }
             else
             {
-              addObject(obj, pass);
+              addObjectCulled(obj, pass);
             }
           }
           else if(cmp - fade > limit)
@@ -241,7 +689,7 @@ class State
             }
             else
             {
-              addObject(obj, pass);
+              addObjectCulled(obj, pass);
             }
           }
           else if(cmp + fade < limit)
@@ -272,18 +720,18 @@ class State
       {
         const Object& obj = db.getObject(ii);
 
-        bsd_srand(ii / block_size);
+        Random rnd(ii / block_size);
 
-        float px = frand(-amplitude[0], amplitude[0]);
-        float py = frand(-amplitude[1], amplitude[1]);
-        float pz = frand(-amplitude[2], amplitude[2]);
-        float ax = frand(static_cast<float>(M_PI));
-        float ay = frand(static_cast<float>(M_PI));
-        float az = frand(static_cast<float>(M_PI));
+        float px = rnd.frand(-amplitude[0], amplitude[0]);
+        float py = rnd.frand(-amplitude[1], amplitude[1]);
+        float pz = rnd.frand(-amplitude[2], amplitude[2]);
+        float ax = rnd.frand(static_cast<float>(M_PI));
+        float ay = rnd.frand(static_cast<float>(M_PI));
+        float az = rnd.frand(static_cast<float>(M_PI));
        
-        px *= dnload_sinf(ax + phase * (brand() ? -1.0f : 1.0f));
-        py *= dnload_sinf(ay + phase * (brand() ? -1.0f : 1.0f));
-        pz *= dnload_sinf(az + phase * (brand() ? -1.0f : 1.0f));
+        px *= dnload_sinf(ax + phase * (rnd.brand() ? -1.0f : 1.0f));
+        py *= dnload_sinf(ay + phase * (rnd.brand() ? -1.0f : 1.0f));
+        pz *= dnload_sinf(az + phase * (rnd.brand() ? -1.0f : 1.0f));
 
         mat4 tr = obj.unpackTransform(m_frame);
 
@@ -301,13 +749,16 @@ class State
     /// \param pass Which pass to draw.
     void drawGeometry(const Program &prg, unsigned pass = 0) const
     {
-      if(m_objects.size() > pass)
-      {
-        for(const ObjectReference &vv : m_objects[pass])
-        {
-          vv.drawGeometry(prg);
-        }
-      }
+      drawVisible(prg, pass, ObjectReference::VISIBLE_VIEW);
+    }
+
+    /// Draw geometry for this state to light space.
+    ///
+    /// \param prg Program to use.
+    /// \param pass Which pass to draw.
+    void drawShadowMap(const Program &prg, unsigned pass = 0) const
+    {
+      drawVisible(prg, pass, ObjectReference::VISIBLE_LIGHT);
     }
 
     /// Draw shadow edges for this state.
@@ -340,6 +791,14 @@ class State
       }
     }
 
+    /// Accessor.
+    ///
+    /// \return Camera position.
+    const vec3& getCameraPosition() const
+    {
+      return m_camera_position;
+    }
+
     /// Accessor.
     ///
     /// \return Camera matrix.
@@ -366,6 +825,17 @@ class State
       m_frame = frame;
       m_frame_count = prev.m_frame_count + 1;
     }
+    /// Set state frame.
+    ///
+    /// Used when states are generated without waiting for the previous state.
+    ///
+    /// \param frame Frame number.
+    /// \param frame_count Total frame count.
+    void setFrame(int frame, unsigned frame_count)
+    {
+      m_frame = frame;
+      m_frame_count = frame_count;
+    }
     /// Set state to initial frame.
     void setFrameInitial()
     {
@@ -414,6 +884,10 @@ class State
       mat4 proj = mat4::projection(xfov, width, height, dist - znear, dist + zfar);
       m_light_transform = proj * viewify(cam);
       m_light_dir = -unit_dir;
+      m_light_frustum = Frustum(m_light_transform);
+#if defined(USE_LD)
+      m_light_set = true;
+#endif
     }
     /// Set light wrapper.
     ///
@@ -463,6 +937,47 @@ class State
       return m_projection * m_camera;
     }
 
+    /// Accessor.
+    ///
+    /// \param op Pass index.
+    /// \return Number of objects culled from given pass.
+    unsigned getCulledCount(unsigned op) const
+    {
+      return (m_culled.size() > op) ? m_culled[op] : 0;
+    }
+
+    /// Accessor.
+    ///
+    /// \param op Pass index.
+    /// \return Number of objects drawn in given pass.
+    unsigned getDrawnCount(unsigned op) const
+    {
+      return (m_objects.size() > op) ? m_objects[op].size() : 0;
+    }
+
+    /// Enable or disable light frustum culling.
+    ///
+    /// Objects outside the view frustum but within the light frustum are kept for shadow map rendering. Light
+    /// must be set before adding objects.
+    ///
+    /// \param op True to enable culling.
+    void setLightCulling(bool op)
+    {
+      m_light_culling = op;
+    }
+
+    /// Enable or disable view frustum culling.
+    ///
+    /// Objects outside the view frustum may still cast shadows into view. States rendered with shadow maps
+    /// should also enable light culling, states rendered with stencil shadows should not be culled. Only static
+    /// objects added from object databases are culled.
+    ///
+    /// \param op True to enable culling.
+    void setViewCulling(bool op)
+    {
+      m_view_culling = op;
+    }
+
     /// Tell if a pass has any objects.
     ///
     /// \param op Pass index.
@@ -481,13 +996,34 @@ class State
       {
         vv.clear();
       }
+      for(InstanceBatchSeq &vv : m_batches)
+      {
+        vv.clear();
+      }
+      for(unsigned &vv : m_culled)
+      {
+        vv = 0;
+      }
 
       // Return animation states from front again.
       m_current_animation_state = 0;
 
+      // Forget object groups from previous use.
+      m_group_links.clear();
+      ++m_group_generation;
+
       m_projection = projection;
       m_camera = viewify(camera);
+      m_camera_position = vec3(camera[12], camera[13], camera[14]);
       m_screen_transform = m_projection * m_camera;
+
+      // Culling must be explicitly enabled for every state.
+      m_view_frustum = Frustum(m_screen_transform);
+      m_view_culling = false;
+      m_light_culling = false;
+#if defined(USE_LD)
+      m_light_set = false;
+#endif
     }
 
     /// Get a fresh animation state.
@@ -630,25 +1166,26 @@ class State
           0.0f, 0.0f, MIN_SCALE, 0.0f,
           0.0f, 0.0f, 0.0f, 1.0f);
 
-      bsd_srand(seed);
+      Random rnd(seed);
 
-      float diff_x = frand(MID_DIFF, HIGH_DIFF);
-      float diff_y = frand(LOW_DIFF, HIGH_DIFF);
-      float diff_z = frand(LOW_DIFF, HIGH_DIFF);
+      float diff_x = rnd.frand(MID_DIFF, HIGH_DIFF);
+      float diff_y = rnd.frand(LOW_DIFF, HIGH_DIFF);
+      float diff_z = rnd.frand(LOW_DIFF, HIGH_DIFF);
 
-      ret[12] = randomOffsetCoord(center[0], diff_x);
-      ret[13] = randomOffsetCoord(center[1], diff_y);
-      ret[14] = center[2] + (brand(-1.0f, 1.0f) * diff_z);
+      ret[12] = randomOffsetCoord(rnd, center[0], diff_x);
+      ret[13] = randomOffsetCoord(rnd, center[1], diff_y);
+      ret[14] = center[2] + (rnd.brand(-1.0f, 1.0f) * diff_z);
 
       return mix(ret, transform, interp);
     }
 
     /// Randomize a fade-in direction based on coordinate itself.
     ///
+    /// \param rnd Random number generator.
     /// \param coord Coordinate value.
     /// \param diff Difference value.
     /// \return Coordinate value coming from correct direction.
-    static float randomOffsetCoord(float coord, float diff)
+    static float randomOffsetCoord(Random &rnd, float coord, float diff)
     {
       if(coord < 0.0f)
       {
@@ -658,7 +1195,7 @@ class State
       {
         return coord + diff;
       }
-      return brand(-1.0f, 1.0f) * diff;
+      return rnd.brand(-1.0f, 1.0f) * diff;
     }
 };
 
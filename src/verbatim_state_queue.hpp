@@ -4,67 +4,144 @@
 #include "verbatim_threading.hpp"
 #include "verbatim_state.hpp"
 
+#include <atomic>
+
 /// State queue.
 ///
+/// Lock-free ring for one producer and one consumer thread. The mutex and conds are only used to sleep
+/// when the ring is full (producer) or empty (consumer).
+///
+/// Alternatively, several producers may fill states at the same time using the ordered interface. States
+/// are then handed to the consumer in the order they were acquired, regardless of which producer finishes
+/// first. The two producer interfaces must not be used at the same time.
+///
 /// Static data only.
-class StateQueue
+///
+/// \param N Number of states to store.
+template<unsigned N> class StateQueue
 {
   private:
-    /// Number of states to store.
-    static const unsigned NUM_STATES = 3;
-
-  private:
-    /// Mutex.
+    /// Mutex for sleeping.
     Mutex m_mutex;
 
-    /// Cond.
-    Cond m_cond;
+    /// Cond for producer waiting for an empty state.
+    Cond m_cond_full;
+
+    /// Cond for consumer waiting for a ready state.
+    Cond m_cond_empty;
 
     /// State array.
-    State m_states[NUM_STATES];
+    State m_states[N];
 
     /// Last inserted state.
     const State *m_last_state;
 
-    /// Current ready state extraction point.
-    unsigned m_extract;
+    /// Number of states finished by producer.
+    std::atomic<unsigned> m_insert;
+
+    /// Number of states finished by consumer.
+    std::atomic<unsigned> m_extract;
 
-    /// Current number of ready states.
-    unsigned m_num_states;
+    /// Set when producer is sleeping.
+    std::atomic<bool> m_waiting_full;
+
+    /// Set when consumer is sleeping.
+    std::atomic<bool> m_waiting_empty;
 
     /// Terminate flag.
-    bool m_terminated;
-    
+    std::atomic<bool> m_terminated;
+
+    /// Mutex for ordered producers acquiring states.
+    Mutex m_reserve_mutex;
+
+    /// Mutex for ordered producers finishing states.
+    Mutex m_publish_mutex;
+
+    /// Number of states acquired by ordered producers.
+    unsigned m_reserve;
+
+    /// Flags for states finished by ordered producers but not yet handed to consumer.
+    bool m_finished[N];
+
+    /// Number of times producer found the queue full.
+    unsigned m_stalls_full;
+
+    /// Number of times consumer found the queue empty.
+    unsigned m_stalls_empty;
+
   public:
     /// Constructor.
     StateQueue() :
+      m_last_state(NULL),
+      m_insert(0),
       m_extract(0),
-      m_num_states(0),
-      m_terminated(false) { }
+      m_waiting_full(false),
+      m_waiting_empty(false),
+      m_terminated(false),
+      m_reserve(0),
+      m_stalls_full(0),
+      m_stalls_empty(0)
+    {
+      for(bool &vv : m_finished)
+      {
+        vv = false;
+      }
+    }
 
   private:
-    /// Acquire state queue mutex.
-    void acquire()
+    /// Tell if the queue is full.
+    ///
+    /// \return True if no empty states are available.
+    bool isFull() const
     {
-      m_mutex.acquire();
+      return (m_insert.load(std::memory_order_relaxed) - m_extract.load() >= N);
     }
 
-    /// Signal state queue cond.
-    void signal()
+    /// Tell if the queue is full for ordered producers.
+    ///
+    /// \return True if no empty states are available for acquiring.
+    bool isReserveFull() const
     {
-      m_cond.signal();
+      return (m_reserve - m_extract.load() >= N);
     }
 
-    /// Release state queue mutex.
-    void release()
+    /// Tell if the queue is empty.
+    ///
+    /// \return True if no ready states are available.
+    bool isEmpty() const
     {
-      m_mutex.release();
+      return (m_insert.load() == m_extract.load(std::memory_order_relaxed));
     }
 
-    /// Wait on this queue.
-    void wait()
+    /// Sleep until other side has made progress.
+    ///
+    /// \param func Function telling if we still need to wait.
+    /// \param cond Cond to wait on.
+    /// \param waiting Flag telling the other side we're sleeping.
+    void wait(bool (StateQueue::*func)() const, Cond &cond, std::atomic<bool> &waiting)
     {
-      m_cond.wait(m_mutex);
+      ScopedLock lock(&m_mutex);
+
+      waiting.store(true);
+      // Must check again after waiting flag is visible, or the wakeup might be missed.
+      while(!m_terminated.load() && (this->*func)())
+      {
+        cond.wait(m_mutex);
+      }
+      waiting.store(false);
+    }
+
+    /// Wake the other side if it's sleeping.
+    ///
+    /// \param cond Cond the other side waits on.
+    /// \param waiting Flag telling if the other side is sleeping.
+    void wake(Cond &cond, const std::atomic<bool> &waiting)
+    {
+      if(waiting.load())
+      {
+        ScopedLock lock(&m_mutex);
+        cond.signal();
+      }
     }
 
   public:
@@ -73,24 +150,40 @@ class StateQueue
     /// \return State or NULL if queue is terminated.
     State* acquireEmpty()
     {
-      ScopedLock lock(&m_mutex);
-
-      for(;;)
+      if(isFull())
+      {
+        ++m_stalls_full;
+        wait(&StateQueue::isFull, m_cond_full, m_waiting_full);
+      }
+      if(m_terminated.load())
       {
-        if(m_terminated)
-        {
-          return NULL;
-        }
+        return NULL;
+      }
 
-        if(NUM_STATES > m_num_states)
-        {
-          break;
-        }
+      return &(m_states[m_insert.load(std::memory_order_relaxed) % N]);
+    }
+
+    /// Acquire one empty state from array for an ordered producer.
+    ///
+    /// \param ticket Receives the ticket to finish the state with.
+    /// \return State or NULL if queue is terminated.
+    State* acquireEmptyOrdered(unsigned &ticket)
+    {
+      // Only one producer at a time may sleep waiting for space.
+      ScopedLock lock(&m_reserve_mutex);
 
-        this->wait();
+      if(isReserveFull())
+      {
+        ++m_stalls_full;
+        wait(&StateQueue::isReserveFull, m_cond_full, m_waiting_full);
+      }
+      if(m_terminated.load())
+      {
+        return NULL;
       }
 
-      return &(m_states[(m_extract + m_num_states) % NUM_STATES]);
+      ticket = m_reserve++;
+      return &(m_states[ticket % N]);
     }
 
     /// Acquire one ready state from array.
@@ -98,27 +191,17 @@ class StateQueue
     /// \return State or NULL if queue is terminated.
     State* acquireReady()
     {
-      ScopedLock lock(&m_mutex);
-
-      for(;;)
+      if(isEmpty())
       {
-        if(m_terminated)
-        {
-          return NULL;
-        }
-
-        if(0 < m_num_states)
-        {
-          break;
-        }
-
-#if defined(USE_LD)
-        std::cout << "WARNING: state queue empty" << std::endl;
-#endif
-        this->wait();
+        ++m_stalls_empty;
+        wait(&StateQueue::isEmpty, m_cond_empty, m_waiting_empty);
+      }
+      if(m_terminated.load())
+      {
+        return NULL;
       }
 
-      return &(m_states[m_extract]);
+      return &(m_states[m_extract.load(std::memory_order_relaxed) % N]);
     }
 
     /// Get last state added.
@@ -129,6 +212,22 @@ class StateQueue
       return m_last_state;
     }
 
+    /// Accessor.
+    ///
+    /// \return Number of times the producer had to wait for an empty state.
+    unsigned getStallsFull() const
+    {
+      return m_stalls_full;
+    }
+
+    /// Accessor.
+    ///
+    /// \return Number of times the consumer had to wait for a ready state.
+    unsigned getStallsEmpty() const
+    {
+      return m_stalls_empty;
+    }
+
     /// Finish an empty state, making it ready.
     ///
     /// The state must be a previously acquired empty state.
@@ -136,32 +235,61 @@ class StateQueue
     /// \param op State to finish.
     void finishEmpty(const State &op)
     {
-      ScopedLock lock(&m_mutex);
+      unsigned insert = m_insert.load(std::memory_order_relaxed) + 1;
 
       m_last_state = &op;
-      ++m_num_states;
+      m_reserve = insert;
+      m_insert.store(insert);
 
-      signal();
+      wake(m_cond_empty, m_waiting_empty);
+    }
+
+    /// Finish an empty state acquired by an ordered producer.
+    ///
+    /// The state is made ready once all states acquired before it have been finished.
+    ///
+    /// \param ticket Ticket received when acquiring the state.
+    /// \return Number of states made ready so far.
+    unsigned finishEmptyOrdered(unsigned ticket)
+    {
+      ScopedLock lock(&m_publish_mutex);
+      unsigned insert = m_insert.load(std::memory_order_relaxed);
+
+      m_finished[ticket % N] = true;
+
+      if(ticket != insert)
+      {
+        return insert;
+      }
+
+      while(m_finished[insert % N])
+      {
+        m_finished[insert % N] = false;
+        m_last_state = &(m_states[insert % N]);
+        ++insert;
+      }
+      m_insert.store(insert);
+
+      wake(m_cond_empty, m_waiting_empty);
+      return insert;
     }
 
     /// Finish the last acquired ready state, making it empty.
     void finishReady()
     {
-      ScopedLock lock(&m_mutex);
-
-      m_extract = (m_extract + 1) % NUM_STATES;
-      --m_num_states;
+      m_extract.store(m_extract.load(std::memory_order_relaxed) + 1);
 
-      this->signal();
+      wake(m_cond_full, m_waiting_full);
     }
 
     /// Terminate execution.
     void terminate()
     {
-      this->acquire();
-      m_terminated = true;
-      this->signal();
-      this->release();
+      ScopedLock lock(&m_mutex);
+
+      m_terminated.store(true);
+      m_cond_full.signal();
+      m_cond_empty.signal();
     }
 };
 
@@ -8,6 +8,7 @@
 #include "synth/effect_bus.cpp"
 #include "synth/ghostsyn.cpp"
 #include "synth/instrument.cpp"
+#include "synth/snapshot.cpp"
 #include "synth/song_writer.cpp"
 #include "synth/voice.cpp"
 
@@ -0,0 +1,247 @@
+#ifndef VERBATIM_TASK_GRAPH_HPP
+#define VERBATIM_TASK_GRAPH_HPP
+
+#include "verbatim_seq.hpp"
+#include "verbatim_threading.hpp"
+#include "verbatim_uptr.hpp"
+
+/// Task graph.
+///
+/// Runs a fixed number of tasks on a pool of threads. A task is started only after all tasks it depends on
+/// have finished. Tasks may only depend on tasks with a smaller index, so the graph can not have cycles.
+class TaskGraph
+{
+  public:
+    /// Task function type.
+    ///
+    /// Receives the user data and the index of the task to run.
+    typedef void (*TaskFunc)(void*, unsigned);
+
+  private:
+    /// One task.
+    struct Task
+    {
+      /// Number of dependencies that have not finished yet.
+      unsigned m_waiting;
+
+      /// Tasks depending on this task.
+      seq<unsigned> m_dependents;
+
+#if defined(USE_LD)
+      /// Tasks this task depends on.
+      seq<unsigned> m_dependencies;
+
+      /// Start time (relative to start of graph).
+      uint32_t m_start;
+
+      /// End time (relative to start of graph).
+      uint32_t m_end;
+#endif
+
+      /// Constructor.
+      Task() :
+        m_waiting(0) { }
+    };
+
+  private:
+    /// Mutex guarding task state.
+    Mutex m_mutex;
+
+    /// Cond for threads waiting for ready tasks.
+    Cond m_cond;
+
+    /// Task function.
+    TaskFunc m_func;
+
+    /// User data.
+    void *m_data;
+
+    /// Tasks.
+    seq<Task> m_tasks;
+
+    /// Tasks ready to run, in the order they became ready.
+    seq<unsigned> m_ready;
+
+    /// Next ready task to hand out.
+    unsigned m_ready_next;
+
+    /// Number of finished tasks.
+    unsigned m_finished;
+
+#if defined(USE_LD)
+    /// Start time of the graph.
+    uint32_t m_start;
+#endif
+
+  private:
+    /// Deleted copy constructor.
+    TaskGraph(const TaskGraph&) = delete;
+    /// Deleted assignment.
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+  public:
+    /// Constructor.
+    ///
+    /// \param count Number of tasks.
+    /// \param func Task function.
+    /// \param data User data passed to task function.
+    TaskGraph(unsigned count, TaskFunc func, void *data) :
+      m_func(func),
+      m_data(data),
+      m_ready_next(0),
+      m_finished(0)
+    {
+      m_tasks.resize(count);
+    }
+
+  private:
+    /// Run tasks until all tasks have been finished.
+    void work()
+    {
+      ScopedLock lock(&m_mutex);
+
+      for(;;)
+      {
+        while((m_ready.size() <= m_ready_next) && (m_tasks.size() > m_finished))
+        {
+          m_cond.wait(m_mutex);
+        }
+        if(m_tasks.size() <= m_finished)
+        {
+          // Pass the wakeup on to the next waiting thread.
+          m_cond.signal();
+          return;
+        }
+
+        unsigned idx = m_ready[m_ready_next];
+        ++m_ready_next;
+
+        m_mutex.release();
+#if defined(USE_LD)
+        m_tasks[idx].m_start = dnload_SDL_GetTicks() - m_start;
+#endif
+        m_func(m_data, idx);
+#if defined(USE_LD)
+        m_tasks[idx].m_end = dnload_SDL_GetTicks() - m_start;
+#endif
+        m_mutex.acquire();
+
+        for(unsigned vv : m_tasks[idx].m_dependents)
+        {
+          if(0 == --m_tasks[vv].m_waiting)
+          {
+            m_ready.push_back(vv);
+            m_cond.signal();
+          }
+        }
+        if(m_tasks.size() <= ++m_finished)
+        {
+          m_cond.signal();
+        }
+      }
+    }
+
+    /// Thread function.
+    ///
+    /// \param data Task graph.
+    /// \return Thread exit code.
+    static int task_graph_thread(void *data)
+    {
+      static_cast<TaskGraph*>(data)->work();
+      return 0;
+    }
+
+  public:
+    /// Add a dependency.
+    ///
+    /// \param task Task that depends on another.
+    /// \param dependency Task that must be finished first.
+    void addDependency(unsigned task, unsigned dependency)
+    {
+#if defined(USE_LD)
+      if((dependency >= task) || (m_tasks.size() <= task))
+      {
+        std::ostringstream sstr;
+        sstr << "invalid dependency from task " << task << " to task " << dependency;
+        BOOST_THROW_EXCEPTION(std::runtime_error(sstr.str()));
+      }
+      m_tasks[task].m_dependencies.push_back(dependency);
+#endif
+      ++m_tasks[task].m_waiting;
+      m_tasks[dependency].m_dependents.push_back(task);
+    }
+
+    /// Run all tasks.
+    ///
+    /// Calling thread takes part in running the tasks. Returns when all tasks are finished.
+    ///
+    /// \param thread_count Total number of threads to run tasks on.
+    void run(unsigned thread_count)
+    {
+      for(unsigned ii = 0; (m_tasks.size() > ii); ++ii)
+      {
+        if(0 == m_tasks[ii].m_waiting)
+        {
+          m_ready.push_back(ii);
+        }
+      }
+
+#if defined(USE_LD)
+      m_start = dnload_SDL_GetTicks();
+#endif
+
+      // Threads are joined when they go out of scope.
+      seq<uptr<Thread> > threads;
+      for(unsigned ii = 1; (thread_count > ii); ++ii)
+      {
+        threads.emplace_back(new Thread(task_graph_thread, this));
+      }
+      work();
+    }
+
+#if defined(USE_LD)
+    /// Get length of the critical path.
+    ///
+    /// Must only be called after running the graph.
+    ///
+    /// \return Longest total running time of any chain of dependent tasks in milliseconds.
+    uint32_t getCriticalPath() const
+    {
+      seq<uint32_t> path;
+      uint32_t ret = 0;
+
+      path.resize(m_tasks.size());
+      for(unsigned ii = 0; (m_tasks.size() > ii); ++ii)
+      {
+        uint32_t longest = 0;
+        for(unsigned vv : m_tasks[ii].m_dependencies)
+        {
+          longest = std::max(longest, path[vv]);
+        }
+        path[ii] = longest + getDuration(ii);
+        ret = std::max(ret, path[ii]);
+      }
+      return ret;
+    }
+
+    /// Accessor.
+    ///
+    /// \param idx Task index.
+    /// \return Running time of the task in milliseconds.
+    uint32_t getDuration(unsigned idx) const
+    {
+      return m_tasks[idx].m_end - m_tasks[idx].m_start;
+    }
+
+    /// Accessor.
+    ///
+    /// \param idx Task index.
+    /// \return Start time of the task relative to start of graph in milliseconds.
+    uint32_t getStart(unsigned idx) const
+    {
+      return m_tasks[idx].m_start;
+    }
+#endif
+};
+
+#endif
@@ -67,6 +67,18 @@ class uvec4
       return m_data[idx];
     }
 
+    /// Equals operator.
+    ///
+    /// \param rhs Right-hand-side operand.
+    /// \return True if equal, false otherwise.
+    bool operator==(const uvec4 &rhs) const
+    {
+      return ((m_data[0] == rhs.m_data[0]) &&
+          (m_data[1] == rhs.m_data[1]) &&
+          (m_data[2] == rhs.m_data[2]) &&
+          (m_data[3] == rhs.m_data[3]));
+    }
+
   public:
     /// Mix two vectors.
     ///
@@ -124,6 +124,17 @@ class Vertex
       m_color = op;
     }
 
+  public:
+    /// Equals operator.
+    ///
+    /// \param rhs Right-hand-side operand.
+    /// \return True if equal, false otherwise.
+    bool operator==(const Vertex &rhs) const
+    {
+      return ((m_position == rhs.m_position) && (m_texcoord == rhs.m_texcoord) && (m_normal == rhs.m_normal) &&
+          (m_color == rhs.m_color) && (m_weights == rhs.m_weights) && (m_references == rhs.m_references));
+    }
+
 #if defined(USE_LD)
   public:
     /// \param Output to stream.
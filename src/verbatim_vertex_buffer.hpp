@@ -2,8 +2,8 @@
 #define VERBATIM_VERTEX_BUFFER_HPP
 
 #include "verbatim_buffer.hpp"
+#include "verbatim_compact_vertex.hpp"
 #include "verbatim_program.hpp"
-#include "verbatim_vertex.hpp"
 
 /// Array buffer containing vertex data.
 class VertexBuffer : public Buffer
@@ -12,6 +12,17 @@ class VertexBuffer : public Buffer
     /// Current array buffer.
     static const VertexBuffer* g_bound_array_buffer;
 
+  private:
+    /// Does this vertex buffer contain compact vertices?
+    bool m_compact;
+
+  public:
+    /// Constructor.
+    ///
+    /// \param compact True to contain compact vertices instead of full vertices.
+    explicit VertexBuffer(bool compact = false) :
+      m_compact(compact) { }
+
   public:
     /// Bind this array buffer for rendering and/or modification.
     void bind() const
@@ -53,6 +64,25 @@ class VertexBuffer : public Buffer
 #endif
     }
 
+    /// Update this vertex buffer into the GPU.
+    ///
+    /// Empty data will not be updated.
+    ///
+    /// \param data Compact data to update.
+    void update(const seq<CompactVertex> &data) const
+    {
+      if(!data)
+      {
+        return;
+      }
+
+      bind();
+      dnload_glBufferData(GL_ARRAY_BUFFER, data.getSizeBytes(), data.getData(), GL_STATIC_DRAW);
+#if defined(USE_LD)
+      vgl::increment_data_size_vertex(data.getSizeBytes());
+#endif
+    }
+
     /// Use this vertex buffer for rendering.
     ///
     /// \param op Program to use.
@@ -65,6 +95,21 @@ class VertexBuffer : public Buffer
         return;
       }
 
+      // Compact vertices have quantized positions and no bone data.
+      if(m_compact)
+      {
+        vgl::disable_excess_attrib_arrays(4);
+        op.attribPointer('P', 3, GL_SHORT, false, sizeof(CompactVertex),
+            static_cast<const uint8_t*>(NULL) + CompactVertex::POSITION_OFFSET);
+        op.attribPointer('T', 4, GL_BYTE, true, sizeof(CompactVertex),
+            static_cast<const uint8_t*>(NULL) + CompactVertex::TEXCOORD_OFFSET);
+        op.attribPointer('N', 3, GL_BYTE, true, sizeof(CompactVertex),
+            static_cast<const uint8_t*>(NULL) + CompactVertex::NORMAL_OFFSET);
+        op.attribPointer('C', 3, GL_UNSIGNED_BYTE, true, sizeof(CompactVertex),
+            static_cast<const uint8_t*>(NULL) + CompactVertex::COLOR_OFFSET);
+        return;
+      }
+
       vgl::disable_excess_attrib_arrays(4);
       op.attribPointer('P', 3, GL_FLOAT, false, sizeof(Vertex),
           static_cast<const uint8_t*>(NULL) + Vertex::POSITION_OFFSET);
@@ -97,7 +142,7 @@ class VertexBuffer : public Buffer
     /// \return Output stream.
     std::ostream& put(std::ostream &ostr) const
     {
-      return ostr << "VertexBuffer(" << getId() << ')';
+      return ostr << (m_compact ? "CompactVertexBuffer(" : "VertexBuffer(") << getId() << ')';
     }
 #endif
 };